@@ -0,0 +1,451 @@
+// Benchmarks of the hot paths of voyager-overlay
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numbers>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <qpdf/QPDF.hh>
+#include <qpdf/QPDFObjectHandle.hh>
+#include <qpdf/QPDFPageDocumentHelper.hh>
+
+#include "compact_display_list.h"
+#include "document.h"
+#include "flatten.h"
+#include "parallel.h"
+#include "sheet_plan.h"
+#include "svg_import.h"
+
+
+// Exports a full page of overlays in all formats, one backend after
+// another and concurrently.  The files are written to the temporary
+// directory.
+static void benchmark_export()
+{
+  constexpr int repeat = 5;
+
+  DisplayList page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry,
+				 { true, true, true, false, {}, ArtworkUse::PRINT });
+  std::string basename = (std::filesystem::temp_directory_path() / "voyager-overlay-benchmark").string();
+
+  std::vector<std::string> formats(EXPORT_FORMATS.begin(), EXPORT_FORMATS.end());
+  double wall_ms[2] = { 0.0, 0.0 };
+  for (int r = 0; r < repeat; r++)
+    for (bool concurrent: { false, true })
+      wall_ms[concurrent] += export_page(basename, formats, page, "", 150.0, concurrent).wall_ms / repeat;
+  std::cout << std::format("sequential {0:.1f} ms, concurrent {1:.1f} ms, speedup {2:.2f} ({3} CPUs)\n",
+			   wall_ms[0], wall_ms[1], wall_ms[0] / wall_ms[1], std::thread::hardware_concurrency());
+  for (const std::string& format: formats)
+    std::filesystem::remove(basename + "." + format);
+}
+
+
+// Numbers of two content streams that differ by more than one in the
+// last of the 6 significant digits emitted by {:g}, as a value just off a
+// rounding tie may round the other way, or SIZE_MAX if the streams differ
+// other than in numbers.
+static std::size_t count_mismatches(const std::string& a,
+				    const std::string& b,
+				    double& max_difference)
+{
+  std::size_t mismatches = 0;
+  max_difference = 0.0;
+  const char* pa = a.c_str();
+  const char* pb = b.c_str();
+  while (*pa && *pb)
+  {
+    char* ea;
+    char* eb;
+    double va = std::strtod(pa, & ea);
+    double vb = std::strtod(pb, & eb);
+    if ((ea != pa) && (eb != pb))
+    {
+      double last_digit = std::pow(10.0, std::floor(std::log10(std::max(std::abs(va), 1e-6))) - 5.0);
+      max_difference = std::max(max_difference, std::abs(va - vb));
+      if (std::abs(va - vb) > 1.5 * last_digit)
+	mismatches++;
+      pa = ea;
+      pb = eb;
+    }
+    else if (*pa++ != *pb++)
+      return std::numeric_limits<std::size_t>::max();
+  }
+  return (*pa || *pb) ? std::numeric_limits<std::size_t>::max() : mismatches;
+}
+
+// A long roll: a column of overlays, each with outlines and legends,
+// recorded once and appended at increasing offsets.
+static void benchmark_compact()
+{
+  const OverlayGeometry& geom = hp_geometry;
+
+  DisplayList overlay;
+  ContentStreamString recorder(true, true);
+  recorder.record_to(& overlay);
+  emit_overlay(recorder, geom, true, true);
+
+  for (int overlay_count: { 100, 1000 })
+  {
+    DisplayList roll;
+    for (int i = 0; i < overlay_count; i++)
+      roll.append(overlay, { 0.5, 0.5 + i * (geom.height_in + 0.1) });
+
+    auto start = std::chrono::steady_clock::now();
+    CompactDisplayList compact(roll);
+    std::chrono::duration<double, std::milli> compact_ms = std::chrono::steady_clock::now() - start;
+
+    ContentStreamString wide(false);
+    start = std::chrono::steady_clock::now();
+    emit_display_list(wide, roll);
+    std::chrono::duration<double, std::milli> wide_ms = std::chrono::steady_clock::now() - start;
+
+    ContentStreamString narrow(false);
+    start = std::chrono::steady_clock::now();
+    emit_compact_display_list(narrow, compact);
+    std::chrono::duration<double, std::milli> narrow_ms = std::chrono::steady_clock::now() - start;
+
+    double max_difference;
+    std::size_t mismatches = count_mismatches(wide, narrow, max_difference);
+    std::cout << std::format("{0:5} overlays, {1:8} ops: {2:6.1f} MB as doubles, {3:5.1f} MB compact ({4:.1f} bytes/op), "
+			     "compact {5:.1f} ms, emit {6:.1f} ms double, {7:.1f} ms compact\n",
+			     overlay_count, roll.size(), roll.memory_bytes() / 1e6, compact.memory_bytes() / 1e6,
+			     double(compact.memory_bytes()) / roll.size(),
+			     compact_ms.count(), wide_ms.count(), narrow_ms.count());
+    if (mismatches == std::numeric_limits<std::size_t>::max())
+      std::cout << "  output differs in structure\n";
+    else
+      std::cout << std::format("  {0} numbers differ beyond emission precision, largest difference {1:g}, {2}\n",
+			       mismatches, max_difference, (wide == narrow) ? "identical" : "not identical");
+  }
+}
+
+
+// Compares the estimate of a page with the page generated, and measures
+// the estimate of a page, once the overlay of its geometry is measured,
+// and of a run of sheets.
+static void benchmark_generate()
+{
+  constexpr int repeat = 200;
+
+  for (bool common_line: { false, true })
+  {
+    PageOptions options = { true, true, true, common_line, {}, ArtworkUse::PRINT };
+    Estimate e = estimate_pdf(cameo4_no_mat_reg_geometry, hp_geometry, options);
+
+    std::size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+      bytes = create_page_contents(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry,
+				   options, ALL_SLOTS, {}, nullptr, 1).length();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::format("{0}: estimated {1} bytes, {2:.3f} ms; generated {3} bytes, {4:.3f} ms\n",
+			     common_line ? "common line" : "separate", e.uncompressed_bytes,
+			     e.generation_s * 1000.0, bytes, elapsed.count() / repeat);
+
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+      estimate_pdf(cameo4_no_mat_reg_geometry, hp_geometry, options);
+    std::chrono::duration<double, std::micro> page_us = std::chrono::steady_clock::now() - start;
+
+    std::vector<PageSlots> sheets;
+    for (int i = 0; i < 1000; i++)
+      sheets.push_back({ (i % 2) ? & sm_geometry : & hp_geometry, std::size_t(1 + i % 8), {} });
+    start = std::chrono::steady_clock::now();
+    estimate_pages(cameo4_no_mat_reg_geometry, options, sheets);
+    std::chrono::duration<double, std::micro> sheets_us = std::chrono::steady_clock::now() - start;
+    std::cout << std::format("  estimate of a page: {0:.1f} us; of {1} sheets: {2:.2f} us per sheet\n",
+			     page_us.count() / repeat, sheets.size(), sheets_us.count() / sheets.size());
+  }
+}
+
+
+// Generates the slots of a long roll page, as used for nested or roll
+// media, with increasing numbers of threads.
+static void benchmark_slots()
+{
+  constexpr int slot_count = 512;
+  constexpr int repeat = 20;
+
+  std::vector<SlotPlacement> slots;
+  for (int i = 0; i < slot_count; i++)
+    slots.push_back({ 0.5 + (i % 4) * (hp_geometry.width_in + 0.1),
+		      0.5 + (i / 4) * (hp_geometry.height_in + 0.1) });
+
+  PageOptions options = { true, false, true, false, {}, ArtworkUse::PRINT };
+  std::string reference;
+  append_slots(reference, slots, hp_geometry, options, {}, "", nullptr, 1);
+
+  double base_ms = 0.0;
+  for (unsigned threads: { 1, 2, 4, 8, 16 })
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+    {
+      std::string contents;
+      append_slots(contents, slots, hp_geometry, options, {}, "", nullptr, threads);
+      if (contents != reference)
+	throw std::runtime_error("parallel output differs from serial output");
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    double ms = elapsed.count() / repeat;
+    if (threads == 1)
+      base_ms = ms;
+    std::cout << std::format("{0:2} threads: {1:8.3f} ms per {2} slots, speedup {3:.2f}\n",
+			     threads, ms, slot_count, base_ms / ms);
+  }
+
+  // The cost of a call itself, as made for each page of a plan.
+  constexpr int calls = 2000;
+  for (unsigned threads: { 2, 4, 8 })
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < calls; r++)
+      parallel_for(threads, threads, [](std::size_t) { });
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::format("{0:2} threads: {1:6.1f} us per empty call\n", threads, elapsed.count() / calls);
+  }
+}
+
+// Assembles documents of many pages, each with a trivial content stream,
+// to compare building the page objects directly from a template with
+// formatting and parsing each page dictionary, as was done before.
+static void benchmark_pages()
+{
+  for (int page_count: { 100, 1000, 10000 })
+  {
+    double us[2];
+    for (bool direct: { false, true })
+    {
+      QPDF pdf;
+      pdf.emptyPDF();
+      QPDFObjectHandle font_obj = pdf.makeIndirectObject(QPDFObjectHandle::newDictionary());
+      QPDFPageDocumentHelper dh(pdf);
+
+      auto start = std::chrono::steady_clock::now();
+      PageTemplate page_template = create_page_template(pdf, "F1", font_obj, letter_width_pt, letter_height_pt);
+      for (int i = 0; i < page_count; i++)
+      {
+	QPDFObjectHandle contents = pdf.newStream("q Q\n");
+	if (direct)
+	{
+	  assemble_page(dh, page_template, contents);
+	  continue;
+	}
+	QPDFObjectHandle rfont = QPDFObjectHandle::newDictionary();
+	rfont.replaceKey("/F1", font_obj);
+	QPDFObjectHandle resources = QPDFObjectHandle::newDictionary();
+	resources.replaceKey("/ProcSet", "[/PDF /Text]"_qpdf);
+	resources.replaceKey("/Font", rfont);
+	QPDFObjectHandle page = pdf.makeIndirectObject(QPDFObjectHandle::parse(
+	  "<< /Type /Page /MediaBox [0 0 "
+	  + std::format("{0:g} {1:g}", letter_width_pt, letter_height_pt)
+	  + "] >>"));
+	page.replaceKey("/Contents", contents);
+	page.replaceKey("/Resources", resources);
+	dh.addPage(page, false);
+      }
+      std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      us[direct] = elapsed.count() / page_count;
+    }
+    std::cout << std::format("{0:5} pages: parsed {1:.2f} us/page, direct {2:.2f} us/page, speedup {3:.2f}\n",
+			     page_count, us[0], us[1], us[0] / us[1]);
+  }
+}
+
+
+// Measures flattening throughput on pseudo-random curves.
+static void benchmark_flatten()
+{
+  constexpr std::size_t curve_count = 100000;
+  constexpr int repeat = 20;
+  constexpr double tolerance = 0.001;	// inches
+
+  std::vector<CubicBezier> curves;
+  uint32_t seed = 1;
+  auto random = [&seed]() { seed = seed * 1664525 + 1013904223; return (seed >> 8) * (10.0 / (1 << 24)); };
+  for (std::size_t i = 0; i < curve_count; i++)
+    curves.push_back({ { random(), random() }, { random(), random() },
+		       { random(), random() }, { random(), random() } });
+
+  std::vector<Coord> points;
+  std::size_t segments = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; r++)
+  {
+    points.clear();
+    flatten_cubics(curves, tolerance, points);
+    segments += points.size();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << std::format("{0} curves, tolerance {1:g} in: {2:.1f} Msegments/s, {3:.1f} Mcurves/s\n",
+			   curve_count, tolerance,
+			   segments / elapsed.count() / 1e6,
+			   curve_count * repeat / elapsed.count() / 1e6);
+
+  // the same curves one per call, as the backends used to flatten them
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; r++)
+  {
+    points.clear();
+    for (const CubicBezier& curve: curves)
+      flatten_cubics({ & curve, 1 }, tolerance, points);
+  }
+  elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << std::format("one curve per call: {0:.1f} Mcurves/s\n",
+			   curve_count * repeat / elapsed.count() / 1e6);
+}
+
+
+// A day's queue: mostly small orders, of two models, a handful of legend
+// sets, due over the next two weeks.
+static void benchmark_plan()
+{
+  constexpr int repeat = 20;
+
+  for (std::size_t order_count: { 1000, 5000, 20000 })
+  {
+    std::mt19937 rng(1);
+    std::vector<Order> orders;
+    std::size_t overlays = 0;
+    for (std::size_t i = 0; i < order_count; i++)
+    {
+      unsigned quantity = (rng() % 8 == 0) ? 1 + rng() % 40 : 1 + rng() % 3;
+      orders.push_back({ std::format("{0}", 100000 + i),
+			 (rng() % 3) ? "voyager" : "dm1xl",
+			 std::format("set-{0}", rng() % 6),
+			 quantity,
+			 20231101 + int(rng() % 14) });
+      overlays += quantity;
+    }
+    std::map<std::string, std::size_t> slot_counts = { { "voyager", 8 }, { "dm1xl", 8 } };
+
+    std::size_t sheet_count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+      sheet_count = plan_sheets(orders, slot_counts).size();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::format("{0:5} orders, {1:6} overlays: {2:5} sheets, {3:8.3f} ms\n",
+			     order_count, overlays, sheet_count, elapsed.count() / repeat);
+  }
+}
+
+
+// Imports a logo as a bitmap tracer without curve fitting would produce
+// it: the outline of a disc with a hole, as pixel steps, plus a few
+// curves, and simplifies it.
+static void benchmark_svg()
+{
+  constexpr int radius_px = 4000;
+  constexpr int repeat = 5;
+
+  std::string d;
+  for (int r: { radius_px, radius_px / 2 })
+  {
+    // the circle rounded to pixels, with a corner at every pixel step
+    int n = 16 * r;
+    int px = r;
+    int py = 0;
+    d += std::format("M{0} {1}", px, py);
+    for (int i = 1; i <= n; i++)
+    {
+      double angle = 2.0 * std::numbers::pi * i / n;
+      int x = std::lround(r * std::cos(angle));
+      int y = std::lround(r * std::sin(angle));
+      if ((x == px) && (y == py))
+	continue;
+      if ((x != px) && (y != py))
+	d += std::format("L{0} {1}", x, py);
+      d += std::format("L{0} {1}", x, y);
+      px = x;
+      py = y;
+    }
+    d += "Z";
+  }
+  d += std::format("M0 0C{0} 0 {0} {0} 0 {0}Z", radius_px / 4);
+  std::string svg = "<svg xmlns=\"http://www.w3.org/2000/svg\"><g transform=\"translate(5000 5000)\"><path d=\""
+		    + d + "\"/></g></svg>";
+
+  std::size_t before = 0;
+  std::size_t after = 0;
+  double import_ms = 0.0;
+  double simplify_ms = 0.0;
+  for (int r = 0; r < repeat; r++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<SvgSubpath> paths = import_svg(svg);
+    fit_svg_paths(paths, { 0.0, 0.0 }, { 2.0, 2.0 });
+    auto imported = std::chrono::steady_clock::now();
+    before = svg_node_count(paths);
+    simplify_svg_paths(paths, 0.001);
+    auto simplified = std::chrono::steady_clock::now();
+    after = svg_node_count(paths);
+    import_ms += std::chrono::duration<double, std::milli>(imported - start).count() / repeat;
+    simplify_ms += std::chrono::duration<double, std::milli>(simplified - imported).count() / repeat;
+  }
+  std::cout << std::format("{0} bytes of path data, {1} nodes: import {2:.2f} ms\n",
+			   d.length(), before, import_ms);
+  std::cout << std::format("simplified to {0} nodes at 0.001 in: {1:.2f} ms\n", after, simplify_ms);
+}
+
+struct Benchmark
+{
+  const char* name;
+  void (*function)();
+};
+
+static constexpr Benchmark benchmarks[] =
+{
+  { "slots",    benchmark_slots },
+  { "flatten",  benchmark_flatten },
+  { "generate", benchmark_generate },
+  { "svg",      benchmark_svg },
+  { "pages",    benchmark_pages },
+  { "plan",     benchmark_plan },
+  { "export",   benchmark_export },
+  { "compact",  benchmark_compact },
+};
+
+// Runs the named benchmarks, or all of them if none are named.
+int main(int argc, char* argv[])
+{
+  try
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      bool found = false;
+      for (const Benchmark& benchmark: benchmarks)
+	found = found || (argv[i] == std::string(benchmark.name));
+      if (! found)
+	throw std::logic_error(std::format("unknown benchmark `{0}'", argv[i]));
+    }
+    for (const Benchmark& benchmark: benchmarks)
+    {
+      bool selected = argc == 1;
+      for (int i = 1; i < argc; i++)
+	selected = selected || (argv[i] == std::string(benchmark.name));
+      if (! selected)
+	continue;
+      std::cout << benchmark.name << ":\n";
+      benchmark.function();
+    }
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
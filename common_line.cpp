@@ -0,0 +1,385 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "common_line.h"
+#include "flatten.h"
+
+// A line (p[0] to p[3]) or a cubic curve (p[0] to p[3] via p[1], p[2]).
+struct CutEdge
+{
+  bool curve;
+  Coord p[4];
+
+  Coord start() const { return p[0]; }
+  Coord end() const { return p[3]; }
+
+  CutEdge reversed() const { return { curve, { p[3], p[2], p[1], p[0] } }; }
+};
+
+static double distance(Coord a,
+		       Coord b)
+{
+  return std::hypot(b.x - a.x, b.y - a.y);
+}
+
+// for comparing distances, without the cost of hypot()
+static double squared_distance(Coord a,
+			       Coord b)
+{
+  return (b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y);
+}
+
+// The curves are flattened together, filling the lanes of
+// flatten_cubics().
+static double total_length(const std::vector<CutEdge>& edges,
+			   double tolerance)
+{
+  double length = 0.0;
+  std::vector<CubicBezier> curves;
+  for (const CutEdge& edge: edges)
+  {
+    if (edge.curve)
+      curves.push_back({ edge.p[0], edge.p[1], edge.p[2], edge.p[3] });
+    else
+      length += distance(edge.start(), edge.end());
+  }
+
+  std::vector<Coord> points;
+  std::vector<unsigned> counts;
+  flatten_cubics(curves, tolerance, points, & counts);
+  std::size_t next = 0;
+  for (std::size_t i = 0; i < curves.size(); i++)
+  {
+    Coord previous = curves[i].p0;
+    for (unsigned k = 0; k < counts[i]; k++)
+    {
+      length += distance(previous, points[next]);
+      previous = points[next++];
+    }
+  }
+  return length;
+}
+
+static std::vector<CutEdge> outline_edges(const DisplayList& outlines,
+					  double tolerance)
+{
+  std::vector<CutEdge> edges;
+  Coord current = { 0.0, 0.0 };
+  Coord subpath_start = current;
+
+  auto add_line = [&](Coord dest)
+  {
+    if (distance(current, dest) > tolerance)
+      edges.push_back({ false, { current, current, dest, dest } });
+  };
+
+  for (std::size_t i = 0; i < outlines.size(); i++)
+  {
+    const DisplayOp& op = outlines[i];
+    if (op.element.role != ElementRole::OVERLAY_OUTLINE)
+      continue;
+    switch (op.kind)
+    {
+    case DisplayOpKind::MOVE_TO:
+      current = op.p[0];
+      subpath_start = current;
+      continue;
+    case DisplayOpKind::LINE_TO:
+      add_line(op.p[0]);
+      current = op.p[0];
+      continue;
+    case DisplayOpKind::CURVE_TO:
+      edges.push_back({ true, { current, op.p[0], op.p[1], op.p[2] } });
+      current = op.p[2];
+      continue;
+    case DisplayOpKind::CLOSE:
+    case DisplayOpKind::CLOSE_STROKE:
+    case DisplayOpKind::CLOSE_FILL_STROKE:
+      add_line(subpath_start);
+      current = subpath_start;
+      continue;
+    default:
+      continue;
+    }
+  }
+  return edges;
+}
+
+// The line an edge lies on: its direction, made to point right (or up),
+// and its signed distance from the origin.
+struct EdgeLine
+{
+  long long direction;		// quantized angle
+  double offset;
+  std::size_t edge;
+};
+
+// Directions closer than this are the same, as they are quantized for
+// sorting.  Edges with directions that differ by less, but are quantized
+// differently, are only cut twice, never left out.
+static constexpr double DIRECTION_QUANTUM_RAD = 1e-9;
+
+static Coord unit_direction(Coord a,
+			    Coord b)
+{
+  double length = distance(a, b);
+  Coord d = { (b.x - a.x) / length, (b.y - a.y) / length };
+  if ((d.x < 0.0) || ((d.x == 0.0) && (d.y < 0.0)))
+    d = { -d.x, -d.y };
+  return d;
+}
+
+// Replaces the line edges with the union of the collinear ones, leaving
+// the curves alone.  The lines are sorted by direction and offset, so
+// that collinear edges are adjacent, rather than each compared with all
+// the others.
+static std::vector<CutEdge> merge_collinear(const std::vector<CutEdge>& edges,
+					    double tolerance)
+{
+  std::vector<CutEdge> merged;
+  std::vector<EdgeLine> lines;
+  for (std::size_t i = 0; i < edges.size(); i++)
+  {
+    const CutEdge& edge = edges[i];
+    if (edge.curve)
+    {
+      merged.push_back(edge);
+      continue;
+    }
+    Coord d = unit_direction(edge.start(), edge.end());
+    lines.push_back({ std::llround(std::atan2(d.y, d.x) / DIRECTION_QUANTUM_RAD),
+		      edge.start().y * d.x - edge.start().x * d.y,
+		      i });
+  }
+  std::sort(lines.begin(), lines.end(),
+	    [](const EdgeLine& a, const EdgeLine& b)
+	    { return std::tie(a.direction, a.offset) < std::tie(b.direction, b.offset); });
+
+  std::vector<std::pair<double, double>> intervals;
+  for (std::size_t first = 0; first < lines.size(); )
+  {
+    // The first edge of a run of collinear edges is the reference line,
+    // along which the others are measured.
+    const CutEdge& reference = edges[lines[first].edge];
+    Coord a = reference.start();
+    Coord d = unit_direction(a, reference.end());
+    auto offset = [&](Coord p) { return std::abs((p.x - a.x) * d.y - (p.y - a.y) * d.x); };
+    auto along  = [&](Coord p) { return (p.x - a.x) * d.x + (p.y - a.y) * d.y; };
+
+    intervals.clear();
+    std::size_t last = first;
+    for (; last < lines.size(); last++)
+    {
+      const CutEdge& edge = edges[lines[last].edge];
+      if ((lines[last].direction != lines[first].direction) ||
+	  (offset(edge.start()) > tolerance) || (offset(edge.end()) > tolerance))
+	break;
+      double s0 = along(edge.start());
+      double s1 = along(edge.end());
+      intervals.push_back({ std::min(s0, s1), std::max(s0, s1) });
+    }
+    first = last;
+
+    std::sort(intervals.begin(), intervals.end());
+    for (std::size_t i = 0; i < intervals.size(); )
+    {
+      auto [r0, r1] = intervals[i];
+      for (i++; (i < intervals.size()) && (intervals[i].first <= r1 + tolerance); i++)
+	r1 = std::max(r1, intervals[i].second);
+      if (r1 - r0 <= tolerance)
+	continue;
+      Coord p0 = { a.x + d.x * r0, a.y + d.y * r0 };
+      Coord p1 = { a.x + d.x * r1, a.y + d.y * r1 };
+      merged.push_back({ false, { p0, p0, p1, p1 } });
+    }
+  }
+  return merged;
+}
+
+// Directions in which an edge leaves its start and enters its end.
+static Coord start_tangent(const CutEdge& edge)
+{
+  for (unsigned i = 1; i < 4; i++)
+    if ((edge.p[i].x != edge.p[0].x) || (edge.p[i].y != edge.p[0].y))
+      return { edge.p[i].x - edge.p[0].x, edge.p[i].y - edge.p[0].y };
+  return { 0.0, 0.0 };
+}
+
+static Coord end_tangent(const CutEdge& edge)
+{
+  for (int i = 2; i >= 0; i--)
+    if ((edge.p[i].x != edge.p[3].x) || (edge.p[i].y != edge.p[3].y))
+      return { edge.p[3].x - edge.p[i].x, edge.p[3].y - edge.p[i].y };
+  return { 0.0, 0.0 };
+}
+
+// Cosine of the turn from one direction to another; 1 for straight on.
+static double turn_cosine(Coord from,
+			  Coord to)
+{
+  double lengths = std::hypot(from.x, from.y) * std::hypot(to.x, to.y);
+  if (lengths == 0.0)
+    return 1.0;
+  return (from.x * to.x + from.y * to.y) / lengths;
+}
+
+// A path isn't continued through a turn of more than a right angle, such
+// as the cusp where the rounded corners of two adjacent overlays meet the
+// edge they share; the blade would swivel in place there, notching both
+// overlays.  Another path starts there instead.
+static constexpr double MINIMUM_TURN_COSINE = -0.01;
+
+
+CommonLineStats emit_common_line_cut(ContentStreamString& cs,
+				     const DisplayList& outlines,
+				     double tolerance)
+{
+  CommonLineStats stats = { 0.0, 0.0, 0.0, 0 };
+
+  std::vector<CutEdge> edges = outline_edges(outlines, tolerance);
+  stats.original_length_in = total_length(edges, tolerance);
+
+  edges = merge_collinear(edges, tolerance);
+  stats.cut_length_in = total_length(edges, tolerance);
+
+  // Chain the edges into paths, starting each path from the free end
+  // nearest to where the previous path ended, and continuing each with
+  // the edge that turns least.
+  std::vector<bool> used(edges.size(), false);
+  std::vector<std::size_t> unused(edges.size());
+  std::iota(unused.begin(), unused.end(), 0);
+  Coord pen = { 0.0, 0.0 };
+
+  // The edges by the cells of a grid, of the tolerance in size, that
+  // their ends are in, so that the ends near a point are all in the
+  // cells around it.
+  auto cell = [tolerance](Coord p)
+  {
+    return std::pair(std::llround(std::floor(p.x / tolerance)), std::llround(std::floor(p.y / tolerance)));
+  };
+  std::map<std::pair<long long, long long>, std::vector<std::size_t>> ends;
+  for (std::size_t i = 0; i < edges.size(); i++)
+  {
+    ends[cell(edges[i].start())].push_back(i);
+    if (cell(edges[i].end()) != cell(edges[i].start()))
+      ends[cell(edges[i].end())].push_back(i);
+  }
+
+  // An unused edge that continues the path at p, where it has the given
+  // direction, oriented to start at p, or if backward, one that leads
+  // into the path at p, oriented to end at p.
+  auto take_edge_at = [&](Coord p,
+			  Coord direction,
+			  bool backward) -> std::pair<bool, CutEdge>
+  {
+    std::size_t best = edges.size();
+    CutEdge best_edge = {};
+    double best_cosine = MINIMUM_TURN_COSINE;
+    auto [cx, cy] = cell(p);
+    for (long long x = cx - 1; x <= cx + 1; x++)
+      for (long long y = cy - 1; y <= cy + 1; y++)
+      {
+	auto it = ends.find({ x, y });
+	if (it == ends.end())
+	  continue;
+	for (std::size_t i: it->second)
+	{
+	  if (used[i])
+	    continue;
+	  for (bool r: { false, true })
+	  {
+	    CutEdge edge = r ? edges[i].reversed() : edges[i];
+	    if (distance(backward ? edge.end() : edge.start(), p) > tolerance)
+	      continue;
+	    double cosine = backward ? turn_cosine(end_tangent(edge), direction)
+				     : turn_cosine(direction, start_tangent(edge));
+	    if ((cosine > best_cosine) || ((cosine == best_cosine) && (i < best)))
+	    {
+	      best = i;
+	      best_edge = edge;
+	      best_cosine = cosine;
+	    }
+	  }
+	}
+      }
+    if (best == edges.size())
+      return { false, {} };
+    used[best] = true;
+    return { true, best_edge };
+  };
+
+  cs.begin_segment({ ElementRole::COMMON_CUT, 0 });
+
+  while (true)
+  {
+    // the edges taken by the previous path are dropped, so that each
+    // search only looks at the edges left
+    std::erase_if(unused, [&used](std::size_t i) { return used[i]; });
+    if (unused.empty())
+      break;
+
+    std::size_t nearest = 0;
+    bool reverse = false;
+    double nearest_distance = std::numeric_limits<double>::infinity();
+    for (std::size_t i: unused)
+    {
+      for (bool r: { false, true })
+      {
+	double dist = squared_distance(pen, r ? edges[i].end() : edges[i].start());
+	if (dist < nearest_distance)
+	{
+	  nearest = i;
+	  reverse = r;
+	  nearest_distance = dist;
+	}
+      }
+    }
+    used[nearest] = true;
+
+    std::deque<CutEdge> path { reverse ? edges[nearest].reversed() : edges[nearest] };
+    while (true)
+    {
+      auto [found, edge] = take_edge_at(path.back().end(), end_tangent(path.back()), false);
+      if (! found)
+	break;
+      path.push_back(edge);
+    }
+    // if the path isn't closed, try to extend it backwards too
+    while (distance(path.front().start(), path.back().end()) > tolerance)
+    {
+      auto [found, edge] = take_edge_at(path.front().start(), start_tangent(path.front()), true);
+      if (! found)
+	break;
+      path.push_front(edge);
+    }
+
+    stats.travel_in += distance(pen, path.front().start());
+    cs.move_to(path.front().start());
+    for (const CutEdge& edge: path)
+    {
+      if (edge.curve)
+	cs.curve_to(edge.p[1], edge.p[2], edge.p[3]);
+      else
+	cs.line_to(edge.end());
+    }
+    if (distance(path.front().start(), path.back().end()) <= tolerance)
+      cs.path_close_stroke();
+    else
+      cs.path_stroke();
+    pen = path.back().end();
+    stats.path_count++;
+  }
+  cs.end_segment();
+
+  return stats;
+}
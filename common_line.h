@@ -0,0 +1,31 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef COMMON_LINE_H
+#define COMMON_LINE_H
+
+#include "content_stream_string.h"
+#include "display_list.h"
+
+// Common-line cutting: when overlays are placed with no gap between them,
+// adjacent outlines share edges, which only need to be cut once.
+
+struct CommonLineStats
+{
+  double original_length_in;	// total length of all outlines
+  double cut_length_in;		// length actually cut
+  double travel_in;		// length of moves between cut paths
+  unsigned path_count;
+};
+
+// Emits the OVERLAY_OUTLINE paths of the display list as cut paths, in
+// one COMMON_CUT segment, with collinear overlapping edges merged into
+// single segments, and the remaining edges chained into as few paths as
+// possible, ordered to reduce travel between them.  Paths don't turn
+// back on themselves.  Edges are considered coincident if they are
+// within tolerance of each other.
+CommonLineStats emit_common_line_cut(ContentStreamString& cs,
+				     const DisplayList& outlines,
+				     double tolerance);
+
+#endif // COMMON_LINE_H
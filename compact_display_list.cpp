@@ -0,0 +1,236 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+#include <stdexcept>
+
+#include "compact_display_list.h"
+
+static int32_t quantize(double value,
+			double origin)
+{
+  double q = std::round((value - origin) / COMPACT_QUANTUM_IN);
+  if ((q < std::numeric_limits<int32_t>::min()) || (q > std::numeric_limits<int32_t>::max()))
+    throw std::invalid_argument("point too far from its element origin for compact storage");
+  return static_cast<int32_t>(q);
+}
+
+static double widen(int32_t value,
+		    double origin)
+{
+  return origin + value * COMPACT_QUANTUM_IN;
+}
+
+// numbers stored for each kind of operation
+static unsigned value_count(DisplayOpKind kind)
+{
+  switch (kind)
+  {
+  case DisplayOpKind::SET_LINE_WIDTH:
+    return 1;
+  case DisplayOpKind::SET_FILL_COLOR:
+  case DisplayOpKind::SET_STROKE_COLOR:
+    return 3;
+  case DisplayOpKind::FILL:
+  case DisplayOpKind::FILL_STROKE:
+  case DisplayOpKind::CLOSE_FILL_STROKE:
+    return 1;			// fill rule
+  case DisplayOpKind::TEXT:
+    return 1 + 2 * display_op_point_count(kind);
+  default:
+    return 2 * display_op_point_count(kind);
+  }
+}
+
+static int32_t float_bits(double value)
+{
+  return std::bit_cast<int32_t>(static_cast<float>(value));
+}
+
+static double float_value(int32_t bits)
+{
+  return std::bit_cast<float>(bits);
+}
+
+
+CompactDisplayList::CompactDisplayList(const DisplayList& list)
+{
+  // Appended lists repeat the same texts, so each is only kept once.
+  std::map<std::tuple<std::string, std::string, double, HorizontalAlignment>, uint32_t> text_indices;
+  std::vector<uint32_t> text_index(list.texts().size());
+  for (std::size_t i = 0; i < list.texts().size(); i++)
+  {
+    const DisplayText& text = list.texts()[i];
+    auto [it, inserted] = text_indices.try_emplace({ text.text, text.font_name, text.font_size, text.horizontal_alignment },
+						   text_table.size());
+    if (inserted)
+      text_table.push_back(text);
+    text_index[i] = it->second;
+  }
+
+  kinds.reserve(list.size());
+  values.reserve(list.size() * 2);
+  for (std::size_t i = 0; i < list.size(); i++)
+  {
+    const DisplayOp& op = list[i];
+    if (runs.empty() || (op.element != runs.back().element))
+    {
+      Coord origin = { 0.0, 0.0 };
+      for (std::size_t j = i; (j < list.size()) && (list[j].element == op.element); j++)
+	if (display_op_point_count(list[j].kind))
+	{
+	  origin = list[j].p[0];
+	  break;
+	}
+      runs.push_back({ op.element, origin, static_cast<uint32_t>(i), static_cast<uint32_t>(values.size()) });
+    }
+    const Coord& origin = runs.back().origin;
+
+    kinds.push_back(static_cast<uint8_t>(op.kind));
+    switch (op.kind)
+    {
+    case DisplayOpKind::SET_LINE_WIDTH:
+      values.push_back(float_bits(op.p[0].x));
+      break;
+    case DisplayOpKind::SET_FILL_COLOR:
+    case DisplayOpKind::SET_STROKE_COLOR:
+      values.push_back(float_bits(op.p[0].x));
+      values.push_back(float_bits(op.p[0].y));
+      values.push_back(float_bits(op.p[1].x));
+      break;
+    case DisplayOpKind::FILL:
+    case DisplayOpKind::FILL_STROKE:
+    case DisplayOpKind::CLOSE_FILL_STROKE:
+      values.push_back(static_cast<int32_t>(op.aux));
+      break;
+    case DisplayOpKind::TEXT:
+      values.push_back(static_cast<int32_t>(text_index[op.aux]));
+      [[fallthrough]];
+    default:
+      for (unsigned j = 0; j < display_op_point_count(op.kind); j++)
+      {
+	values.push_back(quantize(op.p[j].x, origin.x));
+	values.push_back(quantize(op.p[j].y, origin.y));
+      }
+      break;
+    }
+  }
+  runs.shrink_to_fit();
+  values.shrink_to_fit();
+}
+
+std::size_t CompactDisplayList::memory_bytes() const
+{
+  std::size_t bytes = (sizeof(*this) + runs.capacity() * sizeof(Run) + kinds.capacity() +
+		       values.capacity() * sizeof(int32_t) + text_table.capacity() * sizeof(DisplayText));
+  for (const DisplayText& text: text_table)
+    bytes += text.text.capacity() + text.font_name.capacity();
+  return bytes;
+}
+
+void CompactDisplayList::decode(const std::function<void(const DisplayOp&)>& fn) const
+{
+  decode(0, kinds.size(), fn);
+}
+
+void CompactDisplayList::decode(std::size_t first,
+				std::size_t count,
+				const std::function<void(const DisplayOp&)>& fn) const
+{
+  if (count == 0)
+    return;
+  // the last run starting at or before first
+  std::size_t run = std::upper_bound(runs.begin(), runs.end(), first,
+				     [](std::size_t i, const Run& r) { return i < r.first_op; }) - runs.begin() - 1;
+  std::size_t v = runs[run].first_value;
+  for (std::size_t i = runs[run].first_op; i < first; i++)
+    v += value_count(static_cast<DisplayOpKind>(kinds[i]));
+
+  for (std::size_t i = first; i < first + count; i++)
+  {
+    while ((run + 1 < runs.size()) && (runs[run + 1].first_op <= i))
+      run++;
+    const Coord& origin = runs[run].origin;
+
+    DisplayOp op = { static_cast<DisplayOpKind>(kinds[i]), runs[run].element, {}, 0 };
+    switch (op.kind)
+    {
+    case DisplayOpKind::SET_LINE_WIDTH:
+      op.p[0].x = float_value(values[v++]);
+      break;
+    case DisplayOpKind::SET_FILL_COLOR:
+    case DisplayOpKind::SET_STROKE_COLOR:
+      op.p[0].x = float_value(values[v++]);
+      op.p[0].y = float_value(values[v++]);
+      op.p[1].x = float_value(values[v++]);
+      break;
+    case DisplayOpKind::FILL:
+    case DisplayOpKind::FILL_STROKE:
+    case DisplayOpKind::CLOSE_FILL_STROKE:
+      op.aux = static_cast<uint32_t>(values[v++]);
+      break;
+    case DisplayOpKind::TEXT:
+      op.aux = static_cast<uint32_t>(values[v++]);
+      [[fallthrough]];
+    default:
+      for (unsigned j = 0; j < display_op_point_count(op.kind); j++)
+      {
+	op.p[j].x = widen(values[v++], origin.x);
+	op.p[j].y = widen(values[v++], origin.y);
+      }
+      break;
+    }
+    fn(op);
+  }
+}
+
+DisplayList CompactDisplayList::expand() const
+{
+  DisplayList list;
+  expand(0, kinds.size(), list);
+  return list;
+}
+
+void CompactDisplayList::expand(std::size_t first,
+				std::size_t count,
+				DisplayList& list) const
+{
+  decode(first, count, [&](const DisplayOp& op)
+  {
+    if (op.kind == DisplayOpKind::TEXT)
+      list.add_text(op.element, op.p[0], text_table[op.aux]);
+    else if (display_op_is_fill(op.kind))
+      list.add_fill(op.kind, op.element, display_op_fill_rule(op));
+    else
+      list.add(op.kind, op.element, op.p[0], op.p[1], op.p[2]);
+  });
+}
+
+
+std::vector<DisplayItem> display_items(const CompactDisplayList& list)
+{
+  DisplayItemCollector collector;
+  std::size_t i = 0;
+  list.decode([&](const DisplayOp& op)
+  {
+    collector.add(i++, op, list.texts());
+  });
+  return std::move(collector.items);
+}
+
+
+void emit_compact_display_list(ContentStreamString& cs,
+			       const CompactDisplayList& list)
+{
+  cs.set_color_space("DeviceRGB", true, true);
+  list.decode([&](const DisplayOp& op)
+  {
+    emit_display_op(cs, op, list.texts());
+  });
+}
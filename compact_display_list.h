@@ -0,0 +1,77 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef COMPACT_DISPLAY_LIST_H
+#define COMPACT_DISPLAY_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "display_list.h"
+
+// Compact storage of display lists, for jobs such as long rolls or large
+// nested sheets whose recorded geometry would be too large to hold as
+// DisplayOps, at 64 bytes each.  Points are stored relative to the origin
+// of their element, as 32-bit integers in units of the quantum, which is
+// well below the precision of emission, and are only widened back to
+// doubles as the operations are decoded.  Colors and line widths are
+// stored as floats, and identical texts are stored once.
+
+static constexpr double COMPACT_QUANTUM_IN = 1e-6;
+
+class CompactDisplayList
+{
+public:
+  // Throws std::invalid_argument if a point is too far from the origin
+  // of its element, about 2000 inches.
+  explicit CompactDisplayList(const DisplayList& list);
+
+  std::size_t size() const { return kinds.size(); }
+  const std::vector<DisplayText>& texts() const { return text_table; }
+
+  // including the text table
+  std::size_t memory_bytes() const;
+
+  // Calls fn with each operation, widened, in order.
+  void decode(const std::function<void(const DisplayOp&)>& fn) const;
+
+  DisplayList expand() const;
+
+  // Appends count operations from first to list, e.g. those of the items
+  // a tile shows.  Decoding starts at the run of first, so only the
+  // operations of that run before first are skipped.
+  void expand(std::size_t first,
+	      std::size_t count,
+	      DisplayList& list) const;
+
+private:
+  // A run of consecutive operations of one element.  The origin is the
+  // first point of the run.
+  struct Run
+  {
+    ElementId element;
+    Coord origin;
+    uint32_t first_op;
+    uint32_t first_value;
+  };
+
+  void decode(std::size_t first,
+	      std::size_t count,
+	      const std::function<void(const DisplayOp&)>& fn) const;
+
+  std::vector<Run> runs;
+  std::vector<uint8_t> kinds;		// DisplayOpKind
+  std::vector<int32_t> values;		// of all operations, in order
+  std::vector<DisplayText> text_table;
+};
+
+// As display_items(), decoding the operations one at a time.
+std::vector<DisplayItem> display_items(const CompactDisplayList& list);
+
+// As emit_display_list(), decoding the operations one at a time.
+void emit_compact_display_list(ContentStreamString& cs,
+			       const CompactDisplayList& list);
+
+#endif // COMPACT_DISPLAY_LIST_H
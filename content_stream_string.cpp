@@ -1,43 +1,172 @@
 // Copyright 2023 Eric Smith
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <algorithm>
 #include <cmath>
 #include <format>
 #include <stdexcept>
 #include <string>
 
-#include <ft2build.h>
-#include FT_FREETYPE_H
-
 #include "content_stream_string.h"
+#include "display_list.h"
 
-ContentStreamString::ContentStreamString(bool path_graphics_state):
+ContentStreamString::ContentStreamString(bool path_graphics_state,
+					 bool count_only):
   std::string(),
   trailer_length(0),
   have_last_coord(false),
-  last_coord(0.0, 0.0)
+  last_coord(0.0, 0.0),
+  segment_open(false),
+  recording(nullptr),
+  count_only(count_only),
+  operators(0),
+  counted_bytes(0)
 {
   if (path_graphics_state)
   {
-    *this += "q Q\n";
+    if (count_only)
+      counted_bytes = 4;
+    else
+      *this += "q Q\n";
+    operators = 2;
     trailer_length = 2;
   }
 }
 
+std::size_t formatted_length(double value)
+{
+  // {:g} has six significant digits, trailing zeros removed, and uses
+  // exponential notation if the exponent is less than -4 or at least 6.
+  if (value == 0.0)
+    return std::signbit(value) ? 2 : 1;
+  if (! std::isfinite(value))
+    return std::isnan(value) ? 3 : (value < 0) ? 4 : 3;
+
+  std::size_t length = (value < 0) ? 1 : 0;
+  value = std::abs(value);
+  int exponent = std::floor(std::log10(value));
+  // Scale to six integer digits in extended precision, dividing by exact
+  // powers of ten rather than multiplying by inexact ones, so that values
+  // just below a rounding tie aren't rounded up.
+  static constexpr long double powers_of_ten[] =
+  {
+    1e0L,  1e1L,  1e2L,  1e3L,  1e4L,  1e5L,  1e6L,  1e7L,
+    1e8L,  1e9L,  1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L,
+    1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L,
+    1e24L, 1e25L, 1e26L, 1e27L
+  };
+  auto power_of_ten = [](int n) -> long double
+  {
+    return (n < 28) ? powers_of_ten[n] : std::pow(10.0L, n);
+  };
+  auto scale = [value, power_of_ten](int digits) -> long double
+  {
+    return std::llrint((digits >= 0) ? value * power_of_ten(digits)
+				     : value / power_of_ten(-digits));
+  };
+  long double mantissa = scale(5 - exponent);
+  if (mantissa >= 1e6)
+  {
+    mantissa = scale(4 - exponent);
+    exponent++;
+  }
+  else if (mantissa < 1e5)
+  {
+    mantissa = scale(6 - exponent);
+    exponent--;
+  }
+  int digits = 6;
+  for (long m = mantissa; (digits > 1) && (m % 10 == 0); m /= 10)
+    digits--;
+
+  if ((exponent < -4) || (exponent >= 6))
+    return (length + digits + ((digits > 1) ? 1 : 0)
+	    + 2 + ((std::abs(exponent) >= 100) ? 3 : 2));	// e+dd
+  if (exponent < 0)
+    return length + 2 + (-exponent - 1) + digits;		// 0.000ddd
+  int fraction_digits = std::max(0, digits - (exponent + 1));
+  return length + exponent + 1 + (fraction_digits ? fraction_digits + 1 : 0);
+}
+
+std::size_t formatted_length(std::string_view fmt,
+			     const std::size_t* arg_lengths)
+{
+  std::size_t length = 0;
+  for (std::size_t i = 0; i < fmt.length(); i++)
+  {
+    if (fmt[i] != '{')
+    {
+      length++;
+      continue;
+    }
+    std::size_t arg = 0;
+    for (i++; (fmt[i] >= '0') && (fmt[i] <= '9'); i++)
+      arg = arg * 10 + (fmt[i] - '0');
+    length += arg_lengths[arg];
+    i = fmt.find('}', i);
+  }
+  return length;
+}
+
+// The text of a PDF literal string, without its parentheses: an
+// unbalanced parenthesis or a backslash would otherwise end the string
+// early or escape the next character.
+static std::string pdf_string(const std::string& text)
+{
+  std::string s;
+  s.reserve(text.length());
+  for (char c: text)
+  {
+    if ((c == '(') || (c == ')') || (c == '\\'))
+      s += '\\';
+    s += c;
+  }
+  return s;
+}
+
 ContentStreamString& ContentStreamString::insert(const std::string s)
 {
   std::string::insert(this->length() - trailer_length, s);
   return *this;
 }
 
+ContentStreamString& ContentStreamString::record_to(DisplayList* list)
+{
+  recording = list;
+  return *this;
+}
+
+void ContentStreamString::record(DisplayOpKind kind,
+				 Coord p0,
+				 Coord p1,
+				 Coord p2)
+{
+  if (recording)
+    recording->add(kind, current_element(), p0, p1, p2);
+}
+
+void ContentStreamString::record_fill(DisplayOpKind kind,
+				      FillRule fill_rule)
+{
+  if (recording)
+    recording->add_fill(kind, current_element(), fill_rule);
+}
+
+ElementId ContentStreamString::current_element() const
+{
+  if (segment_open)
+    return segment_table.back().id;
+  return { ElementRole::NONE, 0 };
+}
+
 ContentStreamString& ContentStreamString::set_color_space(const std::string color_space,
 							  bool fill,
 							  bool stroke)
 {
   if (fill)
-    this->insert("/" + color_space + "cs ");
+    emit("/{0}cs ", color_space);
   if (stroke)
-    this->insert("/" + color_space + "CS ");
+    emit("/{0}CS ", color_space);
   return *this;
 }
 
@@ -46,21 +175,29 @@ ContentStreamString& ContentStreamString::set_color(Color color,
 						    bool stroke)
 {
   if (fill)
-    this->insert(std::format("{0:g} {1:g} {2:g} sc ", color.r, color.g, color.b));
+  {
+    emit("{0:g} {1:g} {2:g} sc ", color.r, color.g, color.b);
+    record(DisplayOpKind::SET_FILL_COLOR, { color.r, color.g }, { color.b, 0.0 });
+  }
   if (stroke)
-    this->insert(std::format("{0:g} {1:g} {2:g} SC ", color.r, color.g, color.b));
+  {
+    emit("{0:g} {1:g} {2:g} SC ", color.r, color.g, color.b);
+    record(DisplayOpKind::SET_STROKE_COLOR, { color.r, color.g }, { color.b, 0.0 });
+  }
   return *this;
 }
 
 ContentStreamString& ContentStreamString::set_line_width(float width)
 {
-  this->insert(std::format("{0:g} w ", width));
+  emit("{0:g} w ", width);
+  record(DisplayOpKind::SET_LINE_WIDTH, { width, 0.0 });
   return *this;
 }
 
 ContentStreamString& ContentStreamString::move_to(Coord dest)
 {
-  this->insert(std::format("{0:g} {1:g} m ", dest.x, dest.y));
+  emit("{0:g} {1:g} m ", dest.x, dest.y);
+  record(DisplayOpKind::MOVE_TO, dest);
   last_coord = dest;
   have_last_coord = true;
   return *this;
@@ -68,19 +205,18 @@ ContentStreamString& ContentStreamString::move_to(Coord dest)
 
 ContentStreamString& ContentStreamString::line_to(Coord dest)
 {
-  this->insert(std::format("{0:g} {1:g} l ", dest.x, dest.y));
+  emit("{0:g} {1:g} l ", dest.x, dest.y);
+  record(DisplayOpKind::LINE_TO, dest);
   last_coord = dest;
   have_last_coord = true;
   return *this;
 }
 
-ContentStreamString& ContentStreamString::arc_to(Coord dest,
-						 bool clockwise)
+CubicBezier quarter_arc(Coord origin,
+			Coord dest,
+			bool clockwise)
 {
-  if (! have_last_coord)
-    throw std::logic_error("arc_to() origin unknown");
-
-  Coord p0 = last_coord;
+  Coord p0 = origin;
   Coord p1 = p0;
   Coord p2 = dest;
   Coord p3 = dest;
@@ -144,8 +280,26 @@ ContentStreamString& ContentStreamString::arc_to(Coord dest,
     }
   }
 
-  insert(std::format("{0:g} {1:g} {2:g} {3:g} {4:g} {5:g} c\n",
-		     p1.x, p1.y, p2.x, p2.y, p3.x, p3.y));
+  return { p0, p1, p2, p3 };
+}
+
+ContentStreamString& ContentStreamString::arc_to(Coord dest,
+						 bool clockwise)
+{
+  if (! have_last_coord)
+    throw std::logic_error("arc_to() origin unknown");
+
+  CubicBezier curve = quarter_arc(last_coord, dest, clockwise);
+  return curve_to(curve.p1, curve.p2, curve.p3);
+}
+
+ContentStreamString& ContentStreamString::curve_to(Coord control_1,
+						   Coord control_2,
+						   Coord dest)
+{
+  emit("{0:g} {1:g} {2:g} {3:g} {4:g} {5:g} c\n",
+       control_1.x, control_1.y, control_2.x, control_2.y, dest.x, dest.y);
+  record(DisplayOpKind::CURVE_TO, control_1, control_2, dest);
 
   last_coord = dest;
   have_last_coord = true;
@@ -216,33 +370,68 @@ ContentStreamString& ContentStreamString::text(Coord dest,
     break;
   }
 
-  insert("BT ");							// begin text object
-  insert(std::format("{0:g} {1:g} Td ", dest.x, dest.y));		// text position
-  insert("0 Tr ");							// text render mode fill
-  insert("/" + font_name + std::format(" {0:g} Tf\n", font_size_pt));	// select font and size
-  insert("(" + text + ") Tj ");
-  insert("ET\n");							// end text object
+  emit("BT ");							// begin text object
+  emit("{0:g} {1:g} Td ", dest.x, dest.y);			// text position
+  emit("0 Tr ");						// text render mode fill
+  emit("/{0} {1:g} Tf\n", font_name, font_size_pt);		// select font and size
+  emit("({0}) Tj ", pdf_string(text));
+  emit("ET\n");							// end text object
+
+  if (recording)
+    recording->add_text(current_element(), dest, { text, font_name, font_size_pt, horizontal_alignment });
+
+  return *this;
+}
+
+
+ContentStreamString& ContentStreamString::begin_text(const std::string& font_name,
+						     double font_size_pt)
+{
+  emit("BT ");							// begin text object
+  emit("0 Tr ");						// text render mode fill
+  emit("/{0} {1:g} Tf\n", font_name, font_size_pt);		// select font and size
+  return *this;
+}
+
+ContentStreamString& ContentStreamString::show_text(Coord dest,
+						    const std::string& text,
+						    const std::string& font_name,
+						    double font_size_pt)
+{
+  emit("1 0 0 1 {0:g} {1:g} Tm ", dest.x, dest.y);		// text matrix
+  emit("({0}) Tj\n", pdf_string(text));
+
+  if (recording)
+    recording->add_text(current_element(), dest, { text, font_name, font_size_pt, HorizontalAlignment::LEFT });
 
   return *this;
 }
 
+ContentStreamString& ContentStreamString::end_text()
+{
+  emit("ET\n");							// end text object
+  return *this;
+}
 
 ContentStreamString& ContentStreamString::path_close()
 {
-  this->insert("h\n");  // close
+  emit("h\n");  // close
+  record(DisplayOpKind::CLOSE);
   have_last_coord = false;
   return *this;
 }
 
 ContentStreamString& ContentStreamString::path_stroke()
 {
-  this->insert("S\n");  // stroke
+  emit("S\n");  // stroke
+  record(DisplayOpKind::STROKE);
   return *this;
 }
 
 ContentStreamString& ContentStreamString::path_close_stroke()
 {
-  this->insert("s\n");  // close, stroke
+  emit("s\n");  // close, stroke
+  record(DisplayOpKind::CLOSE_STROKE);
   have_last_coord = false;
   return *this;
 }
@@ -250,27 +439,79 @@ ContentStreamString& ContentStreamString::path_close_stroke()
 ContentStreamString& ContentStreamString::path_fill(FillRule fill_rule)
 {
   if (fill_rule == FillRule::NONZERO_WINDING)
-    this->insert("f\n");  // fill
+    emit("f\n");  // fill
   else
-    this->insert("f*\n");  // fill
+    emit("f*\n");  // fill
+  record_fill(DisplayOpKind::FILL, fill_rule);
   return *this;
 }
 
 ContentStreamString& ContentStreamString::path_fill_stroke(FillRule fill_rule)
 {
   if (fill_rule == FillRule::NONZERO_WINDING)
-    this->insert("B\n");  // fill and stroke
+    emit("B\n");  // fill and stroke
   else
-    this->insert("B*\n");  // fill and stroke
+    emit("B*\n");  // fill and stroke
+  record_fill(DisplayOpKind::FILL_STROKE, fill_rule);
   return *this;
 }
 
 ContentStreamString& ContentStreamString::path_close_fill_stroke(FillRule fill_rule)
 {
   if (fill_rule == FillRule::NONZERO_WINDING)
-    this->insert("b\n");  // close, fill and stroke
+    emit("b\n");  // close, fill and stroke
   else
-    this->insert("b*\n");  // close, fill and stroke
+    emit("b*\n");  // close, fill and stroke
+  record_fill(DisplayOpKind::CLOSE_FILL_STROKE, fill_rule);
   have_last_coord = false;
   return *this;
 }
+
+
+ContentStreamString& ContentStreamString::begin_segment(ElementId id)
+{
+  if (segment_open)
+    throw std::logic_error("begin_segment() with segment already open");
+  segment_table.push_back({ id, emitted_length() - trailer_length, 0, operators });
+  segment_open = true;
+  return *this;
+}
+
+ContentStreamString& ContentStreamString::end_segment()
+{
+  if (! segment_open)
+    throw std::logic_error("end_segment() without begin_segment()");
+  Segment& segment = segment_table.back();
+  segment.length = emitted_length() - trailer_length - segment.offset;
+  segment.operator_count = operators - segment.operator_count;
+  segment_open = false;
+  return *this;
+}
+
+const Segment* ContentStreamString::find_segment(ElementId id) const
+{
+  for (const Segment& segment: segment_table)
+    if (segment.id == id)
+      return & segment;
+  return nullptr;
+}
+
+ContentStreamString& ContentStreamString::splice_segment(ElementId id,
+							 std::string_view replacement)
+{
+  if (segment_open)
+    throw std::logic_error("splice_segment() with segment open");
+  if (count_only)
+    throw std::logic_error("splice_segment() of a count-only stream");
+  auto it = std::find_if(segment_table.begin(), segment_table.end(),
+			 [id](const Segment& segment) { return segment.id == id; });
+  if (it == segment_table.end())
+    throw std::invalid_argument("splice_segment() of unknown element");
+
+  std::string::replace(it->offset, it->length, replacement);
+  std::ptrdiff_t delta = replacement.length() - it->length;
+  it->length = replacement.length();
+  for (++it; it != segment_table.end(); ++it)
+    it->offset += delta;
+  return *this;
+}
@@ -4,12 +4,20 @@
 #ifndef CONTENT_STREAM_STRING_H
 #define CONTENT_STREAM_STRING_H
 
+#include <format>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
 struct Coord { double x; double y; };
 
 struct Dimensions { double width; double height; };
 
 struct Color { double r; double g; double b; };
 
+struct CubicBezier { Coord p0; Coord p1; Coord p2; Coord p3; };
+
 constexpr Color BLACK { 0.0, 0.0, 0.0 };
 constexpr Color WHITE { 1.0, 1.0, 1.0 };
 
@@ -26,10 +34,60 @@ enum struct HorizontalAlignment
   RIGHT
 };
 
+// Control points of the cubic Bezier approximation of a quarter circle
+// from origin to dest, as drawn by ContentStreamString::arc_to().
+// WARNING: the same restrictions as arc_to() apply
+CubicBezier quarter_arc(Coord origin,
+			Coord dest,
+			bool clockwise = true);
+
+enum struct ElementRole
+{
+  NONE,				// not part of any element
+  OVERLAY_OUTLINE,
+  KEY_OUTLINE,
+  F_LEGEND,			// gold, above the key
+  PRIMARY_LEGEND,		// on the key
+  G_LEGEND,			// blue, on the front of the key
+  REG_MARK,
+  ARTWORK,			// imported, e.g. a logo
+  COMMON_CUT			// outer outlines of a page, shared edges cut once
+};
+
+// Identifies one drawing element within a content stream.  The index is
+// the user key code for KEY_OUTLINE and the legends, the mark number for
+// REG_MARK, zero for OVERLAY_OUTLINE and COMMON_CUT, and zero for printed
+// or one for cut ARTWORK.
+struct ElementId
+{
+  ElementRole role;
+  int index;
+
+  auto operator<=>(const ElementId&) const = default;
+};
+
+// The byte range of the content stream emitted for one element.
+struct Segment
+{
+  ElementId id;
+  std::string::size_type offset;
+  std::string::size_type length;
+  std::size_t operator_count;	// as originally emitted; not updated by splicing
+};
+
+class DisplayList;
+enum struct DisplayOpKind;
+
 class ContentStreamString: public std::string
 {
 public:
-  ContentStreamString(bool push_graphics_state);
+  // In count-only mode, nothing is stored; only the number of operators
+  // and bytes that would have been emitted are counted.
+  ContentStreamString(bool push_graphics_state,
+		      bool count_only = false);
+
+  std::size_t operator_count() const { return operators; }
+  std::size_t byte_count() const { return emitted_length(); }
 
   ContentStreamString& set_color_space(const std::string color_space,
 				       bool fill,
@@ -47,6 +105,10 @@ public:
   // WARNING: ONLY a 90 degree arc with orientation of a multiple of 90 degrees can be generated
   ContentStreamString& arc_to(Coord dest,
 			      bool clockwise = true);
+
+  ContentStreamString& curve_to(Coord control_1,
+				Coord control_2,
+				Coord dest);
   
   ContentStreamString& rect(Dimensions dimensions);
   ContentStreamString& rounded_rect(Dimensions dimensions,
@@ -58,21 +120,98 @@ public:
 			    const std::string& font_name,
 			    double font_size_pt);
 
+  // A run of texts in one text object, with one font.  Each text is
+  // positioned absolutely, so that it can be re-emitted and spliced on
+  // its own.  The font is only passed to show_text() for recording.
+  ContentStreamString& begin_text(const std::string& font_name,
+				  double font_size_pt);
+  ContentStreamString& show_text(Coord dest,
+				 const std::string& text,
+				 const std::string& font_name,
+				 double font_size_pt);
+  ContentStreamString& end_text();
+
   ContentStreamString& path_close();
   ContentStreamString& path_stroke();
   ContentStreamString& path_close_stroke();
   ContentStreamString& path_fill(FillRule fill_rule = FillRule::NONZERO_WINDING);
   ContentStreamString& path_fill_stroke(FillRule fill_rule = FillRule::NONZERO_WINDING);
   ContentStreamString& path_close_fill_stroke(FillRule fill_rule = FillRule::NONZERO_WINDING);
-  
+
+  // Everything emitted between begin_segment() and end_segment() is
+  // recorded as the segment of the given element, so that the element
+  // can later be re-emitted and spliced in without regenerating the rest
+  // of the stream.  Segments can't be nested.
+  ContentStreamString& begin_segment(ElementId id);
+  ContentStreamString& end_segment();
+
+  const std::vector<Segment>& segments() const { return segment_table; }
+  const Segment* find_segment(ElementId id) const;
+
+  // Replaces the content of a segment in place, adjusting the byte ranges
+  // of the following segments.  Throws std::logic_error in count-only
+  // mode, as there is no content to replace.
+  ContentStreamString& splice_segment(ElementId id,
+				      std::string_view replacement);
+
+  // If list is non-null, all subsequent drawing operations are also
+  // recorded to it, tagged with the element of the open segment.
+  ContentStreamString& record_to(DisplayList* list);
 
 private:
   size_type trailer_length;
   bool have_last_coord;
   Coord last_coord;
 
+  std::vector<Segment> segment_table;
+  bool segment_open;
+
+  DisplayList* recording;
+
+  bool count_only;
+  std::size_t operators;
+  std::size_t counted_bytes;
+
+  size_type emitted_length() const { return count_only ? counted_bytes : length(); }
+
+  template<class... Args>
+  void emit(std::format_string<Args...> fmt,
+	    Args&&... args);
+
+  void record(DisplayOpKind kind,
+	      Coord p0 = {},
+	      Coord p1 = {},
+	      Coord p2 = {});
+  void record_fill(DisplayOpKind kind,
+		   FillRule fill_rule);
+  ElementId current_element() const;
+
   ContentStreamString& insert(const std::string s);
 };
 
+// Length of a value as formatted by emit(), computed without formatting
+// it.  Numbers are always formatted with {:g}.
+std::size_t formatted_length(double value);
+inline std::size_t formatted_length(const std::string& value) { return value.length(); }
+
+// Length of a format string, with each replacement field {n...} replaced
+// by a value of length arg_lengths[n].
+std::size_t formatted_length(std::string_view fmt,
+			     const std::size_t* arg_lengths);
+
+template<class... Args>
+void ContentStreamString::emit(std::format_string<Args...> fmt,
+			       Args&&... args)
+{
+  operators++;
+  if (count_only)
+  {
+    std::size_t arg_lengths[] = { formatted_length(args)..., 0 };
+    counted_bytes += formatted_length(fmt.get(), arg_lengths);
+  }
+  else
+    insert(std::format(fmt, std::forward<Args>(args)...));
+}
+
 #endif // CONTENT_STREAM_STRING_H
 
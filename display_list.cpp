@@ -0,0 +1,441 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <format>
+#include <sstream>
+#include <stdexcept>
+
+#include "display_list.h"
+
+unsigned display_op_point_count(DisplayOpKind kind)
+{
+  switch (kind)
+  {
+  case DisplayOpKind::MOVE_TO:
+  case DisplayOpKind::LINE_TO:
+  case DisplayOpKind::TEXT:
+    return 1;
+  case DisplayOpKind::CURVE_TO:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+void DisplayList::add(DisplayOpKind kind,
+		      ElementId element,
+		      Coord p0,
+		      Coord p1,
+		      Coord p2)
+{
+  ops.push_back({ kind, element, { p0, p1, p2 }, 0 });
+}
+
+void DisplayList::add_text(ElementId element,
+			   Coord position,
+			   const DisplayText& text)
+{
+  ops.push_back({ DisplayOpKind::TEXT, element, { position, {}, {} },
+		  static_cast<uint32_t>(text_table.size()) });
+  text_table.push_back(text);
+}
+
+void DisplayList::add_fill(DisplayOpKind kind,
+			   ElementId element,
+			   FillRule fill_rule)
+{
+  ops.push_back({ kind, element, {}, static_cast<uint32_t>(fill_rule) });
+}
+
+void DisplayList::append(const DisplayList& other,
+			 Coord offset,
+			 std::optional<ElementRole> exclude)
+{
+  uint32_t text_base = text_table.size();
+  ops.reserve(ops.size() + other.ops.size());
+  for (DisplayOp op: other.ops)
+  {
+    if (exclude && (op.element.role == *exclude))
+      continue;
+    for (unsigned i = 0; i < display_op_point_count(op.kind); i++)
+    {
+      op.p[i].x += offset.x;
+      op.p[i].y += offset.y;
+    }
+    if (op.kind == DisplayOpKind::TEXT)
+      op.aux += text_base;
+    ops.push_back(op);
+  }
+  text_table.insert(text_table.end(), other.text_table.begin(), other.text_table.end());
+}
+
+void DisplayList::remove_degenerate_subpaths()
+{
+  std::vector<bool> drop(ops.size(), false);
+  std::vector<std::size_t> subpath;	// operations of the current subpath
+  bool distinct = false;
+  bool have_path = false;		// kept path operations since the last paint
+
+  auto end_subpath = [&]()
+  {
+    if (! subpath.empty())
+    {
+      if (distinct)
+	have_path = true;
+      else
+	for (std::size_t i: subpath)
+	  drop[i] = true;
+    }
+    subpath.clear();
+  };
+
+  for (std::size_t i = 0; i < ops.size(); i++)
+  {
+    const DisplayOp& op = ops[i];
+    switch (op.kind)
+    {
+    case DisplayOpKind::MOVE_TO:
+      end_subpath();
+      subpath.push_back(i);
+      distinct = false;
+      break;
+    case DisplayOpKind::LINE_TO:
+    case DisplayOpKind::CURVE_TO:
+    case DisplayOpKind::CLOSE:
+      if (subpath.empty())
+      {
+	have_path = true;	// continues from a current point set elsewhere
+	break;
+      }
+      subpath.push_back(i);
+      for (unsigned j = 0; j < display_op_point_count(op.kind); j++)
+	distinct = distinct || (op.p[j].x != ops[subpath[0]].p[0].x) || (op.p[j].y != ops[subpath[0]].p[0].y);
+      break;
+    default:
+      if (! display_op_is_paint(op.kind))
+	break;
+      end_subpath();
+      drop[i] = ! have_path;
+      have_path = false;
+      break;
+    }
+  }
+  end_subpath();
+
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < ops.size(); i++)
+    if (! drop[i])
+      ops[kept++] = ops[i];
+  ops.resize(kept);
+}
+
+void DisplayList::clear()
+{
+  ops.clear();
+  text_table.clear();
+}
+
+bool display_op_is_paint(DisplayOpKind kind)
+{
+  switch (kind)
+  {
+  case DisplayOpKind::STROKE:
+  case DisplayOpKind::CLOSE_STROKE:
+  case DisplayOpKind::FILL:
+  case DisplayOpKind::FILL_STROKE:
+  case DisplayOpKind::CLOSE_FILL_STROKE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool display_op_is_fill(DisplayOpKind kind)
+{
+  return ((kind == DisplayOpKind::FILL) ||
+	  (kind == DisplayOpKind::FILL_STROKE) ||
+	  (kind == DisplayOpKind::CLOSE_FILL_STROKE));
+}
+
+FillRule display_op_fill_rule(const DisplayOp& op)
+{
+  return static_cast<FillRule>(op.aux);
+}
+
+DisplayItemCollector::DisplayItemCollector():
+  line_width(1.0),
+  fill_color(BLACK),
+  stroke_color(BLACK),
+  path_start(0),
+  in_path(false),
+  min(),
+  max()
+{
+}
+
+void DisplayItemCollector::add(std::size_t index,
+			       const DisplayOp& op,
+			       const std::vector<DisplayText>& texts)
+{
+  auto extend = [&](Coord p)
+  {
+    min = { std::min(min.x, p.x), std::min(min.y, p.y) };
+    max = { std::max(max.x, p.x), std::max(max.y, p.y) };
+  };
+
+  switch (op.kind)
+  {
+  case DisplayOpKind::SET_LINE_WIDTH:
+    line_width = op.p[0].x;
+    break;
+  case DisplayOpKind::SET_FILL_COLOR:
+    fill_color = { op.p[0].x, op.p[0].y, op.p[1].x };
+    break;
+  case DisplayOpKind::SET_STROKE_COLOR:
+    stroke_color = { op.p[0].x, op.p[0].y, op.p[1].x };
+    break;
+  case DisplayOpKind::TEXT:
+    {
+      // roughly Helvetica: average advance 0.55 em, descent 0.25 em
+      const DisplayText& text = texts[op.aux];
+      Coord p = op.p[0];
+      items.push_back({ index, 1, line_width, fill_color, stroke_color,
+			{ p.x, p.y - 0.25 * text.font_size },
+			{ p.x + 0.55 * text.font_size * text.text.length(), p.y + text.font_size } });
+    }
+    break;
+  case DisplayOpKind::MOVE_TO:
+  case DisplayOpKind::LINE_TO:
+  case DisplayOpKind::CURVE_TO:
+    if (! in_path)
+    {
+      path_start = index;
+      in_path = true;
+      min = max = op.p[0];
+    }
+    for (unsigned j = 0; j < display_op_point_count(op.kind); j++)
+      extend(op.p[j]);	// control points bound the curve
+    break;
+  case DisplayOpKind::CLOSE:
+    break;
+  default:
+    if (display_op_is_paint(op.kind) && in_path)
+      items.push_back({ path_start, index + 1 - path_start, line_width, fill_color, stroke_color, min, max });
+    in_path = false;
+    break;
+  }
+}
+
+std::vector<DisplayItem> display_items(const DisplayList& list)
+{
+  DisplayItemCollector collector;
+  for (std::size_t i = 0; i < list.size(); i++)
+    collector.add(i, list[i], list.texts());
+  return std::move(collector.items);
+}
+
+
+static constexpr const char* ELEMENT_ROLE_NAMES[] =
+{
+  "NONE", "OVERLAY_OUTLINE", "KEY_OUTLINE", "F_LEGEND", "PRIMARY_LEGEND", "G_LEGEND", "REG_MARK", "ARTWORK", "COMMON_CUT"
+};
+
+static constexpr const char* DISPLAY_OP_KIND_NAMES[] =
+{
+  "w", "sc", "SC", "m", "l", "c", "h", "S", "s", "f", "B", "b", "Tj"
+};
+
+// numbers of each kind of operation in the text form
+static unsigned display_op_value_count(DisplayOpKind kind)
+{
+  switch (kind)
+  {
+  case DisplayOpKind::SET_LINE_WIDTH:
+    return 1;
+  case DisplayOpKind::SET_FILL_COLOR:
+  case DisplayOpKind::SET_STROKE_COLOR:
+    return 3;
+  case DisplayOpKind::CURVE_TO:
+    return 6;
+  default:
+    return 2 * display_op_point_count(kind);
+  }
+}
+
+const char* element_role_name(ElementRole role)
+{
+  return ELEMENT_ROLE_NAMES[static_cast<int>(role)];
+}
+
+// Version 2 added the even-odd fill operations; version 1 recordings,
+// which have none, are read the same way.
+static constexpr const char* DISPLAY_LIST_HEADER = "voyager-overlay display list 2";
+static constexpr const char* DISPLAY_LIST_HEADER_V1 = "voyager-overlay display list 1";
+
+// Each line is the operation (named as the PDF operator, with a * for
+// the even-odd rule), the element role and index, and the values.  A
+// text operation is followed by the font, size, alignment and text, the
+// text taking the rest of the line.  Numbers have enough digits to
+// compare layouts to well below 1e-6 in.
+void write_display_list(std::ostream& os,
+			const DisplayList& list)
+{
+  os << DISPLAY_LIST_HEADER << "\n";
+  for (std::size_t i = 0; i < list.size(); i++)
+  {
+    const DisplayOp& op = list[i];
+    const double values[6] = { op.p[0].x, op.p[0].y, op.p[1].x, op.p[1].y, op.p[2].x, op.p[2].y };
+    bool even_odd = display_op_is_fill(op.kind) && (display_op_fill_rule(op) == FillRule::EVEN_ODD);
+    std::string line = std::format("{0}{1} {2} {3}",
+				   DISPLAY_OP_KIND_NAMES[static_cast<int>(op.kind)],
+				   even_odd ? "*" : "",
+				   element_role_name(op.element.role),
+				   op.element.index);
+    for (unsigned j = 0; j < display_op_value_count(op.kind); j++)
+      line += std::format(" {0:.10g}", values[j]);
+    if (op.kind == DisplayOpKind::TEXT)
+    {
+      const DisplayText& text = list.texts()[op.aux];
+      line += std::format(" {0} {1:.10g} {2} {3}", text.font_name, text.font_size,
+			  static_cast<int>(text.horizontal_alignment), text.text);
+    }
+    os << line << "\n";
+  }
+}
+
+template <std::size_t N>
+static int name_index(const char* const (&names)[N],
+		      const std::string& name)
+{
+  for (std::size_t i = 0; i < N; i++)
+    if (name == names[i])
+      return i;
+  return -1;
+}
+
+DisplayList read_display_list(std::istream& is)
+{
+  DisplayList list;
+  std::string line;
+  if ((! std::getline(is, line)) || ((line != DISPLAY_LIST_HEADER) && (line != DISPLAY_LIST_HEADER_V1)))
+    throw std::runtime_error("not a display list");
+
+  for (unsigned line_number = 2; std::getline(is, line); line_number++)
+  {
+    std::istringstream ls(line);
+    std::string kind_name;
+    std::string role_name;
+    ElementId element;
+    ls >> kind_name >> role_name >> element.index;
+    FillRule fill_rule = FillRule::NONZERO_WINDING;
+    if (kind_name.ends_with('*'))
+    {
+      kind_name.pop_back();
+      fill_rule = FillRule::EVEN_ODD;
+    }
+    int kind = name_index(DISPLAY_OP_KIND_NAMES, kind_name);
+    if ((fill_rule == FillRule::EVEN_ODD) && (kind >= 0) && ! display_op_is_fill(static_cast<DisplayOpKind>(kind)))
+      kind = -1;
+    int role = name_index(ELEMENT_ROLE_NAMES, role_name);
+    double values[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    if ((kind >= 0) && (role >= 0))
+      for (unsigned j = 0; j < display_op_value_count(static_cast<DisplayOpKind>(kind)); j++)
+	ls >> values[j];
+    if ((! ls) || (kind < 0) || (role < 0))
+      throw std::runtime_error(std::format("bad display list operation at line {0}", line_number));
+    element.role = static_cast<ElementRole>(role);
+
+    Coord p[3] = { { values[0], values[1] }, { values[2], values[3] }, { values[4], values[5] } };
+    if (display_op_is_fill(static_cast<DisplayOpKind>(kind)))
+    {
+      list.add_fill(static_cast<DisplayOpKind>(kind), element, fill_rule);
+      continue;
+    }
+    if (static_cast<DisplayOpKind>(kind) != DisplayOpKind::TEXT)
+    {
+      list.add(static_cast<DisplayOpKind>(kind), element, p[0], p[1], p[2]);
+      continue;
+    }
+
+    DisplayText text;
+    int alignment;
+    ls >> text.font_name >> text.font_size >> alignment;
+    if (! ls)
+      throw std::runtime_error(std::format("bad display list text at line {0}", line_number));
+    ls.get();			// the separating space
+    std::getline(ls, text.text);
+    text.horizontal_alignment = static_cast<HorizontalAlignment>(alignment);
+    list.add_text(element, p[0], text);
+  }
+  return list;
+}
+
+
+void emit_display_op(ContentStreamString& cs,
+		     const DisplayOp& op,
+		     const std::vector<DisplayText>& texts)
+{
+  switch (op.kind)
+  {
+  case DisplayOpKind::SET_LINE_WIDTH:
+    cs.set_line_width(op.p[0].x);
+    break;
+  case DisplayOpKind::SET_FILL_COLOR:
+    cs.set_color({ op.p[0].x, op.p[0].y, op.p[1].x }, true, false);
+    break;
+  case DisplayOpKind::SET_STROKE_COLOR:
+    cs.set_color({ op.p[0].x, op.p[0].y, op.p[1].x }, false, true);
+    break;
+  case DisplayOpKind::MOVE_TO:
+    cs.move_to(op.p[0]);
+    break;
+  case DisplayOpKind::LINE_TO:
+    cs.line_to(op.p[0]);
+    break;
+  case DisplayOpKind::CURVE_TO:
+    cs.curve_to(op.p[0], op.p[1], op.p[2]);
+    break;
+  case DisplayOpKind::CLOSE:
+    cs.path_close();
+    break;
+  case DisplayOpKind::STROKE:
+    cs.path_stroke();
+    break;
+  case DisplayOpKind::CLOSE_STROKE:
+    cs.path_close_stroke();
+    break;
+  case DisplayOpKind::FILL:
+    cs.path_fill(display_op_fill_rule(op));
+    break;
+  case DisplayOpKind::FILL_STROKE:
+    cs.path_fill_stroke(display_op_fill_rule(op));
+    break;
+  case DisplayOpKind::CLOSE_FILL_STROKE:
+    cs.path_close_fill_stroke(display_op_fill_rule(op));
+    break;
+  case DisplayOpKind::TEXT:
+    {
+      const DisplayText& text = texts[op.aux];
+      cs.text(op.p[0], text.horizontal_alignment, text.text, text.font_name, text.font_size);
+    }
+    break;
+  }
+}
+
+void emit_display_list(ContentStreamString& cs,
+		       const DisplayList& list)
+{
+  // colors are only recorded by their components
+  cs.set_color_space("DeviceRGB", true, true);
+  for (std::size_t i = 0; i < list.size(); i++)
+    emit_display_op(cs, list[i], list.texts());
+}
+
+std::size_t DisplayList::memory_bytes() const
+{
+  std::size_t bytes = sizeof(*this) + ops.capacity() * sizeof(DisplayOp) + text_table.capacity() * sizeof(DisplayText);
+  for (const DisplayText& text: text_table)
+    bytes += text.text.capacity() + text.font_name.capacity();
+  return bytes;
+}
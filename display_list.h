@@ -0,0 +1,169 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "content_stream_string.h"
+
+// Drawing operations recorded by a ContentStreamString, for backends and
+// tools that need the geometry rather than the PDF operators.
+
+enum struct DisplayOpKind
+{
+  SET_LINE_WIDTH,		// p[0].x: width
+  SET_FILL_COLOR,		// p[0].x, p[0].y, p[1].x: r, g, b
+  SET_STROKE_COLOR,		// p[0].x, p[0].y, p[1].x: r, g, b
+  MOVE_TO,			// p[0]
+  LINE_TO,			// p[0]
+  CURVE_TO,			// p[0], p[1]: control points, p[2]: end point
+  CLOSE,
+  STROKE,
+  CLOSE_STROKE,
+  FILL,				// aux: FillRule
+  FILL_STROKE,			// aux: FillRule
+  CLOSE_FILL_STROKE,		// aux: FillRule
+  TEXT				// p[0]: position, aux: index into texts()
+};
+
+struct DisplayOp
+{
+  DisplayOpKind kind;
+  ElementId element;
+  Coord p[3];
+  uint32_t aux;
+};
+
+struct DisplayText
+{
+  std::string text;
+  std::string font_name;
+  double font_size;
+  HorizontalAlignment horizontal_alignment;
+};
+
+class DisplayList
+{
+public:
+  void add(DisplayOpKind kind,
+	   ElementId element,
+	   Coord p0 = {},
+	   Coord p1 = {},
+	   Coord p2 = {});
+
+  void add_text(ElementId element,
+		Coord position,
+		const DisplayText& text);
+
+  // A painting operation that fills, with its fill rule.
+  void add_fill(DisplayOpKind kind,
+		ElementId element,
+		FillRule fill_rule);
+
+  // Appends all operations of another list, translated by offset,
+  // optionally leaving out the operations of one element role.
+  void append(const DisplayList& other,
+	      Coord offset,
+	      std::optional<ElementRole> exclude = std::nullopt);
+
+  std::size_t size() const { return ops.size(); }
+  const DisplayOp& operator[](std::size_t i) const { return ops[i]; }
+  const std::vector<DisplayText>& texts() const { return text_table; }
+
+  // including the text table
+  std::size_t memory_bytes() const;
+
+  // Drops subpaths with fewer than two distinct points, such as the move
+  // that ends rounded_rect(), which backends would otherwise draw as a
+  // dot, or plunge a cutter blade for, and painting operations left with
+  // no path.
+  void remove_degenerate_subpaths();
+
+  void clear();
+
+private:
+  std::vector<DisplayOp> ops;
+  std::vector<DisplayText> text_table;
+};
+
+// Number of points of an operation that are coordinates, and so are
+// subject to translation.
+unsigned display_op_point_count(DisplayOpKind kind);
+
+
+// A path together with the operation that paints it, or a text, with
+// the graphics state in effect and its bounding box.
+struct DisplayItem
+{
+  std::size_t first_op;
+  std::size_t op_count;		// including the painting operation
+  double line_width;
+  Color fill_color;
+  Color stroke_color;
+  Coord min;			// bounding box, not including line width
+  Coord max;
+};
+
+// Splits a display list into items.  Paths that are never painted are
+// dropped.  Text extents are estimated from the font size.
+std::vector<DisplayItem> display_items(const DisplayList& list);
+
+// The same, for operations that aren't held in a DisplayList, e.g. as
+// they are decoded from compact storage: add() each operation, with its
+// index, in order.
+class DisplayItemCollector
+{
+public:
+  DisplayItemCollector();
+
+  void add(std::size_t index,
+	   const DisplayOp& op,
+	   const std::vector<DisplayText>& texts);
+
+  std::vector<DisplayItem> items;
+
+private:
+  double line_width;
+  Color fill_color;
+  Color stroke_color;
+  std::size_t path_start;
+  bool in_path;
+  Coord min;
+  Coord max;
+};
+
+bool display_op_is_paint(DisplayOpKind kind);
+
+// FILL, FILL_STROKE and CLOSE_FILL_STROKE, which have a fill rule
+bool display_op_is_fill(DisplayOpKind kind);
+
+FillRule display_op_fill_rule(const DisplayOp& op);
+
+
+const char* element_role_name(ElementRole role);
+
+// Text form of a display list, one operation per line, so that layouts
+// generated by different versions can be kept and compared.
+// read_display_list() throws std::runtime_error on malformed input.
+void write_display_list(std::ostream& os,
+			const DisplayList& list);
+DisplayList read_display_list(std::istream& is);
+
+// Replays the operations into a content stream, without segments, in
+// the DeviceRGB color space.
+void emit_display_list(ContentStreamString& cs,
+		       const DisplayList& list);
+
+// Replays one operation; texts is the text table of its list.
+void emit_display_op(ContentStreamString& cs,
+		     const DisplayOp& op,
+		     const std::vector<DisplayText>& texts);
+
+#endif // DISPLAY_LIST_H
@@ -0,0 +1,456 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+#include <qpdf/QPDF.hh>
+#include <qpdf/QPDFWriter.hh>
+
+#include "document.h"
+#include "parallel.h"
+#include "raster.h"
+#include "sheet_plan.h"
+#include "vector_export.h"
+
+
+PageTemplate create_page_template(QPDF& pdf,
+				  const std::string& font_name,
+				  QPDFObjectHandle font_obj,
+				  double page_width_pt,
+				  double page_height_pt)
+{
+  QPDFObjectHandle procset = QPDFObjectHandle::newArray({ QPDFObjectHandle::newName("/PDF"),
+							  QPDFObjectHandle::newName("/Text") });
+  QPDFObjectHandle rfont = QPDFObjectHandle::newDictionary({ { "/" + font_name, font_obj } });
+
+  PageTemplate t;
+  t.resources = pdf.makeIndirectObject(QPDFObjectHandle::newDictionary({ { "/ProcSet", procset },
+									 { "/Font",    rfont } }));
+  t.media_box = QPDFObjectHandle::newArray({ QPDFObjectHandle::newInteger(0),
+					     QPDFObjectHandle::newInteger(0),
+					     QPDFObjectHandle::newReal(page_width_pt, 3, true),
+					     QPDFObjectHandle::newReal(page_height_pt, 3, true) });
+  return t;
+}
+
+// The MediaBox is copied, as a direct object must not be shared between
+// pages.
+void assemble_page(QPDFPageDocumentHelper &dh,
+		   PageTemplate& page_template,
+		   QPDFObjectHandle contents)
+{
+  QPDF& pdf(dh.getQPDF());
+  QPDFObjectHandle page = pdf.makeIndirectObject(
+    QPDFObjectHandle::newDictionary({ { "/Type",      QPDFObjectHandle::newName("/Page") },
+				      { "/MediaBox",  page_template.media_box.shallowCopy() },
+				      { "/Contents",  contents },
+				      { "/Resources", page_template.resources } }));
+
+  // Add the page to the PDF file
+  dh.addPage(page, false);
+}
+
+// The template of the letter size pages of a new document, with the
+// Helvetica font as F1.
+static PageTemplate create_letter_template(QPDF& pdf)
+{
+  pdf.emptyPDF();
+
+  QPDFObjectHandle font_obj = pdf.makeIndirectObject(
+    QPDFObjectHandle::newDictionary({ { "/Type",     QPDFObjectHandle::newName("/Font") },
+				      { "/Subtype",  QPDFObjectHandle::newName("/Type1") },
+				      { "/Name",     QPDFObjectHandle::newName("/F1") },
+				      { "/BaseFont", QPDFObjectHandle::newName("/Helvetica") },
+				      { "/Encoding", QPDFObjectHandle::newName("/WinAnsiEncoding") } }));
+
+  return create_page_template(pdf, "F1", font_obj, letter_width_pt, letter_height_pt);
+}
+
+static void create_page(QPDFPageDocumentHelper &dh,
+			PageTemplate& page_template,
+			const RegistrationGeometry& reg_geom,
+			const OverlayGeometry& geom,
+			const PageOptions& options,
+			std::size_t slot_count,
+			const SlotLegends& slot_legends,
+			ShmCache* cache,
+			unsigned threads,
+			CommonLineStats* common_line_stats = nullptr)
+{
+  QPDF& pdf(dh.getQPDF());
+
+  // Create the page content stream
+  QPDFObjectHandle contents = pdf.newStream(create_page_contents(letter_width_in,
+								 letter_height_in,
+								 reg_geom,
+								 geom,
+								 options,
+								 slot_count,
+								 slot_legends,
+								 cache,
+								 threads,
+								 common_line_stats));
+
+  assemble_page(dh, page_template, contents);
+}
+
+
+// Used by startup-benchmark.sh: if the environment supplies the time the
+// process was launched (CLOCK_REALTIME, in ns), report the time until the
+// first byte of output is about to be written.
+static void report_first_byte_time()
+{
+  const char* t0 = std::getenv("VOYAGER_OVERLAY_BENCH_T0");
+  if (! t0)
+    return;
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, & now);
+  long long now_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+  std::cerr << "first_byte_ns " << (now_ns - std::atoll(t0)) << "\n";
+}
+
+CommonLineStats create_pdf(const std::string& filename,
+			   const RegistrationGeometry& reg_geom,
+			   const OverlayGeometry& geom,
+			   const PageOptions& options,
+			   ShmCache* cache,
+			   unsigned threads)
+{
+  QPDF pdf;
+  PageTemplate page_template = create_letter_template(pdf);
+  QPDFPageDocumentHelper dh(pdf);
+
+  CommonLineStats stats = { 0.0, 0.0, 0.0, 0 };
+  create_page(dh, page_template, reg_geom, geom, options, ALL_SLOTS, {}, cache, threads, & stats);
+
+  QPDFWriter w(pdf, filename.c_str());
+  report_first_byte_time();
+  w.write();
+  return stats;
+}
+
+
+// The legend set of legend_table(), which orders may name without
+// defining it.
+static constexpr std::string_view BUILTIN_LEGEND_SET = "16c";
+
+// A queue of orders, and the legends of each set it defines, which point
+// into the definitions of the queue, so it is moved but never copied.
+struct PlanQueue
+{
+  OrderQueue queue;
+  std::map<std::string, std::vector<Legend>> legend_sets;
+
+  PlanQueue() = default;
+  PlanQueue(const PlanQueue&) = delete;
+  PlanQueue(PlanQueue&&) = default;
+};
+
+// Each legend of a set the queue defines must name exactly one key of
+// each model whose orders use the set, as key codes in range may still
+// be no key, e.g. 46, the bottom half of the enter key.
+static void check_legend_keys(const std::string& set,
+			      const std::vector<LegendDefinition>& definitions,
+			      const std::string& model)
+{
+  const OverlayGeometry* geom = model_geometry(model);
+  if (! geom)
+    return;	// plan_sheets() reports the model
+  std::vector<KeyPlacement> keys = key_placements(*geom);
+  for (const LegendDefinition& d: definitions)
+  {
+    auto matches = std::count_if(keys.begin(), keys.end(),
+				 [&d](const KeyPlacement& key) { return key.key_code == d.key_code; });
+    if (matches != 1)
+      throw std::runtime_error(std::format("legend set `{0}': key {1} is {2} of model `{3}'",
+					   set, d.key_code, matches ? "more than one key" : "no key", model));
+  }
+}
+
+// If legends are printed, every order must name the built-in legend set
+// or one the queue defines.
+static PlanQueue read_plan_queue(const std::string& orders_filename,
+				 const PageOptions& options)
+{
+  std::ifstream f(orders_filename);
+  if (! f)
+    throw std::runtime_error("can't read `" + orders_filename + "'");
+  PlanQueue plan;
+  plan.queue = read_order_queue(f);
+
+  for (const auto& [name, definitions]: plan.queue.legend_sets)
+  {
+    if (name == BUILTIN_LEGEND_SET)
+      throw std::runtime_error("legend set `" + name + "' is built in, and can't be defined");
+    std::vector<Legend>& legends = plan.legend_sets[name];
+    for (const LegendDefinition& d: definitions)
+      legends.push_back({ d.key_code, { d.text[0].c_str(), d.text[1].c_str(), d.text[2].c_str() } });
+  }
+
+  std::set<std::pair<std::string, std::string>> checked;
+  for (const Order& order: plan.queue.orders)
+  {
+    auto it = plan.queue.legend_sets.find(order.legend_set);
+    if (it != plan.queue.legend_sets.end())
+    {
+      if (checked.emplace(order.legend_set, order.model).second)
+	check_legend_keys(order.legend_set, it->second, order.model);
+    }
+    else if (options.show_legends && (order.legend_set != BUILTIN_LEGEND_SET))
+      throw std::runtime_error("order " + order.id + ": unknown legend set `" + order.legend_set + "'");
+  }
+  return plan;
+}
+
+// The legend set of each slot of a sheet.
+static SlotLegends sheet_legends(const PlanQueue& plan,
+				 const Sheet& sheet)
+{
+  SlotLegends legends;
+  legends.reserve(sheet.slots.size());
+  for (const SheetSlot& slot: sheet.slots)
+  {
+    auto it = plan.legend_sets.find(plan.queue.orders[slot.order].legend_set);
+    legends.push_back((it != plan.legend_sets.end()) ? std::span<const Legend>(it->second) : legend_table());
+  }
+  return legends;
+}
+
+// The slots of a sheet of each model.
+static std::map<std::string, std::size_t> plan_slot_counts(const RegistrationGeometry& reg_geom,
+							   const PageOptions& options)
+{
+  std::map<std::string, std::size_t> slot_counts;
+  for (const char* model: { "voyager", "dm1xl" })
+    slot_counts[model] = compute_page_layout(letter_width_in, letter_height_in, reg_geom,
+					     *model_geometry(model), options.common_line).slots.size();
+  return slot_counts;
+}
+
+void create_plan(const std::string& orders_filename,
+		 const std::string& pdf_filename,
+		 const std::string& map_filename,
+		 const RegistrationGeometry& reg_geom,
+		 const PageOptions& options,
+		 ShmCache* cache,
+		 unsigned threads)
+{
+  PlanQueue plan = read_plan_queue(orders_filename, options);
+  const std::vector<Order>& orders = plan.queue.orders;
+  std::map<std::string, std::size_t> slot_counts = plan_slot_counts(reg_geom, options);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Sheet> sheets = plan_sheets(orders, slot_counts);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  std::size_t overlays = 0;
+  for (const Sheet& sheet: sheets)
+    overlays += sheet.slots.size();
+  std::cout << std::format("plan: {0} orders, {1} overlays on {2} sheets, {3:.3f} ms\n",
+			   orders.size(), overlays, sheets.size(), elapsed.count());
+
+  std::ofstream map(map_filename);
+  write_sheet_plan(map, orders, sheets);
+  if (! map)
+    throw std::runtime_error("can't write `" + map_filename + "'");
+
+  QPDF pdf;
+  PageTemplate page_template = create_letter_template(pdf);
+  QPDFPageDocumentHelper dh(pdf);
+
+  for (const Sheet& sheet: sheets)
+    create_page(dh,
+		page_template,
+		reg_geom,
+		*model_geometry(sheet.model),
+		options,
+		sheet.slots.size(),
+		sheet_legends(plan, sheet),
+		cache,
+		threads);
+
+  QPDFWriter w(pdf, pdf_filename.c_str());
+  w.write();
+}
+
+Estimate estimate_plan(const std::string& orders_filename,
+		       const RegistrationGeometry& reg_geom,
+		       const PageOptions& options)
+{
+  PlanQueue plan = read_plan_queue(orders_filename, options);
+  std::vector<Sheet> sheets = plan_sheets(plan.queue.orders, plan_slot_counts(reg_geom, options));
+  std::vector<PageSlots> pages;
+  pages.reserve(sheets.size());
+  for (const Sheet& sheet: sheets)
+    pages.push_back({ model_geometry(sheet.model), sheet.slots.size(), sheet_legends(plan, sheet) });
+  return estimate_pages(reg_geom, options, pages);
+}
+
+
+void write_recording(const std::string& filename,
+		     const DisplayList& page)
+{
+  std::ofstream f(filename);
+  write_display_list(f, page);
+  if (! f)
+    throw std::runtime_error("can't write `" + filename + "'");
+}
+
+DisplayList read_recording(const std::string& filename)
+{
+  std::ifstream f(filename);
+  if (! f)
+    throw std::runtime_error("can't read `" + filename + "'");
+  try
+  {
+    return read_display_list(f);
+  }
+  catch (std::runtime_error& e)
+  {
+    throw std::runtime_error(filename + ": " + e.what());
+  }
+}
+
+// Differences up to this are taken to be rounding.
+static constexpr double DIFF_TOLERANCE_IN = 1e-6;
+
+void write_display_list_pdf(const std::string& filename,
+			    const DisplayList& page_ops,
+			    const std::vector<ElementChange>& changes)
+{
+  QPDF pdf;
+  PageTemplate page_template = create_letter_template(pdf);
+  QPDFPageDocumentHelper dh(pdf);
+
+  std::string contents = "q " + std::format("{0:g} 0 0 {0:g} 0 0 cm ", PT_PER_IN);
+  ContentStreamString page(true);
+  emit_display_list(page, page_ops);
+  contents += page;
+  if (! changes.empty())
+  {
+    ContentStreamString highlights(true);
+    emit_layout_diff(highlights, changes);
+    contents += highlights;
+  }
+  contents += "Q\n";
+
+  assemble_page(dh, page_template, pdf.newStream(contents));
+
+  QPDFWriter w(pdf, filename.c_str());
+  w.write();
+}
+
+std::size_t diff_recordings(const std::string& old_path,
+			    const std::string& new_path,
+			    const std::string& highlight_path)
+{
+  namespace fs = std::filesystem;
+
+  if (fs::is_directory(old_path) != fs::is_directory(new_path))
+    throw std::logic_error("--diff needs two files or two directories");
+
+  if (! fs::is_directory(old_path))
+  {
+    std::vector<ElementChange> changes = diff_layouts(read_recording(old_path),
+						      read_recording(new_path),
+						      DIFF_TOLERANCE_IN);
+    write_layout_diff(std::cout, changes);
+    if ((! highlight_path.empty()) && ! changes.empty())
+      write_display_list_pdf(highlight_path, read_recording(new_path), changes);
+    return changes.size();
+  }
+
+  std::vector<std::string> names;
+  for (const fs::directory_entry& entry: fs::directory_iterator(old_path))
+    if (entry.is_regular_file())
+      names.push_back(entry.path().filename().string());
+  for (const fs::directory_entry& entry: fs::directory_iterator(new_path))
+    if (entry.is_regular_file() && ! fs::exists(fs::path(old_path) / entry.path().filename()))
+      std::cout << std::format("{0}: only in {1}\n", entry.path().filename().string(), new_path);
+  std::sort(names.begin(), names.end());
+
+  if (! highlight_path.empty())
+    fs::create_directories(highlight_path);
+
+  std::size_t total = 0;
+  for (const std::string& name: names)
+  {
+    fs::path new_file = fs::path(new_path) / name;
+    if (! fs::exists(new_file))
+    {
+      std::cout << std::format("{0}: only in {1}\n", name, old_path);
+      continue;
+    }
+    DisplayList new_page = read_recording(new_file.string());
+    std::vector<ElementChange> changes = diff_layouts(read_recording((fs::path(old_path) / name).string()),
+						      new_page,
+						      DIFF_TOLERANCE_IN);
+    std::cout << std::format("{0}: {1} changed elements\n", name, changes.size());
+    write_layout_diff(std::cout, changes);
+    if ((! highlight_path.empty()) && ! changes.empty())
+      write_display_list_pdf((fs::path(highlight_path) / fs::path(name).replace_extension(".pdf")).string(),
+			     new_page, changes);
+    total += changes.size();
+  }
+  return total;
+}
+
+
+ExportTimes export_page(const std::string& basename,
+			const std::vector<std::string>& formats,
+			const DisplayList& page,
+			const std::string& font_file,
+			double pixels_per_in,
+			bool concurrent)
+{
+  for (const std::string& format: formats)
+    if (std::find(EXPORT_FORMATS.begin(), EXPORT_FORMATS.end(), format) == EXPORT_FORMATS.end())
+      throw std::logic_error("unknown export format `" + format + "'");
+
+  // The moves that end rounded rectangles would be drawn as dots, or
+  // plunges of a cutter, by some backends, so none is given them.
+  DisplayList clean_page = page;
+  clean_page.remove_degenerate_subpaths();
+
+  std::vector<DisplayItem> items = display_items(clean_page);
+  std::unique_ptr<GlyphCache> glyphs;
+  if (! font_file.empty())
+    glyphs = std::make_unique<GlyphCache>(font_file);
+
+  ExportTimes times = { std::vector<double>(formats.size()), 0.0 };
+  auto start = std::chrono::steady_clock::now();
+  parallel_for(formats.size(), concurrent ? formats.size() : 1, [&](std::size_t i)
+  {
+    auto backend_start = std::chrono::steady_clock::now();
+    std::string filename = basename + "." + formats[i];
+    if (formats[i] == "pdf")
+      write_display_list_pdf(filename, clean_page, {});
+    else if (formats[i] == "svg")
+      write_svg(filename, clean_page, items, { letter_width_in, letter_height_in });
+    else if (formats[i] == "plt")
+      write_hpgl(filename, clean_page, items);
+    else
+    {
+      Raster raster(std::ceil(letter_width_in * pixels_per_in), std::ceil(letter_height_in * pixels_per_in));
+      raster.draw(clean_page, items, { 0.0, letter_height_in, pixels_per_in }, glyphs.get());
+      raster.write_png(filename);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - backend_start;
+    times.backend_ms[i] = elapsed.count();
+  });
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  times.wall_ms = elapsed.count();
+  return times;
+}
@@ -0,0 +1,109 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <qpdf/QPDFObjectHandle.hh>
+#include <qpdf/QPDFPageDocumentHelper.hh>
+
+#include "layout_diff.h"
+#include "page.h"
+
+// The files written by the program: PDF documents of pages and plans,
+// recordings of pages and their differences, and exports to other
+// formats.
+
+// Objects shared by all pages of a document, built once rather than for
+// every page.
+struct PageTemplate
+{
+  QPDFObjectHandle resources;	// indirect, referenced by every page
+  QPDFObjectHandle media_box;
+};
+
+PageTemplate create_page_template(QPDF& pdf,
+				  const std::string& font_name,
+				  QPDFObjectHandle font_obj,
+				  double page_width_pt,
+				  double page_height_pt);
+
+// Builds the page dictionary directly, rather than by formatting and
+// parsing it, and adds it to the document.
+void assemble_page(QPDFPageDocumentHelper &dh,
+		   PageTemplate& page_template,
+		   QPDFObjectHandle contents);
+
+// A letter size document with one page of overlays.  Returns the
+// statistics of its common-line cut, all zero if there is none.
+CommonLineStats create_pdf(const std::string& filename,
+			   const RegistrationGeometry& reg_geom,
+			   const OverlayGeometry& geom,
+			   const PageOptions& options,
+			   ShmCache* cache,
+			   unsigned threads);
+
+// Plans the queue of orders in orders_filename onto sheets, and writes
+// the sheets, one page each, and the mapping of sheet slots to orders.
+// Each slot has the legends of its order, from the built-in set or one
+// the queue defines.
+void create_plan(const std::string& orders_filename,
+		 const std::string& pdf_filename,
+		 const std::string& map_filename,
+		 const RegistrationGeometry& reg_geom,
+		 const PageOptions& options,
+		 ShmCache* cache,
+		 unsigned threads);
+
+// The pages create_plan() would write, as planned, without writing them.
+Estimate estimate_plan(const std::string& orders_filename,
+		       const RegistrationGeometry& reg_geom,
+		       const PageOptions& options);
+
+
+// Recordings of the drawing operations of a page, kept to compare
+// layouts generated by different versions with --diff.  Both throw
+// std::runtime_error on failure.
+void write_recording(const std::string& filename,
+		     const DisplayList& page);
+DisplayList read_recording(const std::string& filename);
+
+// A recorded page, with any changes from another layout outlined.
+void write_display_list_pdf(const std::string& filename,
+			    const DisplayList& page_ops,
+			    const std::vector<ElementChange>& changes);
+
+// Compares two recordings, or, if old and new are directories, each
+// recording in old with the one of the same name in new, writing a
+// highlight PDF of each that changed to the highlight directory.
+// Returns the number of changed elements.
+std::size_t diff_recordings(const std::string& old_path,
+			    const std::string& new_path,
+			    const std::string& highlight_path);
+
+
+static constexpr std::array<std::string_view, 4> EXPORT_FORMATS = { "pdf", "svg", "plt", "png" };
+
+struct ExportTimes
+{
+  std::vector<double> backend_ms;	// indexed as the formats
+  double wall_ms;
+};
+
+// Writes the letter size page in each format, named basename.format.
+// The backends only read the display list and its items, which are
+// computed once, so they can run concurrently, each on its own thread.
+ExportTimes export_page(const std::string& basename,
+			const std::vector<std::string>& formats,
+			const DisplayList& page,
+			const std::string& font_file,
+			double pixels_per_in,
+			bool concurrent);
+
+#endif // DOCUMENT_H
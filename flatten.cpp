@@ -0,0 +1,113 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "flatten.h"
+
+static constexpr unsigned LANES = 4;
+static constexpr unsigned MAX_SEGMENTS = 1 << 16;
+
+// GCC/Clang vector extension; compiles to SSE2/AVX/NEON as available.
+typedef double Lanes __attribute__((vector_size(LANES * sizeof(double))));
+
+unsigned flatten_segment_count(const CubicBezier& curve,
+			       double tolerance)
+{
+  // a NaN would otherwise reach the conversion to unsigned, which is
+  // undefined
+  for (Coord p: { curve.p0, curve.p1, curve.p2, curve.p3 })
+    if (! (std::isfinite(p.x) && std::isfinite(p.y)))
+      throw std::invalid_argument("flatten: curve has a non-finite coordinate");
+  if (! (std::isfinite(tolerance) && (tolerance > 0.0)))
+    throw std::invalid_argument("flatten: tolerance must be positive and finite");
+
+  double d1 = std::hypot(curve.p0.x - 2 * curve.p1.x + curve.p2.x,
+			 curve.p0.y - 2 * curve.p1.y + curve.p2.y);
+  double d2 = std::hypot(curve.p1.x - 2 * curve.p2.x + curve.p3.x,
+			 curve.p1.y - 2 * curve.p2.y + curve.p3.y);
+  double n = std::ceil(std::sqrt(3.0 * std::max(d1, d2) / (4.0 * tolerance)));
+  return std::clamp<double>(n, 1, MAX_SEGMENTS);
+}
+
+void flatten_cubics(std::span<const CubicBezier> curves,
+		    double tolerance,
+		    std::vector<Coord>& points,
+		    std::vector<unsigned>* counts)
+{
+  std::vector<unsigned> local_counts;
+  std::vector<unsigned>& n = counts ? *counts : local_counts;
+  std::size_t first_count = n.size();
+
+  std::size_t total = 0;
+  for (const CubicBezier& curve: curves)
+  {
+    n.push_back(flatten_segment_count(curve, tolerance));
+    total += n.back();
+  }
+
+  std::size_t offset = points.size();
+  points.resize(offset + total);
+
+  for (std::size_t first = 0; first < curves.size(); first += LANES)
+  {
+    Lanes x0, x1, x2, x3, y0, y1, y2, y3, h;
+    unsigned lane_n[LANES];
+    std::size_t lane_offset[LANES];
+    unsigned max_n = 0;
+
+    for (unsigned l = 0; l < LANES; l++)
+    {
+      // unused lanes duplicate the first curve, but store nothing
+      bool used = first + l < curves.size();
+      const CubicBezier& c = curves[used ? first + l : first];
+      x0[l] = c.p0.x; x1[l] = c.p1.x; x2[l] = c.p2.x; x3[l] = c.p3.x;
+      y0[l] = c.p0.y; y1[l] = c.p1.y; y2[l] = c.p2.y; y3[l] = c.p3.y;
+      lane_n[l] = used ? n[first_count + first + l] : 0;
+      h[l] = 1.0 / (used ? lane_n[l] : 1);
+      lane_offset[l] = offset;
+      offset += lane_n[l];
+      max_n = std::max(max_n, lane_n[l]);
+    }
+
+    // B(t) = a t^3 + b t^2 + c t + p0
+    Lanes ax = -x0 + 3 * x1 - 3 * x2 + x3;
+    Lanes ay = -y0 + 3 * y1 - 3 * y2 + y3;
+    Lanes bx = 3 * x0 - 6 * x1 + 3 * x2;
+    Lanes by = 3 * y0 - 6 * y1 + 3 * y2;
+    Lanes cx = 3 * (x1 - x0);
+    Lanes cy = 3 * (y1 - y0);
+
+    Lanes h2 = h * h;
+    Lanes h3 = h2 * h;
+
+    Lanes fx = x0;
+    Lanes fy = y0;
+    Lanes dfx = ax * h3 + bx * h2 + cx * h;
+    Lanes dfy = ay * h3 + by * h2 + cy * h;
+    Lanes ddfx = 6 * ax * h3 + 2 * bx * h2;
+    Lanes ddfy = 6 * ay * h3 + 2 * by * h2;
+    Lanes dddfx = 6 * ax * h3;
+    Lanes dddfy = 6 * ay * h3;
+
+    for (unsigned k = 1; k < max_n; k++)
+    {
+      fx += dfx;
+      fy += dfy;
+      dfx += ddfx;
+      dfy += ddfy;
+      ddfx += dddfx;
+      ddfy += dddfy;
+      for (unsigned l = 0; l < LANES; l++)
+	if (k < lane_n[l])
+	  points[lane_offset[l] + k - 1] = { fx[l], fy[l] };
+    }
+
+    // end exactly on p3, without accumulated rounding error
+    for (unsigned l = 0; l < LANES; l++)
+      if (lane_n[l])
+	points[lane_offset[l] + lane_n[l] - 1] = { x3[l], y3[l] };
+  }
+}
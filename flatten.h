@@ -0,0 +1,37 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef FLATTEN_H
+#define FLATTEN_H
+
+#include <span>
+#include <vector>
+
+#include "content_stream_string.h"
+
+// Flattening of cubic Bezier curves to line segments, shared by all
+// backends that can only draw polylines (plotters, rasterizer, etc.).
+
+// Number of line segments needed for the flattened curve to deviate from
+// the curve by at most tolerance.  Since the deviation of a chord from a
+// curve is bounded by h^2/8 times the maximum second derivative, for n
+// equal parameter steps, n = sqrt(3 * d / (4 * tolerance)), where d is
+// the larger of the two second differences of the control points.
+// Throws std::invalid_argument if a coordinate isn't finite, or the
+// tolerance isn't positive and finite.
+unsigned flatten_segment_count(const CubicBezier& curve,
+			       double tolerance);
+
+// Appends the end points of the line segments of each curve to points,
+// not including the start point p0 of the curve, and always ending
+// exactly at p3.  If counts is non-null, the number of segments of each
+// curve is appended to it.  The curves are evaluated by forward
+// differencing, several curves at a time in SIMD lanes, so callers should
+// pass all the curves they have at once rather than one at a time.
+// Throws as flatten_segment_count().
+void flatten_cubics(std::span<const CubicBezier> curves,
+		    double tolerance,
+		    std::vector<Coord>& points,
+		    std::vector<unsigned>* counts = nullptr);
+
+#endif // FLATTEN_H
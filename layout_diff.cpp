@@ -0,0 +1,287 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <limits>
+#include <map>
+#include <optional>
+#include <tuple>
+
+#include "layout_diff.h"
+#include "shm_cache.h"
+
+static constexpr Color ADDED_COLOR   { 0.0, 0.7, 0.0 };
+static constexpr Color CHANGED_COLOR { 1.0, 0.5, 0.0 };
+static constexpr Color OLD_COLOR     { 0.9, 0.0, 0.0 };
+
+static constexpr double HIGHLIGHT_LINE_WIDTH_IN = 0.01;
+static constexpr double HIGHLIGHT_MARGIN_IN     = 0.02;
+
+static uint64_t hash_quantized(double value,
+			       double tolerance,
+			       uint64_t h)
+{
+  long long q = std::llround(value / tolerance);
+  return ShmCache::hash(& q, sizeof(q), h);
+}
+
+std::vector<LayoutElement> layout_elements(const DisplayList& list,
+					   double tolerance)
+{
+  std::vector<LayoutElement> elements;
+  std::vector<std::vector<std::size_t>> element_ops;
+  std::map<ElementId, unsigned> occurrences;
+
+  // An occurrence is a run of operations of one element, possibly
+  // interleaved with operations that aren't part of any element.
+  std::optional<ElementId> last;
+  for (std::size_t i = 0; i < list.size(); i++)
+  {
+    ElementId id = list[i].element;
+    if (id.role == ElementRole::NONE)
+      continue;
+    if (id != last)
+    {
+      constexpr double inf = std::numeric_limits<double>::infinity();
+      elements.push_back({ id, occurrences[id]++, { inf, inf }, { -inf, -inf }, "", 0, 0 });
+      element_ops.emplace_back();
+      last = id;
+    }
+    element_ops.back().push_back(i);
+  }
+
+  // The graphics state in effect at each operation, as paths may be
+  // painted with a state set outside the element.
+  std::vector<uint64_t> state_hashes(list.size());
+  double state[7] = { 1.0 / 72.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+  for (std::size_t i = 0; i < list.size(); i++)
+  {
+    const DisplayOp& op = list[i];
+    if (op.kind == DisplayOpKind::SET_LINE_WIDTH)
+      state[0] = op.p[0].x;
+    else if ((op.kind == DisplayOpKind::SET_FILL_COLOR) || (op.kind == DisplayOpKind::SET_STROKE_COLOR))
+    {
+      double* color = & state[(op.kind == DisplayOpKind::SET_FILL_COLOR) ? 1 : 4];
+      color[0] = op.p[0].x;
+      color[1] = op.p[0].y;
+      color[2] = op.p[1].x;
+    }
+    if (display_op_is_paint(op.kind) || (op.kind == DisplayOpKind::TEXT))
+    {
+      uint64_t h = 0;
+      for (double v: state)
+	h = hash_quantized(v, tolerance, h);
+      state_hashes[i] = h;
+    }
+  }
+
+  for (std::size_t e = 0; e < elements.size(); e++)
+  {
+    LayoutElement& element = elements[e];
+    for (std::size_t i: element_ops[e])
+    {
+      const DisplayOp& op = list[i];
+      for (unsigned j = 0; j < display_op_point_count(op.kind); j++)
+      {
+	element.min = { std::min(element.min.x, op.p[j].x), std::min(element.min.y, op.p[j].y) };
+	element.max = { std::max(element.max.x, op.p[j].x), std::max(element.max.y, op.p[j].y) };
+      }
+    }
+
+    uint64_t shape = 0;
+    uint64_t style = 0;
+    for (std::size_t i: element_ops[e])
+    {
+      const DisplayOp& op = list[i];
+      shape = ShmCache::hash(& op.kind, sizeof(op.kind), shape);
+      for (unsigned j = 0; j < display_op_point_count(op.kind); j++)
+      {
+	shape = hash_quantized(op.p[j].x - element.min.x, tolerance, shape);
+	shape = hash_quantized(op.p[j].y - element.min.y, tolerance, shape);
+      }
+      if (op.kind == DisplayOpKind::TEXT)
+      {
+	const DisplayText& text = list.texts()[op.aux];
+	if (! element.text.empty())
+	  element.text += "\n";
+	element.text += text.text;
+	style = ShmCache::hash(text.font_name.c_str(), text.font_name.length() + 1, style);
+	style = hash_quantized(text.font_size, tolerance, style);
+      }
+      if (display_op_is_fill(op.kind))
+	style = ShmCache::hash(& op.aux, sizeof(op.aux), style);	// fill rule
+      if (display_op_is_paint(op.kind) || (op.kind == DisplayOpKind::TEXT))
+	style = ShmCache::hash(& state_hashes[i], sizeof(state_hashes[i]), style);
+    }
+    element.shape_hash = shape;
+    element.style_hash = style;
+  }
+
+  return elements;
+}
+
+
+static bool element_order(const LayoutElement& a,
+			  const LayoutElement& b)
+{
+  return std::tie(a.id, a.occurrence) < std::tie(b.id, b.occurrence);
+}
+
+static Coord center(Coord min,
+		    Coord max)
+{
+  return { (min.x + max.x) / 2.0, (min.y + max.y) / 2.0 };
+}
+
+static ElementChange compare_elements(const LayoutElement& o,
+				      const LayoutElement& n,
+				      double tolerance)
+{
+  ElementChange c = { o.id, o.occurrence, false, false, false, false, false, false, false,
+		      o.min, o.max, n.min, n.max, o.text, n.text };
+  Coord oc = center(o.min, o.max);
+  Coord nc = center(n.min, n.max);
+  c.moved = (std::abs(nc.x - oc.x) > tolerance) || (std::abs(nc.y - oc.y) > tolerance);
+  c.resized = ((std::abs((n.max.x - n.min.x) - (o.max.x - o.min.x)) > tolerance) ||
+	       (std::abs((n.max.y - n.min.y) - (o.max.y - o.min.y)) > tolerance));
+  c.reshaped = (! c.resized) && (n.shape_hash != o.shape_hash);
+  c.text_changed = n.text != o.text;
+  c.restyled = n.style_hash != o.style_hash;
+  return c;
+}
+
+std::vector<ElementChange> diff_layouts(const DisplayList& old_list,
+					const DisplayList& new_list,
+					double tolerance)
+{
+  std::vector<LayoutElement> old_elements = layout_elements(old_list, tolerance);
+  std::vector<LayoutElement> new_elements = layout_elements(new_list, tolerance);
+  std::sort(old_elements.begin(), old_elements.end(), element_order);
+  std::sort(new_elements.begin(), new_elements.end(), element_order);
+
+  std::vector<ElementChange> changes;
+  auto o = old_elements.begin();
+  auto n = new_elements.begin();
+  while ((o != old_elements.end()) || (n != new_elements.end()))
+  {
+    if ((n == new_elements.end()) || ((o != old_elements.end()) && element_order(*o, *n)))
+    {
+      changes.push_back({ o->id, o->occurrence, false, true, false, false, false, false, false,
+			  o->min, o->max, {}, {}, o->text, "" });
+      ++o;
+    }
+    else if ((o == old_elements.end()) || element_order(*n, *o))
+    {
+      changes.push_back({ n->id, n->occurrence, true, false, false, false, false, false, false,
+			  {}, {}, n->min, n->max, "", n->text });
+      ++n;
+    }
+    else
+    {
+      ElementChange c = compare_elements(*o, *n, tolerance);
+      if (c.moved || c.resized || c.reshaped || c.text_changed || c.restyled)
+	changes.push_back(c);
+      ++o;
+      ++n;
+    }
+  }
+  return changes;
+}
+
+
+// Texts may span lines, so are shown escaped.
+static std::string quoted(const std::string& text)
+{
+  std::string result = "\"";
+  for (char c: text)
+  {
+    if (c == '\n')
+      result += "\\n";
+    else
+    {
+      if ((c == '"') || (c == '\\'))
+	result += '\\';
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+void write_layout_diff(std::ostream& os,
+		       const std::vector<ElementChange>& changes)
+{
+  for (const ElementChange& c: changes)
+  {
+    std::string line = std::format("{0} {1} #{2}:", element_role_name(c.id.role), c.id.index, c.occurrence + 1);
+    if (c.added)
+      line += std::format(" added at {0:.4f},{1:.4f}", c.new_min.x, c.new_min.y);
+    if (c.removed)
+      line += std::format(" removed from {0:.4f},{1:.4f}", c.old_min.x, c.old_min.y);
+    std::string separator = " ";
+    if (c.moved)
+    {
+      Coord oc = center(c.old_min, c.old_max);
+      Coord nc = center(c.new_min, c.new_max);
+      line += separator + std::format("moved dx {0:+.4f} dy {1:+.4f}", nc.x - oc.x, nc.y - oc.y);
+      separator = ", ";
+    }
+    if (c.resized)
+    {
+      line += separator + std::format("resized dw {0:+.4f} dh {1:+.4f}",
+				      (c.new_max.x - c.new_min.x) - (c.old_max.x - c.old_min.x),
+				      (c.new_max.y - c.new_min.y) - (c.old_max.y - c.old_min.y));
+      separator = ", ";
+    }
+    if (c.reshaped)
+    {
+      line += separator + "reshaped";
+      separator = ", ";
+    }
+    if (c.text_changed)
+    {
+      line += separator + "text " + quoted(c.old_text) + " -> " + quoted(c.new_text);
+      separator = ", ";
+    }
+    if (c.restyled)
+      line += separator + "restyled";
+    os << line << "\n";
+  }
+}
+
+
+static void emit_box(ContentStreamString& cs,
+		     Coord min,
+		     Coord max)
+{
+  min = { min.x - HIGHLIGHT_MARGIN_IN, min.y - HIGHLIGHT_MARGIN_IN };
+  max = { max.x + HIGHLIGHT_MARGIN_IN, max.y + HIGHLIGHT_MARGIN_IN };
+  cs.move_to(min);
+  cs.line_to({ max.x, min.y });
+  cs.line_to(max);
+  cs.line_to({ min.x, max.y });
+  cs.path_close_stroke();
+}
+
+void emit_layout_diff(ContentStreamString& cs,
+		      const std::vector<ElementChange>& changes)
+{
+  cs.set_color_space("DeviceRGB", false, true);
+  cs.set_line_width(HIGHLIGHT_LINE_WIDTH_IN);
+
+  cs.set_color(OLD_COLOR, false, true);
+  for (const ElementChange& c: changes)
+    if (c.removed || c.moved || c.resized)
+      emit_box(cs, c.old_min, c.old_max);
+
+  cs.set_color(CHANGED_COLOR, false, true);
+  for (const ElementChange& c: changes)
+    if (! (c.added || c.removed))
+      emit_box(cs, c.new_min, c.new_max);
+
+  cs.set_color(ADDED_COLOR, false, true);
+  for (const ElementChange& c: changes)
+    if (c.added)
+      emit_box(cs, c.new_min, c.new_max);
+}
@@ -0,0 +1,72 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef LAYOUT_DIFF_H
+#define LAYOUT_DIFF_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "display_list.h"
+
+// Geometric comparison of two recorded layouts, element by element,
+// without rasterizing them.
+
+// The operations of one element, summarized.  Elements with the same id
+// (e.g. the same key in each slot of a page) are told apart by the order
+// in which they occur.
+struct LayoutElement
+{
+  ElementId id;
+  unsigned occurrence;
+  Coord min;			// bounding box of all points, including
+  Coord max;			// control points
+  std::string text;		// texts shown, separated by newlines
+  uint64_t shape_hash;		// operations and points relative to min
+  uint64_t style_hash;		// line width and colors painted with
+};
+
+// Operations that are not part of any element are only used for the
+// graphics state they set.  Coordinates are quantized to the tolerance
+// for the hashes.
+std::vector<LayoutElement> layout_elements(const DisplayList& list,
+					   double tolerance);
+
+struct ElementChange
+{
+  ElementId id;
+  unsigned occurrence;
+  bool added;
+  bool removed;
+  bool moved;			// center moved
+  bool resized;
+  bool reshaped;		// same box, different geometry
+  bool text_changed;
+  bool restyled;
+  Coord old_min;
+  Coord old_max;
+  Coord new_min;
+  Coord new_max;
+  std::string old_text;
+  std::string new_text;
+};
+
+// Changes from old to new, in order of element id.  Differences up to
+// the tolerance, in inches, are ignored.
+std::vector<ElementChange> diff_layouts(const DisplayList& old_list,
+					const DisplayList& new_list,
+					double tolerance);
+
+// One line per change, with deltas in inches.
+void write_layout_diff(std::ostream& os,
+		       const std::vector<ElementChange>& changes);
+
+// Outlines the changes: the new box of added and changed elements in
+// green and orange, and the old box of removed, moved and resized
+// elements in red.
+void emit_layout_diff(ContentStreamString& cs,
+		      const std::vector<ElementChange>& changes);
+
+#endif // LAYOUT_DIFF_H
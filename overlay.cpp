@@ -0,0 +1,332 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "overlay.h"
+
+
+ContentStreamString create_registration(double page_width_in,
+					double page_height_in,
+					const RegistrationGeometry& geom,
+					DisplayList* recording)
+{
+  ContentStreamString s(true);
+  s.record_to(recording);
+  emit_registration(s, page_width_in, page_height_in, geom);
+  s.record_to(nullptr);
+  return s;
+}
+
+void emit_registration(ContentStreamString& s,
+		       double page_width_in,
+		       double page_height_in,
+		       const RegistrationGeometry& geom)
+{
+  s.set_line_width(geom.line_width_in);
+  s.set_color_space("DeviceRGB", true, true);
+  s.set_color(BLACK, true, true);
+
+  // square at top left of cut area
+  s.begin_segment({ ElementRole::REG_MARK, 0 });
+  s.move_to({ geom.inset_left_in,                                        page_height_in - geom.inset_top_in});	// top left
+  s.rect({ geom.square_size_in, geom.square_size_in });
+  s.path_close_fill_stroke();
+  s.end_segment();
+
+  // right angle at bottom left of cut area
+  s.begin_segment({ ElementRole::REG_MARK, 1 });
+  s.move_to({ geom.inset_left_in,                                        geom.inset_bottom_in + geom.line_length_in });
+  s.line_to({ geom.inset_left_in,                                        geom.inset_bottom_in });
+  s.line_to({ geom.inset_left_in + geom.line_length_in,                  geom.inset_bottom_in });
+  s.path_stroke();
+  s.end_segment();
+
+  // right angle at top left of cut area
+  s.begin_segment({ ElementRole::REG_MARK, 2 });
+  s.move_to({ page_width_in - geom.inset_right_in - geom.line_length_in, page_height_in - geom.inset_top_in });
+  s.line_to({ page_width_in - geom.inset_right_in,                       page_height_in - geom.inset_top_in });
+  s.line_to({ page_width_in - geom.inset_right_in,                       page_height_in - geom.inset_top_in - geom.line_length_in});
+  s.path_stroke();
+  s.end_segment();
+}
+
+
+// A constant array rather than a std::map, so that it needs no dynamic
+// initialization at startup.  The columns are the f-shifted, primary and
+// g-shifted legends.
+static constexpr Legend legend_map[] =
+{
+#if 1
+  { 11, { "ln",       "", "e^x"   } },
+  { 12, { "log",      "", "10^x"  } },
+  { 13, { "?",        "", "fact"  } },
+  { 14, { "sin -1",   "", ""      } },
+  { 15, { "cos -1",   "", ""      } },
+  { 16, { "tan -1",   "", ""      } },
+#else
+  { 11, { "SL",       "", ""      } },
+  { 12, { "SR",       "", ""      } },
+  { 13, { "RL",       "", ""      } },
+  { 14, { "RR",       "", ""      } },
+  { 15, { "RLn",      "", ""      } },
+  { 16, { "RRn",      "", ""      } },
+#endif
+  { 17, { "MASKL",    "", ""      } },
+  { 18, { "MASKR",    "", ""      } },
+  { 19, { "RMD",      "", ""      } },
+  { 10, { "XOR",      "", ""      } },
+
+  { 21, { "x<>(i)",   "", ""      } },
+  { 22, { "x<>I",     "", ""      } },
+  { 23, { "SH HEX",   "", ""      } },
+  { 24, { "SH DEC",   "", ""      } },
+  { 25, { "SH OCT",   "", ""      } },
+  { 26, { "SH BIN",   "", ""      } },
+  { 27, { "SB",       "", ""      } },
+  { 28, { "CB",       "", ""      } },
+  { 29, { "B?",       "", ""      } },
+  { 30, { "AND",      "", ""      } },
+
+  { 31, { "(i)",      "", ""      } },
+  { 32, { "I",        "", ""      } },
+  { 33, { "CL PRGM",  "", ""      } },
+  { 34, { "CL REG",   "", ""      } },
+  { 35, { "CL PRFX",  "", ""      } },
+  { 36, { "WINDOW",   "", ""      } },
+  { 37, { "1s COMP",  "", ""      } },
+  { 38, { "2s COMP",  "", ""      } },
+  { 39, { "UNSIGNED", "", ""      } },
+  { 40, { "NOT",      "", ""      } },
+
+  { 41, { "",         "", ""      } },
+  { 42, { "",         "", ""      } },
+  { 43, { "",         "", ""      } },
+  { 44, { "WSIZE",    "", ""      } },
+  { 45, { "FLOAT",    "", ""      } },
+
+  { 47, { "MEM",      "", ""      } },
+  { 48, { "STATUS",   "", ""      } },
+  { 49, { "EEX",      "", ""      } },
+  { 40, { "OR",       "", ""      } },
+};
+
+std::span<const Legend> legend_table()
+{
+  return legend_map;
+}
+
+static const Legend* find_legend(std::span<const Legend> legend_set,
+				 int key_code)
+{
+  for (const Legend& legend: legend_set)
+    if (legend.key_code == key_code)
+      return & legend;
+  return nullptr;
+}
+
+ElementRole legend_role(LegendSlot slot)
+{
+  switch (slot)
+  {
+  case LegendSlot::F_SHIFT:
+    return ElementRole::F_LEGEND;
+  case LegendSlot::PRIMARY:
+    return ElementRole::PRIMARY_LEGEND;
+  case LegendSlot::G_SHIFT:
+    return ElementRole::G_LEGEND;
+  }
+  throw std::invalid_argument("bad legend slot");
+}
+
+static Color legend_color(LegendSlot slot)
+{
+  switch (slot)
+  {
+  case LegendSlot::F_SHIFT:
+    return F_LEGEND_COLOR;
+  case LegendSlot::PRIMARY:
+    return PRIMARY_LEGEND_COLOR;
+  case LegendSlot::G_SHIFT:
+    return G_LEGEND_COLOR;
+  }
+  throw std::invalid_argument("bad legend slot");
+}
+
+
+std::vector<KeyPlacement> key_placements(const OverlayGeometry& geom)
+{
+  std::vector<KeyPlacement> keys;
+  for (int row = 0; row < 4; row++)
+  {
+    double y = geom.height_in - (row * geom.key_row_pitch_in + geom.key_row_1_offset_in);
+    for (int col = 0; col < 10; col++)
+    {
+      if ((row == 3) && (col == 5))
+	continue;  // ignore bottom half of enter key
+      double key_height = geom.key_height_in;
+      if ((row == 2) && (col == 5))
+	key_height += geom.key_row_pitch_in;	// if top half of enter key, it's a tall key
+      int user_kc = (row + 1) * 10 + (col + 1) % 10;
+
+      double x = geom.width_in / 2.0 - (5 * geom.key_col_pitch_in) + (geom.key_col_pitch_in - geom.key_width_in) / 2.0 + col * geom.key_col_pitch_in;
+
+      keys.push_back({ user_kc, { x, y }, { geom.key_width_in, key_height } });
+    }
+  }
+  return keys;
+}
+
+// Legends are centered by eye, as text widths aren't known.  The f-shift
+// legend sits just above the key, the primary is vertically centered on
+// it, and the g-shift legend hangs just below it.
+static constexpr double LEGEND_X_OFFSET_IN = -0.125;
+static constexpr double F_LEGEND_GAP_IN = 0.03;
+static constexpr double G_LEGEND_GAP_IN = 0.02;
+static constexpr double LEGEND_CAP_HEIGHT_IN = 0.72 * LEGEND_FONT_SIZE_IN;
+
+static std::vector<LegendAnchors> compute_legend_anchors(const OverlayGeometry& geom)
+{
+  std::vector<LegendAnchors> table;
+  for (const KeyPlacement& key: key_placements(geom))
+  {
+    double x = key.origin.x + geom.key_width_in / 2.0 + LEGEND_X_OFFSET_IN;
+    table.push_back({ key.key_code,
+		      { { x, key.origin.y + F_LEGEND_GAP_IN },
+			{ x, key.origin.y - (key.size.height + LEGEND_CAP_HEIGHT_IN) / 2.0 },
+			{ x, key.origin.y - key.size.height - G_LEGEND_GAP_IN - LEGEND_CAP_HEIGHT_IN } },
+		      find_legend(legend_map, key.key_code) });
+  }
+  return table;
+}
+
+// Tables are never removed, so the references stay valid while worker
+// threads generate overlays of the same geometry.
+const std::vector<LegendAnchors>& legend_anchors(const OverlayGeometry& geom)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::vector<LegendAnchors>> tables;
+
+  std::string key(reinterpret_cast<const char*>(& geom), sizeof(geom));
+  std::lock_guard<std::mutex> lock(mutex);
+  auto [it, inserted] = tables.try_emplace(key);
+  if (inserted)
+    it->second = compute_legend_anchors(geom);
+  return it->second;
+}
+
+std::vector<LegendAnchors> legend_anchors(const OverlayGeometry& geom,
+					  std::span<const Legend> legend_set)
+{
+  std::vector<LegendAnchors> table = legend_anchors(geom);
+  for (LegendAnchors& anchors: table)
+    anchors.legend = find_legend(legend_set, anchors.key_code);
+  return table;
+}
+
+
+static void emit_overlay_outline(ContentStreamString& cs,
+				 const OverlayGeometry& geom)
+{
+  cs.move_to({ 0.0, geom.height_in });
+  cs.rounded_rect({ geom.width_in, geom.height_in}, geom.corner_radius_in);
+  cs.path_close_stroke();
+}
+
+static void emit_key_outline(ContentStreamString& cs,
+			     const OverlayGeometry& geom,
+			     const KeyPlacement& key)
+{
+  cs.move_to(key.origin);
+  cs.rounded_rect(key.size, geom.key_corner_radius_in);
+  cs.path_close_stroke();
+}
+
+static void emit_legend(ContentStreamString& cs,
+			const LegendAnchors& anchors,
+			LegendSlot slot,
+			const std::string& text)
+{
+  cs.show_text(anchors.slot[static_cast<int>(slot)], text, "F1", LEGEND_FONT_SIZE_IN);
+}
+
+// All legends of one slot, as a single text object with the color set
+// once, rather than a text object per legend.
+static void emit_legend_run(ContentStreamString& cs,
+			    const std::vector<LegendAnchors>& table,
+			    LegendSlot slot)
+{
+  int s = static_cast<int>(slot);
+  auto has_text = [s](const LegendAnchors& a) { return a.legend && *a.legend->text[s]; };
+  if (std::none_of(table.begin(), table.end(), has_text))
+    return;
+
+  cs.set_color(legend_color(slot), true, false);	// set fill color
+  cs.begin_text("F1", LEGEND_FONT_SIZE_IN);
+  for (const LegendAnchors& anchors: table)
+  {
+    if (! has_text(anchors))
+      continue;
+    cs.begin_segment({ legend_role(slot), anchors.key_code });
+    emit_legend(cs, anchors, slot, anchors.legend->text[s]);
+    cs.end_segment();
+  }
+  cs.end_text();
+}
+
+
+ContentStreamString create_overlay(const OverlayGeometry& geom,
+				   bool show_outlines,
+				   bool show_legends,
+				   std::span<const Legend> legend_set,
+				   DisplayList* recording)
+{
+  ContentStreamString cs(true);
+  cs.record_to(recording);
+  emit_overlay(cs, geom, show_outlines, show_legends, legend_set);
+  cs.record_to(nullptr);
+  return cs;
+}
+
+void emit_overlay(ContentStreamString& cs,
+		  const OverlayGeometry& geom,
+		  bool show_outlines,
+		  bool show_legends,
+		  std::span<const Legend> legend_set)
+{
+  cs.set_line_width(CUT_LINE_WIDTH_MM / MM_PER_IN);
+  cs.set_color(BLACK, false, true);	// set stroke color
+
+  if (show_outlines)
+  {
+    cs.begin_segment({ ElementRole::OVERLAY_OUTLINE, 0 });
+    emit_overlay_outline(cs, geom);
+    cs.end_segment();
+  }
+
+  if (show_outlines)
+  {
+    for (const KeyPlacement& key: key_placements(geom))
+    {
+      cs.begin_segment({ ElementRole::KEY_OUTLINE, key.key_code });
+      emit_key_outline(cs, geom, key);
+      cs.end_segment();
+    }
+  }
+
+  if (show_legends)
+  {
+    std::vector<LegendAnchors> other;
+    if (legend_set.data() != legend_table().data())
+      other = legend_anchors(geom, legend_set);
+    const std::vector<LegendAnchors>& table = other.empty() ? legend_anchors(geom) : other;
+    cs.set_color_space("DeviceRGB", true, false);
+    for (LegendSlot slot: { LegendSlot::F_SHIFT, LegendSlot::PRIMARY, LegendSlot::G_SHIFT })
+      emit_legend_run(cs, table, slot);
+  }
+}
+
@@ -0,0 +1,136 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "content_stream_string.h"
+#include "display_list.h"
+
+static constexpr double MM_PER_IN = 25.4;
+static constexpr double PT_PER_IN = 72.0;
+
+static constexpr double CUT_LINE_WIDTH_MM = 0.1;
+
+
+struct RegistrationGeometry
+{
+  double inset_left_in;
+  double inset_right_in;
+  double inset_top_in;
+  double inset_bottom_in;
+
+  double square_size_in;
+  double line_length_in;
+  double line_width_in;
+};
+
+
+struct OverlayGeometry
+{
+  double width_in;
+  double height_in;
+  double corner_radius_in;
+
+  double key_col_pitch_in;
+  double key_row_pitch_in;
+  double key_row_1_offset_in;
+
+  double key_width_in;
+  double key_height_in;
+  double key_corner_radius_in;
+};
+
+
+// Legends printed around each key, as on the calculator: the f-shifted
+// function in gold above the key, the primary function on the key, and
+// the g-shifted function in blue on the front of the key, below it.
+enum struct LegendSlot
+{
+  F_SHIFT,
+  PRIMARY,
+  G_SHIFT
+};
+
+static constexpr std::size_t LEGEND_SLOT_COUNT = 3;
+
+static constexpr Color F_LEGEND_COLOR       = { 0.80, 0.55, 0.10 };
+static constexpr Color PRIMARY_LEGEND_COLOR = BLACK;
+static constexpr Color G_LEGEND_COLOR       = { 0.20, 0.45, 0.80 };
+
+static constexpr double LEGEND_FONT_SIZE_IN = 6.0 / PT_PER_IN;
+
+struct Legend
+{
+  int key_code;
+  const char* text[LEGEND_SLOT_COUNT];	// indexed by LegendSlot, "" if none
+};
+
+// The built-in legend set.  Other sets are given as spans of the same
+// form, e.g. defined by a queue of orders; keys not in a set have no
+// legends.
+std::span<const Legend> legend_table();
+
+ElementRole legend_role(LegendSlot slot);
+
+
+// Position of one key within the overlay, top left origin.
+struct KeyPlacement
+{
+  int key_code;			// user key code, e.g. 11 for top left
+  Coord origin;
+  Dimensions size;
+};
+
+std::vector<KeyPlacement> key_placements(const OverlayGeometry& geom);
+
+// Text positions of the legend slots of each key, in overlay coordinates,
+// with the legend of the key, so that emitting the legends needs no
+// further layout or lookup.  The table of the built-in legends is
+// computed once per geometry, on first use, and shared by every overlay
+// of that geometry; that of another set is made from it.
+struct LegendAnchors
+{
+  int key_code;
+  Coord slot[LEGEND_SLOT_COUNT];	// indexed by LegendSlot
+  const Legend* legend;			// nullptr if the key has none
+};
+
+const std::vector<LegendAnchors>& legend_anchors(const OverlayGeometry& geom);
+std::vector<LegendAnchors> legend_anchors(const OverlayGeometry& geom,
+					  std::span<const Legend> legend_set);
+
+
+// Each drawing element is emitted as its own segment of the content
+// stream, identified by ElementId.  If recording is non-null, the drawing
+// operations are also recorded to it.  The legends of each slot are
+// emitted together, as one text object in the color of the slot.
+ContentStreamString create_registration(double page_width_in,
+					double page_height_in,
+					const RegistrationGeometry& geom,
+					DisplayList* recording = nullptr);
+
+ContentStreamString create_overlay(const OverlayGeometry& geom,
+				   bool show_outlines,
+				   bool show_legends,
+				   std::span<const Legend> legend_set = legend_table(),
+				   DisplayList* recording = nullptr);
+
+// Emit into an existing stream, e.g. a count-only one.
+void emit_registration(ContentStreamString& s,
+		       double page_width_in,
+		       double page_height_in,
+		       const RegistrationGeometry& geom);
+
+void emit_overlay(ContentStreamString& cs,
+		  const OverlayGeometry& geom,
+		  bool show_outlines,
+		  bool show_legends,
+		  std::span<const Legend> legend_set = legend_table());
+
+
+#endif // OVERLAY_H
@@ -0,0 +1,520 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "page.h"
+#include "parallel.h"
+#include "shm_cache.h"
+
+
+const OverlayGeometry* model_geometry(const std::string& model)
+{
+  if (model == "voyager")
+    return & hp_geometry;
+  if (model == "dm1xl")
+    return & sm_geometry;
+  return nullptr;
+}
+
+
+// The cache version identifies the sources of the overlay generator,
+// hashed by the build, so that entries generated by a build with
+// different output for the same inputs are never used.  A build that
+// doesn't define it doesn't use the cache for overlays.
+#ifdef GENERATOR_HASH
+static constexpr std::optional<uint32_t> OVERLAY_CACHE_VERSION = GENERATOR_HASH;
+#else
+static constexpr std::optional<uint32_t> OVERLAY_CACHE_VERSION;
+#endif
+
+// All of the inputs of generate_overlay(), as bytes.
+static std::string overlay_cache_key(const OverlayGeometry& geom,
+				     bool show_outlines,
+				     bool show_legends,
+				     std::span<const Legend> legend_set,
+				     bool common_line)
+{
+  std::string key(reinterpret_cast<const char*>(& geom), sizeof(geom));
+  key += show_outlines ? 'o' : '-';
+  key += show_legends ? 'l' : '-';
+  key += common_line ? 'c' : '-';
+  if (show_legends)
+  {
+    for (const Legend& legend: legend_set)
+    {
+      key.append(reinterpret_cast<const char*>(& legend.key_code), sizeof(legend.key_code));
+      for (const char* text: legend.text)
+	key.append(text, std::strlen(text) + 1);
+    }
+  }
+  return key;
+}
+
+// For common-line cutting, the outer outline is left out of the overlay,
+// as the outlines of all overlays of the page are cut together.
+static std::string generate_overlay(const OverlayGeometry& geom,
+				    bool show_outlines,
+				    bool show_legends,
+				    std::span<const Legend> legend_set,
+				    bool common_line)
+{
+  ContentStreamString cs = create_overlay(geom, show_outlines, show_legends, legend_set);
+  if (show_outlines && common_line)
+    cs.splice_segment({ ElementRole::OVERLAY_OUTLINE, 0 }, "");
+  return cs;
+}
+
+static std::string cached_overlay(ShmCache* cache,
+				  const OverlayGeometry& geom,
+				  bool show_outlines,
+				  bool show_legends,
+				  std::span<const Legend> legend_set,
+				  bool common_line)
+{
+  if ((! cache) || (! OVERLAY_CACHE_VERSION))
+    return generate_overlay(geom, show_outlines, show_legends, legend_set, common_line);
+
+  std::string key = overlay_cache_key(geom, show_outlines, show_legends, legend_set, common_line);
+  if (auto cached = cache->lookup(key, *OVERLAY_CACHE_VERSION))
+    return std::string(*cached);
+
+  std::string s = generate_overlay(geom, show_outlines, show_legends, legend_set, common_line);
+  cache->insert(key, *OVERLAY_CACHE_VERSION, s);
+  return s;
+}
+
+// Imported artwork is printed with the legends, cut with the outlines,
+// or both, in every slot.
+static void emit_artwork(ContentStreamString& cs,
+			 const PageOptions& options)
+{
+  if (options.artwork.empty())
+    return;
+  if (options.show_legends && (options.artwork_use != ArtworkUse::CUT))
+  {
+    cs.begin_segment({ ElementRole::ARTWORK, 0 });
+    cs.set_color_space("DeviceRGB", true, false);
+    cs.set_color(BLACK, true, false);	// set fill color
+    emit_svg_paths(cs, options.artwork, true);
+    cs.end_segment();
+  }
+  if (options.show_outlines && (options.artwork_use != ArtworkUse::PRINT))
+  {
+    cs.begin_segment({ ElementRole::ARTWORK, 1 });
+    cs.set_line_width(CUT_LINE_WIDTH_MM / MM_PER_IN);
+    cs.set_color(BLACK, false, true);	// set stroke color
+    emit_svg_paths(cs, options.artwork, false);
+    cs.end_segment();
+  }
+}
+
+
+static constexpr float OVERLAY_MINIMUM_Y_GAP_IN = 0.1;
+
+static constexpr float ADDITIONAL_INSET_IN = 0.1;
+
+Coord slot_origin(const SlotPlacement& slot)
+{
+  // XXX why the heck do I need to subtract 1.75 from bottom for HP Voyager,
+  // ? for SwissMicros???
+  return { slot.left_in, slot.bottom_in - 1.55 };
+}
+
+static std::string create_slot(const SlotPlacement& slot,
+			       const OverlayGeometry& geom,
+			       const PageOptions& options,
+			       std::span<const Legend> legend_set,
+			       const std::string& artwork,
+			       ShmCache* cache)
+{
+  // transform to inch coordinate system, origin at bottom left
+  Coord origin = slot_origin(slot);
+  return ("q "
+	  + std::format("1 0 0 1 {0:g} {1:g} cm\n", origin.x, origin.y)
+	  + cached_overlay(cache, geom, options.show_outlines, options.show_legends, legend_set, options.common_line)
+	  + artwork
+	  + "Q\n");
+}
+
+// The legend set of slot i.
+static std::span<const Legend> slot_legend_set(const SlotLegends& slot_legends,
+					       std::size_t i)
+{
+  return (i < slot_legends.size()) ? slot_legends[i] : legend_table();
+}
+
+void append_slots(std::string& contents,
+		  const std::vector<SlotPlacement>& slots,
+		  const OverlayGeometry& geom,
+		  const PageOptions& options,
+		  const SlotLegends& slot_legends,
+		  const std::string& artwork,
+		  ShmCache* cache,
+		  unsigned threads)
+{
+  std::vector<std::string> buffers(slots.size());
+  parallel_for(slots.size(), threads, [&](std::size_t i)
+  {
+    buffers[i] = create_slot(slots[i], geom, options, slot_legend_set(slot_legends, i), artwork, cache);
+  });
+
+  std::size_t length = contents.length();
+  for (const std::string& buffer: buffers)
+    length += buffer.length();
+  contents.reserve(length);
+  for (const std::string& buffer: buffers)
+    contents += buffer;
+}
+
+CommonLineStats emit_common_line_slots(ContentStreamString& cs,
+				       const std::vector<SlotPlacement>& slots,
+				       const OverlayGeometry& geom)
+{
+  // only the geometry is needed, so the overlay needn't be formatted
+  DisplayList overlay_ops;
+  ContentStreamString overlay(true, true);
+  overlay.record_to(& overlay_ops);
+  emit_overlay(overlay, geom, true, false);
+
+  DisplayList outlines;
+  for (const SlotPlacement& slot: slots)
+    outlines.append(overlay_ops, slot_origin(slot));
+
+  cs.set_line_width(CUT_LINE_WIDTH_MM / MM_PER_IN);
+  cs.set_color(BLACK, false, true);	// set stroke color
+  return emit_common_line_cut(cs, outlines, COMMON_LINE_TOLERANCE_IN);
+}
+
+PageLayout compute_page_layout(double page_width_in,
+			       double page_height_in,
+			       const RegistrationGeometry& reg_geom,
+			       const OverlayGeometry& geom,
+			       bool common_line)
+{
+  PageLayout layout;
+
+  layout.top_in = reg_geom.inset_top_in + ADDITIONAL_INSET_IN;
+  layout.bottom_in = page_height_in - (reg_geom.inset_bottom_in + ADDITIONAL_INSET_IN);
+  layout.available_height_in = layout.bottom_in - layout.top_in;
+  int y_count = layout.available_height_in / geom.height_in;
+  if ((! common_line) &&
+      ((layout.available_height_in - ((y_count * geom.height_in) / (y_count - 1))) < OVERLAY_MINIMUM_Y_GAP_IN))
+    y_count--;
+  // for common-line cutting, the overlays are placed with no gap, so
+  // that adjacent outlines coincide
+  layout.overlay_y_gap_in = common_line ? 0.0 : (layout.available_height_in - (y_count * geom.height_in)) / (y_count - 1);
+
+  for (int y = 0; y < y_count; y++)
+  {
+    double left = (page_width_in - geom.width_in) / 2.0;
+    double top = layout.top_in + (y * (geom.height_in + layout.overlay_y_gap_in));
+    double bottom = top + geom.height_in;
+    layout.slots.push_back({ left, bottom });
+  }
+
+  return layout;
+}
+
+std::string create_page_contents(double page_width_in,
+				 double page_height_in,
+				 const RegistrationGeometry& reg_geom,
+				 const OverlayGeometry& geom,
+				 const PageOptions& options,
+				 std::size_t slot_count,
+				 const SlotLegends& slot_legends,
+				 ShmCache* cache,
+				 unsigned threads,
+				 CommonLineStats* common_line_stats)
+{
+  // Create a stream that displays our image and the given text in
+  // our font.
+  std::string contents;
+
+  PageLayout layout = compute_page_layout(page_width_in, page_height_in, reg_geom, geom, options.common_line);
+  if (layout.slots.size() > slot_count)
+    layout.slots.resize(slot_count);
+
+  // transform to inch coordinate system, origin at left
+  contents = ("q "                                // push graphics stack
+	      + std::format("{0:g} 0 0 {0:g} 0 0 cm ", PT_PER_IN)
+	      );
+
+  if (options.show_reg_marks)
+  {
+    contents += "q\n";
+    contents += create_registration(page_width_in, page_height_in, cameo4_no_mat_reg_geometry);
+    contents += "Q\n";
+  }
+
+  ContentStreamString artwork_contents(false);
+  emit_artwork(artwork_contents, options);
+
+  append_slots(contents, layout.slots, geom, options, slot_legends, artwork_contents, cache, threads);
+
+  if (options.show_outlines && options.common_line)
+  {
+    ContentStreamString cs(true);
+    CommonLineStats stats = emit_common_line_slots(cs, layout.slots, geom);
+    if (common_line_stats)
+      *common_line_stats = stats;
+    contents += cs;
+  }
+
+  contents += "Q\n";
+
+  return contents;
+}
+
+DisplayList record_page(double page_width_in,
+			double page_height_in,
+			const RegistrationGeometry& reg_geom,
+			const OverlayGeometry& geom,
+			const PageOptions& options)
+{
+  DisplayList page;
+  PageLayout layout = compute_page_layout(page_width_in, page_height_in, reg_geom, geom, options.common_line);
+
+  if (options.show_reg_marks)
+  {
+    ContentStreamString reg(true, true);
+    reg.record_to(& page);
+    emit_registration(reg, page_width_in, page_height_in, reg_geom);
+  }
+
+  DisplayList overlay_ops;
+  ContentStreamString overlay(true, true);
+  overlay.record_to(& overlay_ops);
+  emit_overlay(overlay, geom, options.show_outlines, options.show_legends);
+  emit_artwork(overlay, options);
+  std::optional<ElementRole> exclude;
+  if (options.common_line)
+    exclude = ElementRole::OVERLAY_OUTLINE;
+  for (const SlotPlacement& slot: layout.slots)
+    page.append(overlay_ops, slot_origin(slot), exclude);
+
+  if (options.show_outlines && options.common_line)
+  {
+    ContentStreamString cut(true, true);
+    cut.record_to(& page);
+    emit_common_line_slots(cut, layout.slots, geom);
+  }
+
+  return page;
+}
+
+
+// Operators and bytes of some content, and the time to generate it.
+struct ContentCost
+{
+  std::size_t operators;
+  std::size_t bytes;
+  double generation_s;
+};
+
+static ContentCost& operator+=(ContentCost& a, const ContentCost& b)
+{
+  a.operators += b.operators;
+  a.bytes += b.bytes;
+  a.generation_s += b.generation_s;
+  return a;
+}
+
+static ContentCost operator*(const ContentCost& a, std::size_t n)
+{
+  return { a.operators * n, a.bytes * n, a.generation_s * n };
+}
+
+// Generates content into cs twice, and keeps the faster time, as the
+// first also pays for setup done once per process.
+template<class F>
+static ContentCost measure(ContentStreamString& cs, F generate)
+{
+  std::chrono::duration<double> best = std::chrono::duration<double>::max();
+  for (int i = 0; i < 2; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    cs = generate();
+    best = std::min<std::chrono::duration<double>>(best, std::chrono::steady_clock::now() - start);
+  }
+  return { cs.operator_count(), cs.byte_count(), best.count() };
+}
+
+// An overlay, and its outer outline, which is left out for common-line
+// cutting although it is still generated.
+struct OverlayCost
+{
+  ContentCost overlay;
+  ContentCost outline;
+};
+
+// The overlays and common-line cuts generated for estimates, kept for the
+// life of the process, so that each is only generated once.
+static std::mutex estimate_table_mutex;
+static std::map<std::string, OverlayCost> overlay_costs;
+static std::map<std::string, ContentCost> cut_costs;
+
+static const OverlayCost& overlay_cost(const OverlayGeometry& geom,
+				       const PageOptions& options,
+				       std::span<const Legend> legend_set)
+{
+  std::string key = overlay_cache_key(geom, options.show_outlines, options.show_legends, legend_set, false);
+  std::lock_guard<std::mutex> lock(estimate_table_mutex);
+  auto it = overlay_costs.find(key);
+  if (it != overlay_costs.end())
+    return it->second;
+
+  ContentStreamString cs(false);
+  OverlayCost cost = { measure(cs, [&]()
+  {
+    return create_overlay(geom, options.show_outlines, options.show_legends, legend_set);
+  }), { 0, 0, 0.0 } };
+  if (const Segment* outline = cs.find_segment({ ElementRole::OVERLAY_OUTLINE, 0 }))
+    cost.outline = { outline->operator_count, outline->length, 0.0 };
+  return overlay_costs.emplace(key, cost).first->second;
+}
+
+// The cut of the first slot_count slots of a layout.
+static const ContentCost& cut_cost(const RegistrationGeometry& reg_geom,
+				   const OverlayGeometry& geom,
+				   const PageLayout& layout,
+				   std::size_t slot_count)
+{
+  std::string key(reinterpret_cast<const char*>(& reg_geom), sizeof(reg_geom));
+  key.append(reinterpret_cast<const char*>(& geom), sizeof(geom));
+  key += std::to_string(slot_count);
+  std::lock_guard<std::mutex> lock(estimate_table_mutex);
+  auto it = cut_costs.find(key);
+  if (it != cut_costs.end())
+    return it->second;
+
+  std::vector<SlotPlacement> slots(layout.slots.begin(), layout.slots.begin() + slot_count);
+  ContentStreamString cs(false);
+  ContentCost cost = measure(cs, [&]()
+  {
+    ContentStreamString cut(true);
+    emit_common_line_slots(cut, slots, geom);
+    return cut;
+  });
+  return cut_costs.emplace(key, cost).first->second;
+}
+
+// What all pages of one geometry share: the layout, and the content of
+// the first n slots, with their transforms and artwork, less the
+// overlays.
+struct GeometryCost
+{
+  PageLayout layout;
+  std::vector<ContentCost> slots;	// indexed by n
+};
+
+Estimate estimate_pages(const RegistrationGeometry& reg_geom,
+			const PageOptions& options,
+			const std::vector<PageSlots>& pages)
+{
+  Estimate e = { 0, 0, 0, 0, 0.0 };
+
+  // page transform, q ... Q
+  ContentCost page = { 3, 2 + std::formatted_size("{0:g} 0 0 {0:g} 0 0 cm ", PT_PER_IN) + 2, 0.0 };
+
+  if (options.show_reg_marks)
+  {
+    ContentStreamString cs(false);
+    ContentCost reg = measure(cs, [&]()
+    {
+      return create_registration(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry);
+    });
+    reg.operators += 2;
+    reg.bytes += 4;
+    page += reg;
+  }
+
+  // The artwork is generated once per page, and appended to every slot.
+  ContentStreamString artwork_contents(false);
+  ContentCost artwork = measure(artwork_contents, [&]()
+  {
+    ContentStreamString cs(false);
+    emit_artwork(cs, options);
+    return cs;
+  });
+  page.generation_s += artwork.generation_s;
+  artwork.generation_s = 0.0;
+
+  // The overlay of each geometry and legend set, as it is in a slot.
+  std::map<std::pair<const OverlayGeometry*, const Legend*>, ContentCost> overlays;
+  auto slot_overlay = [&](const OverlayGeometry* geom, std::span<const Legend> legend_set) -> const ContentCost&
+  {
+    auto [it, inserted] = overlays.try_emplace({ geom, legend_set.data() });
+    if (inserted)
+    {
+      const OverlayCost& cost = overlay_cost(*geom, options, legend_set);
+      it->second = cost.overlay;
+      if (options.show_outlines && options.common_line)
+      {
+	it->second.operators -= cost.outline.operators;
+	it->second.bytes -= cost.outline.bytes;
+      }
+    }
+    return it->second;
+  };
+
+  std::map<const OverlayGeometry*, GeometryCost> geometries;
+  for (const PageSlots& p: pages)
+  {
+    auto it = geometries.find(p.geom);
+    if (it == geometries.end())
+    {
+      GeometryCost g = { compute_page_layout(letter_width_in, letter_height_in, reg_geom,
+					     *p.geom, options.common_line),
+			 { { 0, 0, 0.0 } } };
+      for (const SlotPlacement& slot: g.layout.slots)
+      {
+	Coord origin = slot_origin(slot);
+	ContentCost s = g.slots.back();
+	s += artwork;
+	s.operators += 3;
+	s.bytes += 2 + std::formatted_size("1 0 0 1 {0:g} {1:g} cm\n", origin.x, origin.y) + 2;
+	g.slots.push_back(s);
+      }
+      it = geometries.emplace(p.geom, std::move(g)).first;
+    }
+
+    GeometryCost& g = it->second;
+    std::size_t slot_count = std::min(p.slot_count, g.layout.slots.size());
+    ContentCost c = page;
+    c += g.slots[slot_count];
+    std::size_t builtin_slots = slot_count;
+    for (std::size_t i = 0; i < std::min(slot_count, p.legends.size()); i++)
+    {
+      if (p.legends[i].data() != legend_table().data())
+      {
+	c += slot_overlay(p.geom, p.legends[i]);
+	builtin_slots--;
+      }
+    }
+    c += slot_overlay(p.geom, legend_table()) * builtin_slots;
+    if (options.show_outlines && options.common_line)
+      c += cut_cost(reg_geom, *p.geom, g.layout, slot_count);
+
+    e.pages++;
+    e.streams++;	// one content stream per page
+    e.operators += c.operators;
+    e.uncompressed_bytes += c.bytes;
+    e.generation_s += c.generation_s;
+  }
+  return e;
+}
+
+Estimate estimate_pdf(const RegistrationGeometry& reg_geom,
+		      const OverlayGeometry& geom,
+		      const PageOptions& options)
+{
+  return estimate_pages(reg_geom, options, { { & geom, ALL_SLOTS, {} } });
+}
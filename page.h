@@ -0,0 +1,221 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common_line.h"
+#include "display_list.h"
+#include "overlay.h"
+#include "svg_import.h"
+
+class ShmCache;
+
+// Layout of a page of overlays, and generation of its content stream or
+// its recorded drawing operations.  Nothing here depends on the PDF
+// library; the documents themselves are assembled in document.cpp.
+
+static constexpr double letter_width_in = 8.5;
+static constexpr double letter_height_in = 11.0;
+
+static constexpr double letter_width_pt = letter_width_in * PT_PER_IN;
+static constexpr double letter_height_pt = letter_height_in * PT_PER_IN;
+
+static constexpr double PAGE_INSET_LEFT_IN     = 0.625;
+static constexpr double PAGE_INSET_RIGHT_IN    = 0.625;
+static constexpr double PAGE_INSET_TOP_IN      = 0.625;
+static constexpr double PAGE_INSET_BOTTOM_IN   = 1.024;
+
+static constexpr double REG_MARK_SIZE_IN       = 0.250;
+static constexpr double REG_MARK_LINE_WIDTH_MM = 0.5;
+
+constexpr RegistrationGeometry cameo4_no_mat_reg_geometry =
+{
+  .inset_left_in   = PAGE_INSET_LEFT_IN,
+  .inset_right_in  = PAGE_INSET_RIGHT_IN,
+  .inset_top_in    = PAGE_INSET_TOP_IN,
+  .inset_bottom_in = PAGE_INSET_BOTTOM_IN,
+
+  .square_size_in  = REG_MARK_SIZE_IN,
+  .line_length_in  = REG_MARK_SIZE_IN,
+  .line_width_in   = REG_MARK_LINE_WIDTH_MM / MM_PER_IN,
+};
+
+constexpr OverlayGeometry hp_geometry =
+{
+  .width_in             = 4.65,
+  .height_in            = 2.10,
+  .corner_radius_in     = 0.025,
+
+  .key_col_pitch_in     = 0.45,
+  .key_row_pitch_in     = 0.50,
+  .key_row_1_offset_in  = 0.133,
+
+  .key_width_in         = 0.34,
+  .key_height_in        = 0.32,
+  .key_corner_radius_in = 0.025
+};
+
+constexpr OverlayGeometry sm_geometry =
+{
+  .width_in             = 4.75,
+  .height_in            = 1.95,
+  .corner_radius_in     = 0.025,
+
+  .key_col_pitch_in     = 0.475,
+  .key_row_pitch_in     = 0.475,
+  .key_row_1_offset_in  = 0.175,
+
+  .key_width_in         = 0.33,
+  .key_height_in        = 0.30,
+  .key_corner_radius_in = 0.025
+};
+
+// Models that orders may name, as used in output file names; nullptr for
+// an unknown model.
+const OverlayGeometry* model_geometry(const std::string& model);
+
+// edges closer than this are cut as one
+static constexpr double COMMON_LINE_TOLERANCE_IN = 0.001;
+
+// imported artwork may deviate this much from the original, well below
+// the precision of the cutter
+static constexpr double ARTWORK_TOLERANCE_IN = 0.001;
+
+
+// Imported artwork may be printed, e.g. as a logo, or also cut out, e.g.
+// as a window in the overlay.
+enum struct ArtworkUse
+{
+  PRINT,
+  CUT,
+  BOTH
+};
+
+// What is drawn on each page.
+struct PageOptions
+{
+  bool show_outlines;
+  bool show_reg_marks;
+  bool show_legends;
+  bool common_line;		// place overlays with no gap, cut shared edges once
+  std::vector<SvgSubpath> artwork;	// empty if none
+  ArtworkUse artwork_use;
+};
+
+// Position of one overlay on the page.
+struct SlotPlacement
+{
+  double left_in;
+  double bottom_in;
+};
+
+// origin of the overlay coordinate system of a slot, in page coordinates
+Coord slot_origin(const SlotPlacement& slot);
+
+struct PageLayout
+{
+  double top_in;
+  double bottom_in;
+  double available_height_in;
+  double overlay_y_gap_in;
+  std::vector<SlotPlacement> slots;
+};
+
+PageLayout compute_page_layout(double page_width_in,
+			       double page_height_in,
+			       const RegistrationGeometry& reg_geom,
+			       const OverlayGeometry& geom,
+			       bool common_line);
+
+// The legend set of each slot of a page, in slot order.  Slots beyond
+// the end, e.g. all slots if it is empty, have the built-in legends.
+using SlotLegends = std::vector<std::span<const Legend>>;
+
+// Appends the content of each slot, the overlay followed by the given
+// artwork content.  Each slot is generated into its own buffer, possibly
+// on a worker thread, and the buffers are appended in slot order, so the
+// result is the same for any number of threads.  If cache is non-null,
+// generated overlays are shared through it.
+void append_slots(std::string& contents,
+		  const std::vector<SlotPlacement>& slots,
+		  const OverlayGeometry& geom,
+		  const PageOptions& options,
+		  const SlotLegends& slot_legends,
+		  const std::string& artwork,
+		  ShmCache* cache,
+		  unsigned threads);
+
+// Cut the outer outlines of all slots, with shared edges cut once.
+CommonLineStats emit_common_line_slots(ContentStreamString& cs,
+				       const std::vector<SlotPlacement>& slots,
+				       const OverlayGeometry& geom);
+
+// Fill every slot of a page.
+static constexpr std::size_t ALL_SLOTS = std::numeric_limits<std::size_t>::max();
+
+// The content stream of a page, in points.  Only the first slot_count
+// slots are filled, e.g. for the last sheet of a plan.  If
+// common_line_stats is non-null, the statistics of the common-line cut,
+// if any, are stored to it.
+std::string create_page_contents(double page_width_in,
+				 double page_height_in,
+				 const RegistrationGeometry& reg_geom,
+				 const OverlayGeometry& geom,
+				 const PageOptions& options,
+				 std::size_t slot_count,
+				 const SlotLegends& slot_legends,
+				 ShmCache* cache,
+				 unsigned threads,
+				 CommonLineStats* common_line_stats = nullptr);
+
+// Records the drawing operations of a page, as create_page_contents()
+// emits them, in page coordinates.  Nothing is formatted.
+DisplayList record_page(double page_width_in,
+			double page_height_in,
+			const RegistrationGeometry& reg_geom,
+			const OverlayGeometry& geom,
+			const PageOptions& options);
+
+
+// The content streams of a document, and the time to generate them.
+// Writing the PDF file, which compresses the streams, isn't included.
+struct Estimate
+{
+  unsigned pages;
+  unsigned streams;
+  std::size_t operators;
+  std::size_t uncompressed_bytes;
+  double generation_s;
+};
+
+// A page of the first slot_count slots of a layout of geom.
+struct PageSlots
+{
+  const OverlayGeometry* geom;
+  std::size_t slot_count;
+  SlotLegends legends;
+};
+
+// Predicts the letter size pages that create_page_contents() would
+// generate.  An overlay of each geometry and options, and the
+// common-line cut of each number of slots, is generated and timed once in
+// the life of the process, and the registration marks and artwork once
+// per call; each page then adds up those costs, an overlay for every
+// slot.
+Estimate estimate_pages(const RegistrationGeometry& reg_geom,
+			const PageOptions& options,
+			const std::vector<PageSlots>& pages);
+
+// The page of create_pdf().
+Estimate estimate_pdf(const RegistrationGeometry& reg_geom,
+		      const OverlayGeometry& geom,
+		      const PageOptions& options);
+
+#endif // PAGE_H
@@ -0,0 +1,146 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+// Worker threads, started as a call first needs them and then kept
+// waiting for the next call, so that a call, e.g. for each page of a
+// plan, only wakes them rather than starting and joining threads.  The
+// pool runs one call at a time.
+class ThreadPool
+{
+public:
+  ~ThreadPool();
+
+  // Runs fn over [0, count) on the calling thread and up to helpers
+  // workers.  Returns false, having run nothing, if the pool is busy
+  // with another call.
+  bool run(std::size_t count,
+	   unsigned helpers,
+	   const std::function<void(std::size_t)>& fn);
+
+private:
+  void work();
+  void run_items();
+
+  std::mutex mutex;
+  std::condition_variable wake;		// for the workers: work, or stop
+  std::condition_variable done;		// for the caller: no worker active
+  std::vector<std::thread> workers;
+  bool busy = false;
+  bool stopping = false;
+
+  // the current call
+  const std::function<void(std::size_t)>* job_fn = nullptr;
+  std::size_t job_count = 0;
+  std::atomic<std::size_t> next = 0;
+  unsigned wanted = 0;			// workers still to join it
+  unsigned active = 0;			// workers running it
+  std::exception_ptr error;
+};
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& thread: workers)
+    thread.join();
+}
+
+bool ThreadPool::run(std::size_t count,
+		     unsigned helpers,
+		     const std::function<void(std::size_t)>& fn)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (busy)
+      return false;
+    busy = true;
+    while (workers.size() < helpers)
+      workers.emplace_back(&ThreadPool::work, this);
+    job_fn = & fn;
+    job_count = count;
+    next.store(0, std::memory_order_relaxed);
+    wanted = helpers;
+    error = nullptr;
+  }
+  wake.notify_all();
+
+  run_items();
+
+  std::exception_ptr e;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    wanted = 0;		// workers not yet woken aren't needed now
+    done.wait(lock, [this] { return active == 0; });
+    job_fn = nullptr;
+    busy = false;
+    e = error;
+  }
+  if (e)
+    std::rethrow_exception(e);
+  return true;
+}
+
+void ThreadPool::work()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;)
+  {
+    wake.wait(lock, [this] { return stopping || (wanted > 0); });
+    if (stopping)
+      return;
+    wanted--;
+    active++;
+    lock.unlock();
+    run_items();
+    lock.lock();
+    if (--active == 0)
+      done.notify_one();
+  }
+}
+
+void ThreadPool::run_items()
+{
+  for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < job_count; )
+  {
+    try
+    {
+      (*job_fn)(i);
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (! error)
+	error = std::current_exception();
+      next.store(job_count, std::memory_order_relaxed);	// stop handing out work
+    }
+  }
+}
+
+void parallel_for(std::size_t count,
+		  unsigned threads,
+		  const std::function<void(std::size_t)>& fn)
+{
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<std::size_t>(threads, count);
+
+  static ThreadPool pool;
+  if ((threads > 1) && pool.run(count, threads - 1, fn))
+    return;
+
+  for (std::size_t i = 0; i < count; i++)
+    fn(i);
+}
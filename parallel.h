@@ -0,0 +1,21 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Calls fn(i) for each i in [0, count), distributing the calls over up to
+// the given number of threads, including the calling thread.  A thread
+// count of zero means one per CPU.  Returns when all calls are complete;
+// if any call throws, one of the exceptions is rethrown.  The other
+// threads are kept from one call to the next.  A call made while another
+// is running, e.g. from within fn, makes all its calls on the calling
+// thread.
+void parallel_for(std::size_t count,
+		  unsigned threads,
+		  const std::function<void(std::size_t)>& fn);
+
+#endif // PARALLEL_H
@@ -0,0 +1,512 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+#include <stdexcept>
+
+#ifndef RASTER_LIBS_LINKED
+#include <dlfcn.h>
+#endif
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <png.h>
+
+#include "flatten.h"
+#include "raster.h"
+
+// maximum deviation of flattened curves, in pixels
+static constexpr double FLATTEN_TOLERANCE_PX = 0.2;
+
+// thinner lines are drawn one pixel wide, so that cut lines remain
+// visible at all zoom levels
+static constexpr double MINIMUM_LINE_WIDTH_PX = 1.0;
+
+// sub-scanlines per pixel row for antialiased fills
+static constexpr int FILL_SUBSAMPLES = 4;
+
+
+// FreeType and libpng are only needed for previews, so unless they are
+// linked in, as in the static build, they are loaded on first use rather
+// than by the dynamic linker at every startup.
+struct RasterLibs
+{
+  decltype(& FT_Init_FreeType) init_freetype;
+  decltype(& FT_New_Face) new_face;
+  decltype(& FT_Done_Face) done_face;
+  decltype(& FT_Done_FreeType) done_freetype;
+  decltype(& FT_Set_Char_Size) set_char_size;
+  decltype(& FT_Load_Char) load_char;
+
+  decltype(& png_create_write_struct) create_write_struct;
+  decltype(& png_create_info_struct) create_info_struct;
+  decltype(& png_set_longjmp_fn) set_longjmp_fn;
+  decltype(& png_destroy_write_struct) destroy_write_struct;
+  decltype(& png_init_io) init_io;
+  decltype(& png_set_IHDR) set_IHDR;
+  decltype(& png_write_info) write_info;
+  decltype(& png_write_row) write_row;
+  decltype(& png_write_end) write_end;
+};
+
+#ifdef RASTER_LIBS_LINKED
+
+static const RasterLibs& raster_libs()
+{
+  static const RasterLibs libs =
+  {
+    FT_Init_FreeType, FT_New_Face, FT_Done_Face, FT_Done_FreeType,
+    FT_Set_Char_Size, FT_Load_Char,
+    png_create_write_struct, png_create_info_struct, png_set_longjmp_fn,
+    png_destroy_write_struct, png_init_io, png_set_IHDR, png_write_info,
+    png_write_row, png_write_end
+  };
+  return libs;
+}
+
+#else
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+static constexpr const char* FREETYPE_LIBRARY = "libfreetype.so.6";
+static constexpr const char* PNG_LIBRARY = "libpng" STRINGIFY(PNG_LIBPNG_VER_DLLNUM) ".so." STRINGIFY(PNG_LIBPNG_VER_SONUM);
+
+static void* open_library(const char* name)
+{
+  void* handle = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+  if (! handle)
+    throw std::runtime_error(std::string("can't load ") + name + ", needed for previews");
+  return handle;
+}
+
+template <typename F>
+static void find_symbol(F& f,
+			void* handle,
+			const char* library,
+			const char* name)
+{
+  f = reinterpret_cast<F>(dlsym(handle, name));
+  if (! f)
+    throw std::runtime_error(std::string("can't find ") + name + " in " + library);
+}
+
+static RasterLibs load_raster_libs()
+{
+  RasterLibs libs;
+  void* ft = open_library(FREETYPE_LIBRARY);
+  find_symbol(libs.init_freetype, ft, FREETYPE_LIBRARY, "FT_Init_FreeType");
+  find_symbol(libs.new_face, ft, FREETYPE_LIBRARY, "FT_New_Face");
+  find_symbol(libs.done_face, ft, FREETYPE_LIBRARY, "FT_Done_Face");
+  find_symbol(libs.done_freetype, ft, FREETYPE_LIBRARY, "FT_Done_FreeType");
+  find_symbol(libs.set_char_size, ft, FREETYPE_LIBRARY, "FT_Set_Char_Size");
+  find_symbol(libs.load_char, ft, FREETYPE_LIBRARY, "FT_Load_Char");
+
+  void* png = open_library(PNG_LIBRARY);
+  find_symbol(libs.create_write_struct, png, PNG_LIBRARY, "png_create_write_struct");
+  find_symbol(libs.create_info_struct, png, PNG_LIBRARY, "png_create_info_struct");
+  find_symbol(libs.set_longjmp_fn, png, PNG_LIBRARY, "png_set_longjmp_fn");
+  find_symbol(libs.destroy_write_struct, png, PNG_LIBRARY, "png_destroy_write_struct");
+  find_symbol(libs.init_io, png, PNG_LIBRARY, "png_init_io");
+  find_symbol(libs.set_IHDR, png, PNG_LIBRARY, "png_set_IHDR");
+  find_symbol(libs.write_info, png, PNG_LIBRARY, "png_write_info");
+  find_symbol(libs.write_row, png, PNG_LIBRARY, "png_write_row");
+  find_symbol(libs.write_end, png, PNG_LIBRARY, "png_write_end");
+  // the libraries stay loaded until exit
+  return libs;
+}
+
+// Thread-safe; if loading fails, it is retried by the next caller.
+static const RasterLibs& raster_libs()
+{
+  static const RasterLibs libs = load_raster_libs();
+  return libs;
+}
+
+#endif // RASTER_LIBS_LINKED
+
+
+struct GlyphCache::FreeType
+{
+  FT_Library library;
+  FT_Face face;
+};
+
+GlyphCache::GlyphCache(const std::string& font_file):
+  file(font_file)
+{
+}
+
+GlyphCache::~GlyphCache()
+{
+  if (ft)
+  {
+    const RasterLibs& libs = raster_libs();
+    libs.done_face(ft->face);
+    libs.done_freetype(ft->library);
+  }
+}
+
+const GlyphCache::Glyph& GlyphCache::glyph(char c,
+					   double pixel_size)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // sizes are cached in 26.6 fixed point, as FreeType uses them
+  long size_26_6 = std::lround(pixel_size * 64.0);
+  auto it = glyphs.find({ c, size_26_6 });
+  if (it != glyphs.end())
+    return *it->second;
+
+  const RasterLibs& libs = raster_libs();
+  if (! ft)
+  {
+    auto f = std::make_unique<FreeType>();
+    if (libs.init_freetype(& f->library))
+      throw std::runtime_error("can't initialize FreeType");
+    if (libs.new_face(f->library, file.c_str(), 0, & f->face))
+    {
+      libs.done_freetype(f->library);
+      throw std::runtime_error("can't load font `" + file + "'");
+    }
+    ft = std::move(f);
+  }
+
+  auto g = std::make_unique<Glyph>();
+  libs.set_char_size(ft->face, 0, size_26_6, 72, 72);
+  if (libs.load_char(ft->face, static_cast<unsigned char>(c), FT_LOAD_RENDER) == 0)
+  {
+    FT_GlyphSlot slot = ft->face->glyph;
+    g->left = slot->bitmap_left;
+    g->top = slot->bitmap_top;
+    g->width = slot->bitmap.width;
+    g->rows = slot->bitmap.rows;
+    g->advance = slot->advance.x / 64.0;
+    for (unsigned y = 0; y < g->rows; y++)
+    {
+      const uint8_t* row = slot->bitmap.buffer + y * slot->bitmap.pitch;
+      g->coverage.insert(g->coverage.end(), row, row + g->width);
+    }
+  }
+  else
+    *g = { 0, 0, 0, 0, pixel_size / 2.0, {} };
+
+  const Glyph& result = *g;
+  glyphs.emplace(std::make_pair(c, size_26_6), std::move(g));
+  return result;
+}
+
+
+Raster::Raster(unsigned width,
+	       unsigned height):
+  w(width),
+  h(height),
+  rgb(width * height * 3, 255),
+  mask_x0(0), mask_y0(0), mask_x1(0), mask_y1(0)
+{
+}
+
+void Raster::begin_mask(Coord min,
+			Coord max)
+{
+  if (mask.empty())
+    mask.resize(w * h, 0.0f);
+  mask_x0 = std::clamp<int>(std::floor(min.x), 0, w);
+  mask_y0 = std::clamp<int>(std::floor(min.y), 0, h);
+  mask_x1 = std::clamp<int>(std::ceil(max.x) + 1, 0, w);
+  mask_y1 = std::clamp<int>(std::ceil(max.y) + 1, 0, h);
+}
+
+void Raster::composite_mask(Color color)
+{
+  const float c[3] = { float(color.r * 255.0), float(color.g * 255.0), float(color.b * 255.0) };
+  for (int y = mask_y0; y < mask_y1; y++)
+  {
+    for (int x = mask_x0; x < mask_x1; x++)
+    {
+      float& m = mask[y * w + x];
+      if (m <= 0.0f)
+	continue;
+      float a = std::min(m, 1.0f);
+      uint8_t* p = & rgb[(y * w + x) * 3];
+      for (int i = 0; i < 3; i++)
+	p[i] = std::lround(p[i] * (1.0f - a) + c[i] * a);
+      m = 0.0f;
+    }
+  }
+}
+
+// Each pixel is covered according to its distance from the nearest
+// segment, which gives round joins and caps.
+void Raster::stroke_polyline(std::span<const Coord> points,
+			     double width)
+{
+  double half = std::max(width, MINIMUM_LINE_WIDTH_PX) / 2.0;
+  for (std::size_t i = 1; i < points.size(); i++)
+  {
+    Coord a = points[i - 1];
+    Coord b = points[i];
+    Coord d = { b.x - a.x, b.y - a.y };
+    double length_squared = d.x * d.x + d.y * d.y;
+
+    int x0 = std::max<int>(std::floor(std::min(a.x, b.x) - half - 1.0), mask_x0);
+    int x1 = std::min<int>(std::ceil (std::max(a.x, b.x) + half + 1.0), mask_x1);
+    int y0 = std::max<int>(std::floor(std::min(a.y, b.y) - half - 1.0), mask_y0);
+    int y1 = std::min<int>(std::ceil (std::max(a.y, b.y) + half + 1.0), mask_y1);
+    for (int y = y0; y < y1; y++)
+    {
+      for (int x = x0; x < x1; x++)
+      {
+	Coord p = { x + 0.5 - a.x, y + 0.5 - a.y };
+	double t = 0.0;
+	if (length_squared > 0.0)
+	  t = std::clamp((p.x * d.x + p.y * d.y) / length_squared, 0.0, 1.0);
+	double distance = std::hypot(p.x - t * d.x, p.y - t * d.y);
+	float coverage = std::clamp(half + 0.5 - distance, 0.0, 1.0);
+	float& m = mask[y * w + x];
+	m = std::max(m, coverage);
+      }
+    }
+  }
+}
+
+// Fill by the PDF fill rule, sampled on several sub-scanlines per pixel
+// row, with exact horizontal coverage of span ends.
+void Raster::fill_polygons(const std::vector<std::vector<Coord>>& polygons,
+			   FillRule fill_rule)
+{
+  struct Crossing { double x; int winding; };
+  std::vector<Crossing> crossings;
+
+  for (int y = mask_y0; y < mask_y1; y++)
+  {
+    for (int s = 0; s < FILL_SUBSAMPLES; s++)
+    {
+      double sy = y + (s + 0.5) / FILL_SUBSAMPLES;
+      crossings.clear();
+      for (const std::vector<Coord>& polygon: polygons)
+      {
+	for (std::size_t i = 0; i < polygon.size(); i++)
+	{
+	  Coord a = polygon[i];
+	  Coord b = polygon[(i + 1) % polygon.size()];
+	  if ((a.y <= sy) == (b.y <= sy))
+	    continue;
+	  double x = a.x + (sy - a.y) * (b.x - a.x) / (b.y - a.y);
+	  crossings.push_back({ x, (b.y > a.y) ? 1 : -1 });
+	}
+      }
+      std::sort(crossings.begin(), crossings.end(),
+		[](const Crossing& a, const Crossing& b) { return a.x < b.x; });
+
+      int winding = 0;
+      for (std::size_t i = 0; i + 1 < crossings.size(); i++)
+      {
+	winding += crossings[i].winding;
+	if ((fill_rule == FillRule::EVEN_ODD) ? ((winding & 1) == 0) : (winding == 0))
+	  continue;
+	double xa = std::max<double>(crossings[i].x, mask_x0);
+	double xb = std::min<double>(crossings[i + 1].x, mask_x1);
+	for (int x = std::floor(xa); x < xb; x++)
+	{
+	  double covered = std::min(xb, x + 1.0) - std::max(xa, double(x));
+	  if (covered > 0.0)
+	    mask[y * w + x] += covered / FILL_SUBSAMPLES;
+	}
+      }
+    }
+  }
+}
+
+// Glyphs of one text don't overlap, so they are blended directly rather
+// than through the mask.
+void Raster::draw_text(const DisplayText& text,
+		       Coord position,
+		       double pixels_per_in,
+		       GlyphCache& glyphs,
+		       Color color)
+{
+  double pixel_size = text.font_size * pixels_per_in;
+  double pen = position.x;
+  int baseline = std::lround(position.y);
+  for (char c: text.text)
+  {
+    const GlyphCache::Glyph& g = glyphs.glyph(c, pixel_size);
+    int gx = std::lround(pen) + g.left;
+    int gy = baseline - g.top;
+    for (unsigned row = 0; row < g.rows; row++)
+    {
+      int y = gy + row;
+      if ((y < 0) || (y >= int(h)))
+	continue;
+      for (unsigned col = 0; col < g.width; col++)
+      {
+	int x = gx + col;
+	if ((x < 0) || (x >= int(w)))
+	  continue;
+	float a = g.coverage[row * g.width + col] / 255.0f;
+	uint8_t* p = & rgb[(y * w + x) * 3];
+	p[0] = std::lround(p[0] * (1.0f - a) + color.r * 255.0 * a);
+	p[1] = std::lround(p[1] * (1.0f - a) + color.g * 255.0 * a);
+	p[2] = std::lround(p[2] * (1.0f - a) + color.b * 255.0 * a);
+      }
+    }
+    pen += g.advance;
+  }
+}
+
+void Raster::draw(const DisplayList& list,
+		  std::span<const DisplayItem> items,
+		  const RasterView& view,
+		  GlyphCache* glyphs)
+{
+  std::vector<std::vector<Coord>> subpaths;
+  std::vector<bool> closed;
+  std::vector<CubicBezier> curves;
+  std::vector<Coord> curve_points;
+  std::vector<unsigned> curve_counts;
+
+  for (const DisplayItem& item: items)
+  {
+    const DisplayOp& last = list[item.first_op + item.op_count - 1];
+    if (last.kind == DisplayOpKind::TEXT)
+    {
+      if (glyphs)
+	draw_text(list.texts()[last.aux], view.to_pixels(last.p[0]), view.pixels_per_in, *glyphs, item.fill_color);
+      continue;
+    }
+
+    // Flatten all curves of the item at once, rather than one at a time,
+    // so that they fill the lanes of flatten_cubics().
+    curves.clear();
+    Coord current = { 0.0, 0.0 };
+    for (std::size_t i = item.first_op; i < item.first_op + item.op_count; i++)
+    {
+      const DisplayOp& op = list[i];
+      if ((op.kind == DisplayOpKind::MOVE_TO) || (op.kind == DisplayOpKind::LINE_TO))
+	current = view.to_pixels(op.p[0]);
+      else if (op.kind == DisplayOpKind::CURVE_TO)
+      {
+	curves.push_back({ current,
+			   view.to_pixels(op.p[0]),
+			   view.to_pixels(op.p[1]),
+			   view.to_pixels(op.p[2]) });
+	current = curves.back().p3;
+      }
+    }
+    curve_points.clear();
+    curve_counts.clear();
+    flatten_cubics(curves, FLATTEN_TOLERANCE_PX, curve_points, & curve_counts);
+    std::size_t next_curve = 0;
+    std::size_t next_point = 0;
+
+    subpaths.clear();
+    closed.clear();
+    for (std::size_t i = item.first_op; i < item.first_op + item.op_count; i++)
+    {
+      const DisplayOp& op = list[i];
+      switch (op.kind)
+      {
+      case DisplayOpKind::MOVE_TO:
+	subpaths.push_back({ view.to_pixels(op.p[0]) });
+	closed.push_back(false);
+	break;
+      case DisplayOpKind::LINE_TO:
+	subpaths.back().push_back(view.to_pixels(op.p[0]));
+	break;
+      case DisplayOpKind::CURVE_TO:
+	{
+	  unsigned count = curve_counts[next_curve++];
+	  subpaths.back().insert(subpaths.back().end(),
+				 curve_points.begin() + next_point,
+				 curve_points.begin() + next_point + count);
+	  next_point += count;
+	}
+	break;
+      case DisplayOpKind::CLOSE:
+      case DisplayOpKind::CLOSE_STROKE:
+      case DisplayOpKind::CLOSE_FILL_STROKE:
+	closed.back() = true;
+	break;
+      default:
+	break;
+      }
+    }
+
+    double line_width = item.line_width * view.pixels_per_in;
+    double margin = std::max(line_width, MINIMUM_LINE_WIDTH_PX) / 2.0 + 1.0;
+    Coord top_left = view.to_pixels({ item.min.x, item.max.y });
+    Coord bottom_right = view.to_pixels({ item.max.x, item.min.y });
+    begin_mask({ top_left.x - margin, top_left.y - margin },
+	       { bottom_right.x + margin, bottom_right.y + margin });
+
+    bool fill = false;
+    bool stroke = false;
+    switch (last.kind)
+    {
+    case DisplayOpKind::STROKE:
+    case DisplayOpKind::CLOSE_STROKE:
+      stroke = true;
+      break;
+    case DisplayOpKind::FILL:
+      fill = true;
+      break;
+    default:
+      fill = stroke = true;
+      break;
+    }
+
+    if (fill)
+    {
+      fill_polygons(subpaths, display_op_fill_rule(last));
+      composite_mask(item.fill_color);
+    }
+    if (stroke)
+    {
+      for (std::size_t i = 0; i < subpaths.size(); i++)
+      {
+	// as in PDF, a subpath that is only a move isn't painted
+	if (subpaths[i].size() < 2)
+	  continue;
+	if (closed[i])
+	  subpaths[i].push_back(subpaths[i].front());
+	stroke_polyline(subpaths[i], line_width);
+      }
+      composite_mask(item.stroke_color);
+    }
+  }
+}
+
+
+void Raster::write_png(const std::string& filename) const
+{
+  const RasterLibs& libs = raster_libs();
+  FILE* f = std::fopen(filename.c_str(), "wb");
+  if (! f)
+    throw std::runtime_error("can't create `" + filename + "'");
+
+  png_structp png = libs.create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+  png_infop info = png ? libs.create_info_struct(png) : nullptr;
+  // png_jmpbuf(), through the loaded library
+  if ((! info) || setjmp(*libs.set_longjmp_fn(png, std::longjmp, sizeof(std::jmp_buf))))
+  {
+    libs.destroy_write_struct(& png, & info);
+    std::fclose(f);
+    throw std::runtime_error("can't write PNG `" + filename + "'");
+  }
+
+  libs.init_io(png, f);
+  libs.set_IHDR(png, info, w, h, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+	       PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  libs.write_info(png, info);
+  for (unsigned y = 0; y < h; y++)
+    libs.write_row(png, & rgb[y * w * 3]);
+  libs.write_end(png, nullptr);
+  libs.destroy_write_struct(& png, & info);
+
+  if (std::fclose(f) != 0)
+    throw std::runtime_error("can't write PNG `" + filename + "'");
+}
@@ -0,0 +1,113 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "display_list.h"
+
+// Rasterization of display lists, for previews.  Strokes and fills are
+// antialiased; text is drawn with FreeType if a font file is given.
+
+// Mapping from page coordinates (inches, origin at bottom left) to pixels
+// (origin at top left).
+struct RasterView
+{
+  double left_in;		// page x of the left edge of the raster
+  double top_in;		// page y of the top edge of the raster
+  double pixels_per_in;
+
+  Coord to_pixels(Coord p) const
+  {
+    return { (p.x - left_in) * pixels_per_in, (top_in - p.y) * pixels_per_in };
+  }
+};
+
+
+// Glyph bitmaps of one font, shared by all threads.  FreeType is only
+// initialized when the first glyph is needed.
+class GlyphCache
+{
+public:
+  explicit GlyphCache(const std::string& font_file);
+  ~GlyphCache();
+
+  struct Glyph
+  {
+    int left;			// offset of bitmap from pen position
+    int top;			// rows above the baseline
+    unsigned width;
+    unsigned rows;
+    double advance;		// pixels
+    std::vector<uint8_t> coverage;
+  };
+
+  const std::string& font_file() const { return file; }
+
+  // The returned glyph remains valid for the lifetime of the cache.
+  const Glyph& glyph(char c,
+		     double pixel_size);
+
+private:
+  std::string file;
+  std::mutex mutex;
+  struct FreeType;
+  std::unique_ptr<FreeType> ft;
+  std::map<std::pair<char, long>, std::unique_ptr<Glyph>> glyphs;
+};
+
+
+// An RGB image, initially white.
+class Raster
+{
+public:
+  Raster(unsigned width,
+	 unsigned height);
+
+  unsigned width() const { return w; }
+  unsigned height() const { return h; }
+  const std::vector<uint8_t>& pixels() const { return rgb; }
+
+  // Draws items of the list in order.  Text is skipped if glyphs is null.
+  void draw(const DisplayList& list,
+	    std::span<const DisplayItem> items,
+	    const RasterView& view,
+	    GlyphCache* glyphs = nullptr);
+
+  // Throws std::runtime_error on failure.
+  void write_png(const std::string& filename) const;
+
+private:
+  unsigned w;
+  unsigned h;
+  std::vector<uint8_t> rgb;
+
+  // coverage of the element being drawn, zero outside of it
+  std::vector<float> mask;
+  int mask_x0, mask_y0, mask_x1, mask_y1;
+
+  void begin_mask(Coord min,
+		  Coord max);
+  void composite_mask(Color color);
+
+  void stroke_polyline(std::span<const Coord> points,
+		       double width);
+  void fill_polygons(const std::vector<std::vector<Coord>>& polygons,
+		     FillRule fill_rule);
+  void draw_text(const DisplayText& text,
+		 Coord position,
+		 double pixels_per_in,
+		 GlyphCache& glyphs,
+		 Color color);
+};
+
+#endif // RASTER_H
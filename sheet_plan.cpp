@@ -0,0 +1,151 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+#include "sheet_plan.h"
+
+static int parse_date(const std::string& s)
+{
+  int year;
+  int month;
+  int day;
+  char extra;
+  if ((std::sscanf(s.c_str(), "%4d-%2d-%2d%c", & year, & month, & day, & extra) != 3) ||
+      (month < 1) || (month > 12) || (day < 1) || (day > 31))
+    return -1;
+  return year * 10000 + month * 100 + day;
+}
+
+// Another definition of a key already in the set is an error.
+static void read_legend(std::istringstream& ls,
+			unsigned line_number,
+			OrderQueue& queue)
+{
+  std::string set;
+  LegendDefinition legend;
+  std::string extra;
+  ls >> set >> legend.key_code;
+  for (std::string& text: legend.text)
+    ls >> std::quoted(text);
+  if ((! ls) || (ls >> extra))
+    throw std::runtime_error(std::format("bad legend at line {0}", line_number));
+
+  std::vector<LegendDefinition>& legends = queue.legend_sets[set];
+  for (const LegendDefinition& other: legends)
+    if (other.key_code == legend.key_code)
+      throw std::runtime_error(std::format("legend set `{0}' defines key {1} again at line {2}",
+					   set, legend.key_code, line_number));
+  legends.push_back(legend);
+}
+
+OrderQueue read_order_queue(std::istream& is)
+{
+  OrderQueue queue;
+  std::string line;
+  for (unsigned line_number = 1; std::getline(is, line); line_number++)
+  {
+    std::istringstream ls(line);
+    std::string first;
+    if ((! (ls >> first)) || (first[0] == '#'))
+      continue;
+    if (first == "legend")
+    {
+      read_legend(ls, line_number, queue);
+      continue;
+    }
+
+    Order order;
+    order.id = first;
+    std::string due;
+    std::string extra;
+    long quantity = 0;
+    ls >> order.model >> order.legend_set >> quantity >> due;
+    if ((! ls) || (ls >> extra) || (quantity < 1))
+      throw std::runtime_error(std::format("bad order at line {0}", line_number));
+    order.quantity = quantity;
+    order.due_date = parse_date(due);
+    if (order.due_date < 0)
+      throw std::runtime_error(std::format("bad due date `{0}' at line {1}", due, line_number));
+    queue.orders.push_back(order);
+  }
+  return queue;
+}
+
+
+std::vector<Sheet> plan_sheets(const std::vector<Order>& orders,
+			       const std::map<std::string, std::size_t>& slot_counts)
+{
+  for (const Order& order: orders)
+  {
+    auto it = slot_counts.find(order.model);
+    if ((it == slot_counts.end()) || (it->second == 0))
+      throw std::invalid_argument("no sheet layout for model `" + order.model + "' of order " + order.id);
+  }
+
+  // Stable, so that orders due the same day with the same legend set
+  // stay in queue order.
+  std::vector<std::size_t> queue(orders.size());
+  for (std::size_t i = 0; i < queue.size(); i++)
+    queue[i] = i;
+  std::stable_sort(queue.begin(), queue.end(), [&](std::size_t a, std::size_t b)
+  {
+    return (std::tie(orders[a].due_date, orders[a].legend_set) <
+	    std::tie(orders[b].due_date, orders[b].legend_set));
+  });
+
+  // Sheets of each model are filled one after another; only the current
+  // one of each model has free slots.
+  std::vector<Sheet> sheets;
+  std::map<std::string, std::size_t> current;
+  for (std::size_t i: queue)
+  {
+    const Order& order = orders[i];
+    std::size_t capacity = slot_counts.at(order.model);
+    for (unsigned copy = 0; copy < order.quantity; copy++)
+    {
+      auto it = current.find(order.model);
+      if ((it == current.end()) || (sheets[it->second].slots.size() == capacity))
+      {
+	sheets.push_back({ order.model, order.due_date, {} });
+	sheets.back().slots.reserve(capacity);
+	it = current.insert_or_assign(order.model, sheets.size() - 1).first;
+      }
+      sheets[it->second].slots.push_back({ i, copy });
+    }
+  }
+
+  // Sheets of different models are interleaved by due date.  The sheets
+  // of each model are already in order.
+  std::stable_sort(sheets.begin(), sheets.end(), [](const Sheet& a, const Sheet& b)
+  {
+    return a.due_date < b.due_date;
+  });
+  return sheets;
+}
+
+static std::string format_date(int date)
+{
+  return std::format("{0:04}-{1:02}-{2:02}", date / 10000, date / 100 % 100, date % 100);
+}
+
+void write_sheet_plan(std::ostream& os,
+		      const std::vector<Order>& orders,
+		      const std::vector<Sheet>& sheets)
+{
+  os << "sheet,slot,order,copy,model,legend_set,due_date\n";
+  for (std::size_t s = 0; s < sheets.size(); s++)
+    for (std::size_t i = 0; i < sheets[s].slots.size(); i++)
+    {
+      const SheetSlot& slot = sheets[s].slots[i];
+      const Order& order = orders[slot.order];
+      os << std::format("{0},{1},{2},{3},{4},{5},{6}\n", s + 1, i + 1, order.id, slot.copy + 1,
+			order.model, order.legend_set, format_date(order.due_date));
+    }
+}
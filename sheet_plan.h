@@ -0,0 +1,81 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef SHEET_PLAN_H
+#define SHEET_PLAN_H
+
+#include <cstddef>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Consolidation of a queue of orders onto as few sheets as possible.
+// Every slot of a sheet has the same geometry, so a sheet only holds
+// overlays of one model, but may hold any mix of orders and legend sets.
+
+struct Order
+{
+  std::string id;
+  std::string model;		// e.g. "voyager"
+  std::string legend_set;
+  unsigned quantity;
+  int due_date;			// yyyymmdd
+};
+
+// The legends of one key, in a legend set defined by a queue: the
+// f-shifted, primary and g-shifted legends, "" if none.
+struct LegendDefinition
+{
+  int key_code;
+  std::string text[3];
+};
+
+// A queue of orders, and the legend sets it defines, by name.
+struct OrderQueue
+{
+  std::vector<Order> orders;
+  std::map<std::string, std::vector<LegendDefinition>> legend_sets;
+};
+
+// Reads a queue of orders, one per line: id, model, legend set,
+// quantity and due date (YYYY-MM-DD), separated by white space.  A line
+//   legend SET KEY_CODE F_SHIFT PRIMARY G_SHIFT
+// instead defines the legends of one key of a legend set; legends with
+// white space are quoted, and "" is none; whether KEY_CODE is a key
+// depends on the models using the set.  Blank lines and lines
+// starting with # are ignored.  Throws std::runtime_error on malformed
+// input.
+OrderQueue read_order_queue(std::istream& is);
+
+struct SheetSlot
+{
+  std::size_t order;		// index into the orders
+  unsigned copy;		// of the quantity of the order, from 0
+};
+
+struct Sheet
+{
+  std::string model;
+  int due_date;			// earliest of its slots
+  std::vector<SheetSlot> slots;	// in slot order of the page layout
+};
+
+// Fills the sheets of each model in order of due date, so each model
+// needs the fewest sheets, only the last of which may be partial, and no
+// overlay is on a sheet later than one with an overlay due after it.
+// Orders due the same day are grouped by legend set.  The sheets are
+// returned in the order they should be produced.  slot_counts gives the
+// capacity of a sheet of each model; throws std::invalid_argument for an
+// order of a model not in it.
+std::vector<Sheet> plan_sheets(const std::vector<Order>& orders,
+			       const std::map<std::string, std::size_t>& slot_counts);
+
+// One line per slot: sheet, slot (both from 1), order, copy, model,
+// legend set and due date, comma separated.
+void write_sheet_plan(std::ostream& os,
+		      const std::vector<Order>& orders,
+		      const std::vector<Sheet>& sheets);
+
+#endif // SHEET_PLAN_H
@@ -0,0 +1,311 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shm_cache.h"
+
+struct ShmCache::Header
+{
+  uint64_t magic;
+  uint32_t format_version;
+  uint32_t bucket_count;
+  uint64_t data_size;
+  uint64_t data_tail;		// atomic, offset of next free byte of data area
+};
+
+// The bucket refers to the record at offset - 1 in the data area, so that
+// zero can mean unused.
+struct ShmCache::Bucket
+{
+  uint64_t offset;		// atomic, zero if bucket is unused
+};
+
+// Followed by the key bytes, and then the value bytes.
+struct ShmCache::Record
+{
+  uint64_t key_hash;
+  uint32_t version;
+  uint32_t key_length;
+  uint64_t value_length;
+};
+
+
+std::string ShmCache::default_path()
+{
+  const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir && (runtime_dir[0] == '/'))
+    return std::string(runtime_dir) + "/voyager-overlay-cache";
+  return "/dev/shm/voyager-overlay-cache-" + std::to_string(geteuid());
+}
+
+ShmCache::ShmCache(const std::string& path):
+  path(path),
+  map_size(sizeof(Header) + BUCKET_COUNT * sizeof(Bucket) + DATA_SIZE),
+  ro_base(nullptr),
+  rw_base(nullptr),
+  device(0),
+  inode(0),
+  replaced(false)
+{
+  // O_NOFOLLOW, so that a link planted by another user isn't followed
+  int fd = open(path.c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+  if ((fd < 0) && (errno == ENOENT) && create(false))
+    fd = open(path.c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  MapResult result = map_file(fd);
+  close(fd);
+  if (result != MapResult::INCOMPATIBLE)
+    return;
+
+  // a cache file of ours, e.g. from an older build, that this one can't
+  // use; replace it
+  if (! create(true))
+    return;
+  fd = open(path.c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  map_file(fd);
+  close(fd);
+}
+
+// Maps the file only if it is a trusted cache file of this format.  A
+// file without the magic number may not be a cache file at all, e.g. a
+// mistaken --cache-file, so only one with it is reported incompatible.
+ShmCache::MapResult ShmCache::map_file(int fd)
+{
+  struct stat st;
+  uint64_t magic;
+  if ((fstat(fd, & st) < 0) ||
+      (! S_ISREG(st.st_mode)) ||
+      (st.st_uid != geteuid()) ||
+      ((st.st_mode & 07777) != 0600) ||
+      (pread(fd, & magic, sizeof(magic), 0) != sizeof(magic)) ||
+      (magic != MAGIC))
+    return MapResult::UNUSABLE;
+  if (static_cast<size_t>(st.st_size) != map_size)
+    return MapResult::INCOMPATIBLE;
+
+  void* ro = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  void* rw = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if ((ro == MAP_FAILED) || (rw == MAP_FAILED))
+  {
+    if (ro != MAP_FAILED)
+      munmap(ro, map_size);
+    if (rw != MAP_FAILED)
+      munmap(rw, map_size);
+    return MapResult::UNUSABLE;
+  }
+
+  const Header* h = static_cast<const Header*>(ro);
+  if ((h->format_version != FORMAT_VERSION) ||
+      (h->bucket_count != BUCKET_COUNT) ||
+      (h->data_size != DATA_SIZE))
+  {
+    munmap(ro, map_size);
+    munmap(rw, map_size);
+    return MapResult::INCOMPATIBLE;
+  }
+  ro_base = static_cast<const char*>(ro);
+  rw_base = static_cast<char*>(rw);
+  device = st.st_dev;
+  inode = st.st_ino;
+  return MapResult::MAPPED;
+}
+
+ShmCache::~ShmCache()
+{
+  if (ro_base)
+    munmap(const_cast<char*>(ro_base), map_size);
+  if (rw_base)
+    munmap(rw_base, map_size);
+}
+
+// The file is fully initialized under a temporary name, then linked into
+// place, so no process can ever map a partially initialized cache.  If
+// another process wins the race, its file is used instead.  To replace
+// an existing file, the new one is instead renamed over it, which
+// processes that have the old one mapped don't notice.
+bool ShmCache::create(bool replace)
+{
+  std::string temp_path = path + "." + std::to_string(getpid());
+  int fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return false;
+
+  // the mode must be exactly 0600, whatever the umask
+  bool ok = (fchmod(fd, 0600) == 0) && (ftruncate(fd, map_size) == 0);
+  if (ok)
+  {
+    Header h = { .magic          = MAGIC,
+		 .format_version = FORMAT_VERSION,
+		 .bucket_count   = BUCKET_COUNT,
+		 .data_size      = DATA_SIZE,
+		 .data_tail      = 0 };
+    ok = pwrite(fd, & h, sizeof(h), 0) == sizeof(h);
+  }
+  close(fd);
+  if (ok && replace)
+    ok = rename(temp_path.c_str(), path.c_str()) == 0;
+  else if (ok && (link(temp_path.c_str(), path.c_str()) < 0) && (errno != EEXIST))
+    ok = false;
+  unlink(temp_path.c_str());
+  return ok;
+}
+
+// Only the first process to find the file full replaces it; the others
+// find another file at the path by then.
+void ShmCache::replace_full()
+{
+  if (replaced.exchange(true, std::memory_order_relaxed))
+    return;
+  struct stat st;
+  if ((lstat(path.c_str(), & st) == 0) && (st.st_dev == device) && (st.st_ino == inode))
+    create(true);
+}
+
+const ShmCache::Header* ShmCache::ro_header() const
+{
+  return reinterpret_cast<const Header*>(ro_base);
+}
+
+const ShmCache::Bucket* ShmCache::ro_buckets() const
+{
+  return reinterpret_cast<const Bucket*>(ro_base + sizeof(Header));
+}
+
+ShmCache::Header* ShmCache::rw_header() const
+{
+  return reinterpret_cast<Header*>(rw_base);
+}
+
+ShmCache::Bucket* ShmCache::rw_buckets() const
+{
+  return reinterpret_cast<Bucket*>(rw_base + sizeof(Header));
+}
+
+uint64_t ShmCache::hash(const void* data,
+			size_t size,
+			uint64_t h)
+{
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; i++)
+  {
+    h ^= p[i];
+    h *= 0x100000001b3;
+  }
+  return h;
+}
+
+// Searches the probe sequence of the key from probe, and returns the
+// record of the key, or nullptr with probe set to the first unused
+// bucket, or to BUCKET_COUNT if all are used.
+const ShmCache::Record* ShmCache::find(std::string_view key,
+				       uint64_t key_hash,
+				       uint32_t version,
+				       uint32_t& probe) const
+{
+  // The mapping is read-only, so the atomic loads must not be able to
+  // write; on all supported platforms an atomic load is a plain load.
+  Bucket* buckets = const_cast<Bucket*>(ro_buckets());
+  const char* data = ro_base + sizeof(Header) + BUCKET_COUNT * sizeof(Bucket);
+  for (; probe < BUCKET_COUNT; probe++)
+  {
+    Bucket& b = buckets[(key_hash + probe) % BUCKET_COUNT];
+    uint64_t offset = std::atomic_ref<uint64_t>(b.offset).load(std::memory_order_acquire);
+    if (offset == 0)
+      return nullptr;
+    offset--;
+    if (offset + sizeof(Record) > DATA_SIZE)
+      continue;			// corrupt
+    const Record* r = reinterpret_cast<const Record*>(data + offset);
+    uint64_t available = DATA_SIZE - offset - sizeof(Record);
+    if ((r->key_hash != key_hash) ||
+	(r->version != version) ||
+	(r->key_length != key.size()) ||
+	(r->key_length > available) ||
+	(r->value_length > available - r->key_length))
+      continue;
+    if (std::memcmp(r + 1, key.data(), key.size()) == 0)
+      return r;
+  }
+  return nullptr;
+}
+
+std::optional<std::string_view> ShmCache::lookup(std::string_view key,
+						 uint32_t version) const
+{
+  if (! ro_base)
+    return std::nullopt;
+
+  uint32_t probe = 0;
+  const Record* r = find(key, hash(key.data(), key.size()), version, probe);
+  if (! r)
+    return std::nullopt;
+  return std::string_view(reinterpret_cast<const char*>(r + 1) + r->key_length, r->value_length);
+}
+
+bool ShmCache::insert(std::string_view key,
+		      uint32_t version,
+		      std::string_view value)
+{
+  if ((! rw_base) || (key.size() > UINT32_MAX))
+    return false;
+
+  // If the key is already present there's no point in copying the value.
+  uint64_t key_hash = hash(key.data(), key.size());
+  uint32_t probe = 0;
+  if (find(key, key_hash, version, probe))
+    return true;
+  if (probe == BUCKET_COUNT)
+  {
+    replace_full();		// all buckets used
+    return false;
+  }
+
+  // reserve space in the data area, rounded up to keep records aligned,
+  // and fill in the complete record
+  uint64_t size = (sizeof(Record) + key.size() + value.size() + 7) & ~uint64_t(7);
+  if (size > DATA_SIZE)
+    return false;		// too big for any cache; not reserved
+  uint64_t offset = std::atomic_ref<uint64_t>(rw_header()->data_tail).fetch_add(size, std::memory_order_relaxed);
+  if (offset > DATA_SIZE - size)
+  {
+    replace_full();		// full; space past the end is wasted
+    return false;
+  }
+  char* data = rw_base + sizeof(Header) + BUCKET_COUNT * sizeof(Bucket);
+  Record r = { .key_hash     = key_hash,
+	       .version      = version,
+	       .key_length   = static_cast<uint32_t>(key.size()),
+	       .value_length = value.size() };
+  std::memcpy(data + offset, & r, sizeof(r));
+  std::memcpy(data + offset + sizeof(r), key.data(), key.size());
+  std::memcpy(data + offset + sizeof(r) + key.size(), value.data(), value.size());
+
+  // publish it in the first unused bucket of the probe sequence
+  Bucket* buckets = rw_buckets();
+  while (probe < BUCKET_COUNT)
+  {
+    Bucket& b = buckets[(key_hash + probe) % BUCKET_COUNT];
+    uint64_t expected = 0;
+    if (std::atomic_ref<uint64_t>(b.offset).compare_exchange_strong(expected, offset + 1, std::memory_order_acq_rel))
+      return true;
+    // Another process took the bucket; if it added the same entry, ours
+    // is not needed.
+    if (find(key, key_hash, version, probe))
+      return true;
+  }
+  replace_full();		// all buckets used
+  return false;
+}
@@ -0,0 +1,116 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef SHM_CACHE_H
+#define SHM_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <sys/types.h>
+
+// Cross-process cache of immutable generated data (overlay content
+// streams, metrics, layouts), kept in a memory-mapped file so that many
+// short-lived concurrent invocations can share results.
+//
+// The file holds an open-addressed hash table of buckets and an
+// append-only data area.  A writer reserves space in the data area with
+// an atomic add, and copies in a complete record: the hash of the key,
+// the version, the key bytes and the value.  It then publishes the
+// record with a compare-and-swap of a free bucket from zero to the
+// record's offset.  Readers only ever load, and compare the key bytes of
+// every record on the probe sequence, so keys whose hashes collide are
+// still distinct.  A bucket is never claimed before its record is
+// complete, so a writer that dies at any point leaves at most some
+// unreferenced space behind, never a bucket that blocks its key.  Two
+// writers racing to add the same entry may both publish it; readers
+// find the first, and the second is merely wasted space.  Entries are
+// never modified or removed.
+//
+// Every entry carries a version supplied by the caller, which must
+// change whenever the generator output for the same inputs changes, so
+// entries produced by an older build are never returned.  If the cache
+// file format itself changes, FORMAT_VERSION is bumped, and a file of
+// the old format is replaced by an empty one.
+//
+// Space is never reclaimed within a file, so once its buckets or data
+// area are full, which also disposes of the entries of older versions,
+// the file is replaced by an empty one, in the same way as it is
+// created.  A process that has the full file mapped keeps it, so that
+// the views it has returned stay valid, but adds nothing more to it;
+// processes opening the cache from then on use the new file.
+//
+// Other processes can't be trusted to write only valid entries, so the
+// cache file is private to the user: it is only used if it is a regular
+// file, not a symbolic link, owned by the effective user and with mode
+// 0600.  Otherwise the cache is not opened, and every lookup misses.
+
+class ShmCache
+{
+public:
+  // In $XDG_RUNTIME_DIR, which is private to the user, if set, otherwise
+  // in /dev/shm, named with the effective user id.
+  static std::string default_path();
+
+  ShmCache(const std::string& path = default_path());
+  ~ShmCache();
+
+  ShmCache(const ShmCache&) = delete;
+  ShmCache& operator=(const ShmCache&) = delete;
+
+  bool is_open() const { return ro_base != nullptr; }
+
+  // The returned view points into the read-only mapping, and remains
+  // valid for the lifetime of the ShmCache object.
+  std::optional<std::string_view> lookup(std::string_view key,
+					 uint32_t version) const;
+
+  // Returns false if the entry could not be added, e.g. because the cache
+  // is full, in which case the file is replaced for later processes.
+  // Adding a key that is already present is not an error.
+  bool insert(std::string_view key,
+	      uint32_t version,
+	      std::string_view value);
+
+  // 64-bit FNV-1a, stable across processes and builds.
+  static uint64_t hash(const void* data,
+		       size_t size,
+		       uint64_t h = 0xcbf29ce484222325);
+
+private:
+  static constexpr uint64_t MAGIC          = 0x6568636143796f56;  // "VoyCache"
+  static constexpr uint32_t FORMAT_VERSION = 2;
+  static constexpr uint32_t BUCKET_COUNT   = 16384;
+  static constexpr uint64_t DATA_SIZE      = 32 << 20;
+
+  struct Header;
+  struct Bucket;
+  struct Record;
+
+  enum class MapResult { MAPPED, INCOMPATIBLE, UNUSABLE };
+
+  std::string path;
+  size_t map_size;
+  const char* ro_base;		// read-only mapping, used for lookups
+  char* rw_base;		// writable mapping, used only for inserts
+  dev_t device;			// of the mapped file
+  ino_t inode;
+  std::atomic<bool> replaced;	// the file was found full
+
+  bool create(bool replace);
+  MapResult map_file(int fd);
+  void replace_full();
+  const Header* ro_header() const;
+  const Bucket* ro_buckets() const;
+  Header* rw_header() const;
+  Bucket* rw_buckets() const;
+  const Record* find(std::string_view key,
+		     uint64_t key_hash,
+		     uint32_t version,
+		     uint32_t& probe) const;
+};
+
+#endif // SHM_CACHE_H
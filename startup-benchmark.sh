@@ -0,0 +1,43 @@
+#!/bin/sh
+# Copyright 2023 Eric Smith
+# SPDX-License-Identifier: GPL-3.0-only
+
+# Measure cold-start latency of voyager-overlay for a single overlay
+# (--hp --cut), where process startup dominates the real work.
+#
+# For each binary given (default: the dynamically and statically linked
+# builds, if present), reports the mean over N runs of the time to first
+# byte of output and the full run time, in milliseconds.
+#
+# usage: startup-benchmark.sh [-n N] [binary ...]
+
+runs=100
+if [ "$1" = "-n" ]; then
+  runs=$2
+  shift 2
+fi
+if [ $# -eq 0 ]; then
+  for b in ./voyager-overlay ./voyager-overlay-static; do
+    [ -x "$b" ] && set -- "$@" "$b"
+  done
+fi
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+for binary in "$@"; do
+  binary=$(realpath "$binary")
+  first_total=0
+  full_total=0
+  i=0
+  while [ $i -lt $runs ]; do
+    t0=$(date +%s%N)
+    first=$(cd "$dir" && VOYAGER_OVERLAY_BENCH_T0=$t0 "$binary" --hp --cut 2>&1 >/dev/null |
+            sed -n 's/^first_byte_ns //p')
+    t1=$(date +%s%N)
+    first_total=$((first_total + first))
+    full_total=$((full_total + t1 - t0))
+    i=$((i + 1))
+  done
+  echo "$binary: first byte $((first_total / runs / 1000))us, full run $((full_total / runs / 1000))us (mean of $runs)"
+done
@@ -0,0 +1,1017 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <numbers>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include "svg_import.h"
+
+// Affine transform, as in SVG: x' = a x + c y + e, y' = b x + d y + f
+struct Affine
+{
+  double a, b, c, d, e, f;
+
+  Coord apply(Coord p) const
+  {
+    return { a * p.x + c * p.y + e, b * p.x + d * p.y + f };
+  }
+};
+
+static constexpr Affine IDENTITY = { 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+
+// m * n, i.e. n applied first
+static Affine multiply(const Affine& m,
+		       const Affine& n)
+{
+  return { m.a * n.a + m.c * n.b,
+	   m.b * n.a + m.d * n.b,
+	   m.a * n.c + m.c * n.d,
+	   m.b * n.c + m.d * n.d,
+	   m.a * n.e + m.c * n.f + m.e,
+	   m.b * n.e + m.d * n.f + m.f };
+}
+
+
+// Numbers, flags and command letters of path data and attributes.
+class Scanner
+{
+public:
+  explicit Scanner(std::string_view s):
+    s(s),
+    pos(0)
+  {
+  }
+
+  bool at_end()
+  {
+    skip_separators();
+    return pos >= s.size();
+  }
+
+  bool at_number()
+  {
+    skip_separators();
+    if (pos >= s.size())
+      return false;
+    char c = s[pos];
+    return std::isdigit(static_cast<unsigned char>(c)) || (c == '-') || (c == '+') || (c == '.');
+  }
+
+  char take()
+  {
+    skip_separators();
+    return s[pos++];
+  }
+
+  // the next character is consumed only if it is c
+  bool accept(char c)
+  {
+    skip_separators();
+    if ((pos < s.size()) && (s[pos] == c))
+    {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  bool accept_word(std::string_view word)
+  {
+    skip_separators();
+    if (s.substr(pos, word.size()) != word)
+      return false;
+    pos += word.size();
+    return true;
+  }
+
+  double number()
+  {
+    skip_separators();
+    std::size_t start = pos;
+    if ((pos < s.size()) && ((s[pos] == '-') || (s[pos] == '+')))
+      pos++;
+    std::size_t digits = skip_digits();
+    if ((pos < s.size()) && (s[pos] == '.'))
+    {
+      pos++;
+      digits += skip_digits();
+    }
+    if (! digits)
+      throw std::runtime_error(std::string("SVG: number expected at `") + std::string(s.substr(start, 20)) + "'");
+    if ((pos < s.size()) && ((s[pos] == 'e') || (s[pos] == 'E')))
+    {
+      std::size_t mark = pos++;
+      if ((pos < s.size()) && ((s[pos] == '-') || (s[pos] == '+')))
+	pos++;
+      if (! skip_digits())
+	pos = mark;		// not an exponent, e.g. the "em" of a unit
+    }
+    if (s[start] == '+')
+      start++;
+    double value;
+    if (std::from_chars(s.data() + start, s.data() + pos, value).ec != std::errc())
+      throw std::runtime_error(std::string("SVG: number expected at `") + std::string(s.substr(start, 20)) + "'");
+    return value;
+  }
+
+  // arc flags may be written without separators, e.g. "a1 1 0 01.5 .5"
+  bool flag()
+  {
+    skip_separators();
+    if ((pos < s.size()) && ((s[pos] == '0') || (s[pos] == '1')))
+      return s[pos++] == '1';
+    throw std::runtime_error("SVG: arc flag expected");
+  }
+
+private:
+  std::string_view s;
+  std::size_t pos;
+
+  void skip_separators()
+  {
+    while ((pos < s.size()) && (std::isspace(static_cast<unsigned char>(s[pos])) || (s[pos] == ',')))
+      pos++;
+  }
+
+  std::size_t skip_digits()
+  {
+    std::size_t start = pos;
+    while ((pos < s.size()) && std::isdigit(static_cast<unsigned char>(s[pos])))
+      pos++;
+    return pos - start;
+  }
+};
+
+
+// Collects subpaths in local coordinates, transforming them as they are
+// added.  Curves stay exact under an affine transform.
+class PathBuilder
+{
+public:
+  PathBuilder(std::vector<SvgSubpath>& paths,
+	      const Affine& transform,
+	      FillRule fill_rule = FillRule::NONZERO_WINDING):
+    paths(paths),
+    transform(transform),
+    fill_rule(fill_rule),
+    start({ 0.0, 0.0 }),
+    current({ 0.0, 0.0 }),
+    open(false)
+  {
+  }
+
+  void move_to(Coord p)
+  {
+    paths.push_back({ transform.apply(p), {}, false, fill_rule });
+    start = current = p;
+    open = true;
+  }
+
+  void line_to(Coord p)
+  {
+    reopen();
+    paths.back().segments.push_back({ false, {}, {}, transform.apply(p) });
+    current = p;
+  }
+
+  void curve_to(Coord c1,
+		Coord c2,
+		Coord p)
+  {
+    reopen();
+    paths.back().segments.push_back({ true, transform.apply(c1), transform.apply(c2), transform.apply(p) });
+    current = p;
+  }
+
+  // Elliptical arc from the current point, as specified in SVG 1.1
+  // appendix F.6, split into cubic curves of at most 90 degrees.
+  void arc_to(double rx,
+	      double ry,
+	      double rotation_deg,
+	      bool large_arc,
+	      bool sweep,
+	      Coord p)
+  {
+    Coord p0 = current;
+    if ((p0.x == p.x) && (p0.y == p.y))
+      return;
+    rx = std::abs(rx);
+    ry = std::abs(ry);
+    if ((rx == 0.0) || (ry == 0.0))
+    {
+      line_to(p);
+      return;
+    }
+
+    double phi = rotation_deg * std::numbers::pi / 180.0;
+    double cos_phi = std::cos(phi);
+    double sin_phi = std::sin(phi);
+    double dx = (p0.x - p.x) / 2.0;
+    double dy = (p0.y - p.y) / 2.0;
+    double x1 =  cos_phi * dx + sin_phi * dy;
+    double y1 = -sin_phi * dx + cos_phi * dy;
+
+    double lambda = (x1 * x1) / (rx * rx) + (y1 * y1) / (ry * ry);
+    if (lambda > 1.0)
+    {
+      rx *= std::sqrt(lambda);
+      ry *= std::sqrt(lambda);
+    }
+
+    double num = rx * rx * ry * ry - rx * rx * y1 * y1 - ry * ry * x1 * x1;
+    double den = rx * rx * y1 * y1 + ry * ry * x1 * x1;
+    double coef = std::sqrt(std::max(0.0, num / den));
+    if (large_arc == sweep)
+      coef = -coef;
+    double cx1 =  coef * rx * y1 / ry;
+    double cy1 = -coef * ry * x1 / rx;
+    double cx = cos_phi * cx1 - sin_phi * cy1 + (p0.x + p.x) / 2.0;
+    double cy = sin_phi * cx1 + cos_phi * cy1 + (p0.y + p.y) / 2.0;
+
+    auto angle = [](double ux, double uy, double vx, double vy)
+    {
+      return std::atan2(ux * vy - uy * vx, ux * vx + uy * vy);
+    };
+    double theta = angle(1.0, 0.0, (x1 - cx1) / rx, (y1 - cy1) / ry);
+    double delta = angle((x1 - cx1) / rx, (y1 - cy1) / ry, (-x1 - cx1) / rx, (-y1 - cy1) / ry);
+    if ((! sweep) && (delta > 0.0))
+      delta -= 2.0 * std::numbers::pi;
+    else if (sweep && (delta < 0.0))
+      delta += 2.0 * std::numbers::pi;
+
+    auto point = [&](double ux, double uy) -> Coord
+    {
+      return { cx + rx * cos_phi * ux - ry * sin_phi * uy,
+	       cy + rx * sin_phi * ux + ry * cos_phi * uy };
+    };
+
+    int n = std::max(1, int(std::ceil(std::abs(delta) / (std::numbers::pi / 2.0) - 1e-9)));
+    double step = delta / n;
+    double k = 4.0 / 3.0 * std::tan(step / 4.0);
+    for (int i = 0; i < n; i++)
+    {
+      double t0 = theta + i * step;
+      double t1 = t0 + step;
+      Coord c1 = point(std::cos(t0) - k * std::sin(t0), std::sin(t0) + k * std::cos(t0));
+      Coord c2 = point(std::cos(t1) + k * std::sin(t1), std::sin(t1) - k * std::cos(t1));
+      curve_to(c1, c2, (i == n - 1) ? p : point(std::cos(t1), std::sin(t1)));
+    }
+  }
+
+  void close()
+  {
+    if (! open)
+      return;
+    paths.back().closed = true;
+    current = start;
+    open = false;
+  }
+
+  Coord current_point() const { return current; }
+
+private:
+  std::vector<SvgSubpath>& paths;
+  Affine transform;
+  FillRule fill_rule;
+  Coord start;
+  Coord current;
+  bool open;
+
+  // drawing after a close starts a new subpath at the close point
+  void reopen()
+  {
+    if (open)
+      return;
+    if (paths.empty())
+      throw std::runtime_error("SVG: path data must start with a move");
+    move_to(current);
+  }
+};
+
+
+static void parse_path_data(std::string_view d,
+			    PathBuilder& b)
+{
+  Scanner sc(d);
+  char command = 0;
+  char previous = 0;
+  Coord last_control = { 0.0, 0.0 };	// for S and T
+
+  while (! sc.at_end())
+  {
+    if (sc.at_number())
+    {
+      // repeated parameters; a move is followed by implicit lines
+      if ((command == 0) || (command == 'Z') || (command == 'z'))
+	throw std::runtime_error("SVG: path data command expected");
+      if (command == 'M')
+	command = 'L';
+      else if (command == 'm')
+	command = 'l';
+    }
+    else
+      command = sc.take();
+
+    Coord current = b.current_point();
+    bool relative = std::islower(static_cast<unsigned char>(command));
+    auto coord = [&]() -> Coord
+    {
+      double x = sc.number();
+      double y = sc.number();
+      return relative ? Coord { current.x + x, current.y + y } : Coord { x, y };
+    };
+    auto reflect = [&](const char* after) -> Coord
+    {
+      if (previous && std::strchr(after, std::toupper(previous)))
+	return { 2.0 * current.x - last_control.x, 2.0 * current.y - last_control.y };
+      return current;
+    };
+
+    switch (std::toupper(static_cast<unsigned char>(command)))
+    {
+    case 'M':
+      b.move_to(coord());
+      break;
+    case 'L':
+      b.line_to(coord());
+      break;
+    case 'H':
+      {
+	double x = sc.number();
+	b.line_to({ relative ? current.x + x : x, current.y });
+      }
+      break;
+    case 'V':
+      {
+	double y = sc.number();
+	b.line_to({ current.x, relative ? current.y + y : y });
+      }
+      break;
+    case 'C':
+      {
+	Coord c1 = coord();
+	Coord c2 = coord();
+	Coord p = coord();
+	b.curve_to(c1, c2, p);
+	last_control = c2;
+      }
+      break;
+    case 'S':
+      {
+	Coord c1 = reflect("CS");
+	Coord c2 = coord();
+	Coord p = coord();
+	b.curve_to(c1, c2, p);
+	last_control = c2;
+      }
+      break;
+    case 'Q':
+    case 'T':
+      {
+	Coord q = (std::toupper(command) == 'Q') ? coord() : reflect("QT");
+	Coord p = coord();
+	// degree elevation to a cubic
+	b.curve_to({ current.x + 2.0 / 3.0 * (q.x - current.x), current.y + 2.0 / 3.0 * (q.y - current.y) },
+		   { p.x + 2.0 / 3.0 * (q.x - p.x), p.y + 2.0 / 3.0 * (q.y - p.y) },
+		   p);
+	last_control = q;
+      }
+      break;
+    case 'A':
+      {
+	double rx = sc.number();
+	double ry = sc.number();
+	double rotation = sc.number();
+	bool large_arc = sc.flag();
+	bool sweep = sc.flag();
+	b.arc_to(rx, ry, rotation, large_arc, sweep, coord());
+      }
+      break;
+    case 'Z':
+      b.close();
+      break;
+    default:
+      throw std::runtime_error(std::string("SVG: unknown path data command `") + command + "'");
+    }
+    previous = command;
+  }
+}
+
+std::vector<SvgSubpath> parse_svg_path_data(std::string_view d)
+{
+  std::vector<SvgSubpath> paths;
+  PathBuilder b(paths, IDENTITY);
+  parse_path_data(d, b);
+  return paths;
+}
+
+
+// transform attribute: a list of transform functions, applied right to left
+static Affine parse_transform(std::string_view s)
+{
+  Affine m = IDENTITY;
+  Scanner sc(s);
+  while (! sc.at_end())
+  {
+    Affine t = IDENTITY;
+    if (sc.accept_word("matrix"))
+    {
+      sc.accept('(');
+      t.a = sc.number(); t.b = sc.number(); t.c = sc.number();
+      t.d = sc.number(); t.e = sc.number(); t.f = sc.number();
+    }
+    else if (sc.accept_word("translate"))
+    {
+      sc.accept('(');
+      t.e = sc.number();
+      t.f = sc.at_number() ? sc.number() : 0.0;
+    }
+    else if (sc.accept_word("scale"))
+    {
+      sc.accept('(');
+      t.a = sc.number();
+      t.d = sc.at_number() ? sc.number() : t.a;
+    }
+    else if (sc.accept_word("rotate"))
+    {
+      sc.accept('(');
+      double angle = sc.number() * std::numbers::pi / 180.0;
+      Affine r = { std::cos(angle), std::sin(angle), -std::sin(angle), std::cos(angle), 0.0, 0.0 };
+      if (sc.at_number())
+      {
+	double cx = sc.number();
+	double cy = sc.number();
+	r = multiply(multiply({ 1.0, 0.0, 0.0, 1.0, cx, cy }, r), { 1.0, 0.0, 0.0, 1.0, -cx, -cy });
+      }
+      t = r;
+    }
+    else if (sc.accept_word("skewX"))
+    {
+      sc.accept('(');
+      t.c = std::tan(sc.number() * std::numbers::pi / 180.0);
+    }
+    else if (sc.accept_word("skewY"))
+    {
+      sc.accept('(');
+      t.b = std::tan(sc.number() * std::numbers::pi / 180.0);
+    }
+    else
+      throw std::runtime_error("SVG: bad transform `" + std::string(s) + "'");
+    if (! sc.accept(')'))
+      throw std::runtime_error("SVG: bad transform `" + std::string(s) + "'");
+    m = multiply(m, t);
+  }
+  return m;
+}
+
+
+struct XmlAttribute
+{
+  std::string_view name;
+  std::string_view value;
+};
+
+static std::optional<std::string_view> find_attribute(const std::vector<XmlAttribute>& attributes,
+						      std::string_view name)
+{
+  for (const XmlAttribute& a: attributes)
+    if (a.name == name)
+      return a.value;
+  return std::nullopt;
+}
+
+// Lengths are taken as user units; any unit suffix is ignored.
+static double length_attribute(const std::vector<XmlAttribute>& attributes,
+			       std::string_view name,
+			       double default_value = 0.0)
+{
+  auto value = find_attribute(attributes, name);
+  if (! value)
+    return default_value;
+  Scanner sc(*value);
+  return sc.number();
+}
+
+static std::string_view trim(std::string_view s)
+{
+  while (! s.empty() && std::isspace(static_cast<unsigned char>(s.front())))
+    s.remove_prefix(1);
+  while (! s.empty() && std::isspace(static_cast<unsigned char>(s.back())))
+    s.remove_suffix(1);
+  return s;
+}
+
+// The fill-rule property, from its presentation attribute or the style
+// attribute, which takes precedence; inherited if not specified.
+static FillRule fill_rule_property(const std::vector<XmlAttribute>& attributes,
+				   FillRule inherited)
+{
+  std::optional<std::string_view> value = find_attribute(attributes, "fill-rule");
+  if (auto style = find_attribute(attributes, "style"))
+  {
+    // declarations separated by semicolons
+    std::string_view rest = *style;
+    while (! rest.empty())
+    {
+      std::size_t end = rest.find(';');
+      std::string_view declaration = rest.substr(0, end);
+      rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 1);
+      std::size_t colon = declaration.find(':');
+      if (colon == std::string_view::npos)
+	continue;
+      if (trim(declaration.substr(0, colon)) == "fill-rule")
+	value = trim(declaration.substr(colon + 1));
+    }
+  }
+  if (! value)
+    return inherited;
+  std::string_view rule = trim(*value);
+  if (rule == "nonzero")
+    return FillRule::NONZERO_WINDING;
+  if (rule == "evenodd")
+    return FillRule::EVEN_ODD;
+  if (rule == "inherit")
+    return inherited;
+  throw std::runtime_error("SVG: unknown fill-rule `" + std::string(rule) + "'");
+}
+
+static void points_attribute(const std::vector<XmlAttribute>& attributes,
+			     PathBuilder& b,
+			     bool close)
+{
+  auto value = find_attribute(attributes, "points");
+  if (! value)
+    return;
+  Scanner sc(*value);
+  bool first = true;
+  while (sc.at_number())
+  {
+    Coord p;
+    p.x = sc.number();
+    p.y = sc.number();
+    if (first)
+      b.move_to(p);
+    else
+      b.line_to(p);
+    first = false;
+  }
+  if (close && ! first)
+    b.close();
+}
+
+static void import_shape(std::string_view name,
+			 const std::vector<XmlAttribute>& attributes,
+			 PathBuilder& b)
+{
+  if (name == "path")
+  {
+    if (auto d = find_attribute(attributes, "d"))
+      parse_path_data(*d, b);
+  }
+  else if (name == "rect")
+  {
+    double x = length_attribute(attributes, "x");
+    double y = length_attribute(attributes, "y");
+    double w = length_attribute(attributes, "width");
+    double h = length_attribute(attributes, "height");
+    if ((w <= 0.0) || (h <= 0.0))
+      return;
+    double rx = length_attribute(attributes, "rx", -1.0);
+    double ry = length_attribute(attributes, "ry", -1.0);
+    if (rx < 0.0)
+      rx = std::max(ry, 0.0);
+    if (ry < 0.0)
+      ry = rx;
+    rx = std::min(rx, w / 2.0);
+    ry = std::min(ry, h / 2.0);
+    b.move_to({ x + rx, y });
+    b.line_to({ x + w - rx, y });
+    b.arc_to(rx, ry, 0.0, false, true, { x + w, y + ry });
+    b.line_to({ x + w, y + h - ry });
+    b.arc_to(rx, ry, 0.0, false, true, { x + w - rx, y + h });
+    b.line_to({ x + rx, y + h });
+    b.arc_to(rx, ry, 0.0, false, true, { x, y + h - ry });
+    b.line_to({ x, y + ry });
+    b.arc_to(rx, ry, 0.0, false, true, { x + rx, y });
+    b.close();
+  }
+  else if ((name == "circle") || (name == "ellipse"))
+  {
+    double cx = length_attribute(attributes, "cx");
+    double cy = length_attribute(attributes, "cy");
+    double rx = length_attribute(attributes, (name == "circle") ? "r" : "rx");
+    double ry = length_attribute(attributes, (name == "circle") ? "r" : "ry");
+    if ((rx <= 0.0) || (ry <= 0.0))
+      return;
+    b.move_to({ cx + rx, cy });
+    b.arc_to(rx, ry, 0.0, false, true, { cx, cy + ry });
+    b.arc_to(rx, ry, 0.0, false, true, { cx - rx, cy });
+    b.arc_to(rx, ry, 0.0, false, true, { cx, cy - ry });
+    b.arc_to(rx, ry, 0.0, false, true, { cx + rx, cy });
+    b.close();
+  }
+  else if (name == "line")
+  {
+    b.move_to({ length_attribute(attributes, "x1"), length_attribute(attributes, "y1") });
+    b.line_to({ length_attribute(attributes, "x2"), length_attribute(attributes, "y2") });
+  }
+  else if (name == "polyline")
+    points_attribute(attributes, b, false);
+  else if (name == "polygon")
+    points_attribute(attributes, b, true);
+}
+
+// elements whose content is never drawn directly
+static bool ignored_element(std::string_view name)
+{
+  for (std::string_view ignored: { "defs", "clipPath", "mask", "symbol", "pattern", "marker",
+				   "metadata", "title", "desc", "style", "script", "text",
+				   "linearGradient", "radialGradient", "filter" })
+    if (name == ignored)
+      return true;
+  return false;
+}
+
+// A minimal XML reader, sufficient for the SVG written by drawing and
+// tracing programs: comments, processing instructions, declarations and
+// CDATA are skipped, and entities aren't expanded, as no geometry needs
+// them.
+std::vector<SvgSubpath> import_svg(std::string_view svg)
+{
+  struct OpenElement
+  {
+    std::string_view name;
+    Affine transform;
+    FillRule fill_rule;
+    bool ignored;
+  };
+
+  std::vector<SvgSubpath> paths;
+  std::vector<OpenElement> open;
+  std::vector<XmlAttribute> attributes;
+
+  auto skip_to = [&](std::size_t pos, std::string_view end) -> std::size_t
+  {
+    std::size_t found = svg.find(end, pos);
+    if (found == std::string_view::npos)
+      throw std::runtime_error("SVG: unterminated markup");
+    return found + end.size();
+  };
+  auto is_name_char = [](char c)
+  {
+    return std::isalnum(static_cast<unsigned char>(c)) || (c == '-') || (c == '_') || (c == ':') || (c == '.');
+  };
+
+  std::size_t pos = 0;
+  while ((pos = svg.find('<', pos)) != std::string_view::npos)
+  {
+    std::string_view rest = svg.substr(pos);
+    if (rest.starts_with("<!--"))
+    {
+      pos = skip_to(pos, "-->");
+      continue;
+    }
+    if (rest.starts_with("<![CDATA["))
+    {
+      pos = skip_to(pos, "]]>");
+      continue;
+    }
+    if (rest.starts_with("<?"))
+    {
+      pos = skip_to(pos, "?>");
+      continue;
+    }
+    if (rest.starts_with("<!"))
+    {
+      pos = skip_to(pos, ">");
+      continue;
+    }
+    if (rest.starts_with("</"))
+    {
+      std::size_t end = skip_to(pos, ">");
+      std::string_view name = svg.substr(pos + 2, end - 1 - (pos + 2));
+      while (! name.empty() && std::isspace(static_cast<unsigned char>(name.back())))
+	name.remove_suffix(1);
+      // tolerate mismatched tags by closing up to the matching one
+      while (! open.empty())
+      {
+	bool match = open.back().name == name;
+	open.pop_back();
+	if (match)
+	  break;
+      }
+      pos = end;
+      continue;
+    }
+
+    // start tag
+    pos++;
+    std::size_t name_start = pos;
+    while ((pos < svg.size()) && is_name_char(svg[pos]))
+      pos++;
+    std::string_view name = svg.substr(name_start, pos - name_start);
+    attributes.clear();
+    bool self_closing = false;
+    while (true)
+    {
+      while ((pos < svg.size()) && std::isspace(static_cast<unsigned char>(svg[pos])))
+	pos++;
+      if (pos >= svg.size())
+	throw std::runtime_error("SVG: unterminated tag");
+      if (svg[pos] == '>')
+      {
+	pos++;
+	break;
+      }
+      if (svg.substr(pos, 2) == "/>")
+      {
+	pos += 2;
+	self_closing = true;
+	break;
+      }
+      std::size_t attr_start = pos;
+      while ((pos < svg.size()) && is_name_char(svg[pos]))
+	pos++;
+      std::string_view attr_name = svg.substr(attr_start, pos - attr_start);
+      while ((pos < svg.size()) && std::isspace(static_cast<unsigned char>(svg[pos])))
+	pos++;
+      if (attr_name.empty() || (pos >= svg.size()) || (svg[pos] != '='))
+	throw std::runtime_error("SVG: bad attribute in <" + std::string(name) + ">");
+      pos++;
+      while ((pos < svg.size()) && std::isspace(static_cast<unsigned char>(svg[pos])))
+	pos++;
+      if ((pos >= svg.size()) || ((svg[pos] != '"') && (svg[pos] != '\'')))
+	throw std::runtime_error("SVG: unquoted attribute in <" + std::string(name) + ">");
+      char quote = svg[pos++];
+      std::size_t value_end = svg.find(quote, pos);
+      if (value_end == std::string_view::npos)
+	throw std::runtime_error("SVG: unterminated attribute in <" + std::string(name) + ">");
+      attributes.push_back({ attr_name, svg.substr(pos, value_end - pos) });
+      pos = value_end + 1;
+    }
+
+    OpenElement element = { name, IDENTITY, FillRule::NONZERO_WINDING, false };
+    if (! open.empty())
+      element = { name, open.back().transform, open.back().fill_rule, open.back().ignored };
+    element.ignored = element.ignored || ignored_element(name);
+    if (auto transform = find_attribute(attributes, "transform"))
+      element.transform = multiply(element.transform, parse_transform(*transform));
+    element.fill_rule = fill_rule_property(attributes, element.fill_rule);
+
+    if (! element.ignored)
+    {
+      PathBuilder b(paths, element.transform, element.fill_rule);
+      import_shape(name, attributes, b);
+    }
+    if (! self_closing)
+      open.push_back(element);
+  }
+  return paths;
+}
+
+std::vector<SvgSubpath> import_svg_file(const std::string& filename)
+{
+  std::ifstream f(filename);
+  if (! f)
+    throw std::runtime_error("can't open `" + filename + "'");
+  std::ostringstream s;
+  s << f.rdbuf();
+  return import_svg(s.str());
+}
+
+
+void fit_svg_paths(std::vector<SvgSubpath>& paths,
+		   Coord origin,
+		   Dimensions box)
+{
+  if (paths.empty())
+    return;
+
+  // control points bound the curves, so the fit may be slightly loose
+  Coord min = paths.front().start;
+  Coord max = min;
+  auto extend = [&](Coord p)
+  {
+    min = { std::min(min.x, p.x), std::min(min.y, p.y) };
+    max = { std::max(max.x, p.x), std::max(max.y, p.y) };
+  };
+  for (const SvgSubpath& path: paths)
+  {
+    extend(path.start);
+    for (const SvgSegment& segment: path.segments)
+    {
+      if (segment.curve)
+      {
+	extend(segment.control_1);
+	extend(segment.control_2);
+      }
+      extend(segment.end);
+    }
+  }
+
+  double width = max.x - min.x;
+  double height = max.y - min.y;
+  double scale = std::numeric_limits<double>::infinity();
+  if (width > 0.0)
+    scale = box.width / width;
+  if (height > 0.0)
+    scale = std::min(scale, box.height / height);
+  if (std::isinf(scale))
+    scale = 1.0;		// a single point
+  Coord offset = { origin.x + (box.width - width * scale) / 2.0,
+		   origin.y + (box.height - height * scale) / 2.0 };
+
+  auto map = [&](Coord& p)
+  {
+    p = { offset.x + (p.x - min.x) * scale, offset.y + (max.y - p.y) * scale };
+  };
+  for (SvgSubpath& path: paths)
+  {
+    map(path.start);
+    for (SvgSegment& segment: path.segments)
+    {
+      map(segment.control_1);
+      map(segment.control_2);
+      map(segment.end);
+    }
+  }
+}
+
+std::size_t svg_node_count(const std::vector<SvgSubpath>& paths)
+{
+  std::size_t count = 0;
+  for (const SvgSubpath& path: paths)
+    count += 1 + path.segments.size();
+  return count;
+}
+
+
+static double segment_distance(Coord p,
+			       Coord a,
+			       Coord b)
+{
+  Coord d = { b.x - a.x, b.y - a.y };
+  double length_squared = d.x * d.x + d.y * d.y;
+  double t = 0.0;
+  if (length_squared > 0.0)
+    t = std::clamp(((p.x - a.x) * d.x + (p.y - a.y) * d.y) / length_squared, 0.0, 1.0);
+  return std::hypot(p.x - a.x - t * d.x, p.y - a.y - t * d.y);
+}
+
+// Limits the work of checking the dropped points of a merged run, which
+// is quadratic in their number.  Longer runs are left to Douglas-Peucker.
+static constexpr std::size_t MAXIMUM_MERGE_RUN = 64;
+
+// Drops points where the polyline continues nearly straight: a point is
+// dropped if it and all points dropped since the last kept point are
+// within tolerance of the segment joining the last kept point and the
+// next point.
+static void merge_collinear(std::vector<Coord>& points,
+			    double tolerance)
+{
+  if (points.size() < 3)
+    return;
+  std::vector<Coord> kept { points.front() };
+  std::vector<Coord> dropped;
+  for (std::size_t i = 1; i + 1 < points.size(); i++)
+  {
+    Coord next = points[i + 1];
+    dropped.push_back(points[i]);
+    bool straight = dropped.size() <= MAXIMUM_MERGE_RUN;
+    for (std::size_t j = 0; straight && (j < dropped.size()); j++)
+      straight = segment_distance(dropped[j], kept.back(), next) <= tolerance;
+    if (straight)
+      continue;
+    kept.push_back(points[i]);
+    dropped.clear();
+  }
+  kept.push_back(points.back());
+  points = std::move(kept);
+}
+
+// Douglas-Peucker, with an explicit stack as traced paths can be very
+// long.
+static void douglas_peucker(std::vector<Coord>& points,
+			    double tolerance)
+{
+  if (points.size() < 3)
+    return;
+  std::vector<bool> keep(points.size(), false);
+  keep.front() = keep.back() = true;
+  std::vector<std::pair<std::size_t, std::size_t>> stack { { 0, points.size() - 1 } };
+  while (! stack.empty())
+  {
+    auto [first, last] = stack.back();
+    stack.pop_back();
+    double farthest = 0.0;
+    std::size_t index = 0;
+    for (std::size_t i = first + 1; i < last; i++)
+    {
+      double distance = segment_distance(points[i], points[first], points[last]);
+      if (distance > farthest)
+      {
+	farthest = distance;
+	index = i;
+      }
+    }
+    if (farthest > tolerance)
+    {
+      keep[index] = true;
+      stack.push_back({ first, index });
+      stack.push_back({ index, last });
+    }
+  }
+  std::vector<Coord> kept;
+  for (std::size_t i = 0; i < points.size(); i++)
+    if (keep[i])
+      kept.push_back(points[i]);
+  points = std::move(kept);
+}
+
+// Each of the three steps that move the path, replacing curves by their
+// chords, merging and Douglas-Peucker, keeps it within a third of the
+// tolerance of its input, so that together they stay within it.
+static void simplify_subpath(SvgSubpath& path,
+			     double tolerance)
+{
+  double step_tolerance = tolerance / 3.0;
+  std::vector<SvgSegment> segments;
+  std::vector<Coord> run { path.start };
+
+  auto flush_run = [&]()
+  {
+    merge_collinear(run, step_tolerance);
+    douglas_peucker(run, step_tolerance);
+    for (std::size_t i = 1; i < run.size(); i++)
+      segments.push_back({ false, {}, {}, run[i] });
+    run.erase(run.begin(), run.end() - 1);
+  };
+
+  for (const SvgSegment& segment: path.segments)
+  {
+    Coord from = run.back();
+    // the curve lies within the hull of its control points, so if they
+    // are all close to the chord, so is the curve
+    if ((! segment.curve) ||
+	((segment_distance(segment.control_1, from, segment.end) <= step_tolerance) &&
+	 (segment_distance(segment.control_2, from, segment.end) <= step_tolerance)))
+    {
+      run.push_back(segment.end);
+      continue;
+    }
+    flush_run();
+    segments.push_back(segment);
+    run = { segment.end };
+  }
+  flush_run();
+  path.segments = std::move(segments);
+}
+
+void simplify_svg_paths(std::vector<SvgSubpath>& paths,
+			double tolerance)
+{
+  for (SvgSubpath& path: paths)
+    simplify_subpath(path, tolerance);
+}
+
+
+void emit_svg_paths(ContentStreamString& cs,
+		    const std::vector<SvgSubpath>& paths,
+		    bool fill)
+{
+  if (paths.empty())
+    return;
+  for (std::size_t i = 0; i < paths.size(); i++)
+  {
+    const SvgSubpath& path = paths[i];
+    cs.move_to(path.start);
+    for (const SvgSegment& segment: path.segments)
+    {
+      if (segment.curve)
+	cs.curve_to(segment.control_1, segment.control_2, segment.end);
+      else
+	cs.line_to(segment.end);
+    }
+    if (path.closed)
+      cs.path_close();
+    if (fill)
+    {
+      if ((i + 1 == paths.size()) || (paths[i + 1].fill_rule != path.fill_rule))
+	cs.path_fill(path.fill_rule);
+    }
+    else if (i + 1 == paths.size())
+      cs.path_stroke();
+  }
+}
@@ -0,0 +1,73 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef SVG_IMPORT_H
+#define SVG_IMPORT_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "content_stream_string.h"
+
+// Import of SVG artwork, e.g. customer logos, as paths that can be cut or
+// printed with the overlay.  Only geometry is imported: path data, the
+// basic shapes (rect, circle, ellipse, line, polyline, polygon),
+// transforms and the fill rule.  Other styles, text, images and
+// references are ignored.
+
+struct SvgSegment
+{
+  bool curve;			// cubic Bezier if true, else a line to end
+  Coord control_1;
+  Coord control_2;
+  Coord end;
+};
+
+struct SvgSubpath
+{
+  Coord start;
+  std::vector<SvgSegment> segments;
+  bool closed;
+  FillRule fill_rule;		// of the shape the subpath belongs to
+};
+
+// Parses path data (the d attribute of a path element), in user
+// coordinates.  Quadratic curves and elliptical arcs are converted to
+// cubic curves.  Throws std::runtime_error on malformed data.
+std::vector<SvgSubpath> parse_svg_path_data(std::string_view d);
+
+// Parses an SVG document, returning the paths of all shapes with their
+// transforms applied, in the coordinates of the root element (y down).
+// Throws std::runtime_error on malformed input.
+std::vector<SvgSubpath> import_svg(std::string_view svg);
+
+std::vector<SvgSubpath> import_svg_file(const std::string& filename);
+
+// Scales and translates the paths to fit within the box, centered and
+// with their aspect ratio preserved, flipping them to y up.  The box
+// origin is its bottom left corner.
+void fit_svg_paths(std::vector<SvgSubpath>& paths,
+		   Coord origin,
+		   Dimensions box);
+
+std::size_t svg_node_count(const std::vector<SvgSubpath>& paths);
+
+// Reduces the number of nodes while keeping every point of the paths
+// within tolerance of the original.  Curves are kept as curves, unless
+// their control points are within tolerance of the chord, in which case
+// they become lines.  Runs of lines are first merged where consecutive
+// segments are nearly collinear, which is cheap and removes most nodes
+// of traced bitmaps, then reduced by Douglas-Peucker.
+void simplify_svg_paths(std::vector<SvgSubpath>& paths,
+			double tolerance);
+
+// Emits the paths as one path, stroked, or filled.  For filling, each run
+// of subpaths with the same fill rule is a separate path, filled with
+// that rule.
+void emit_svg_paths(ContentStreamString& cs,
+		    const std::vector<SvgSubpath>& paths,
+		    bool fill);
+
+#endif // SVG_IMPORT_H
@@ -0,0 +1,64 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <cmath>
+#include <filesystem>
+#include <string>
+
+// Minimal unit test harness.  TEST(name) defines a test, which is
+// registered before main() runs; the CHECK macros report a failure and
+// let the test continue.  voyager-overlay-tests runs all tests, or those
+// named on the command line, and exits with status 1 if any check failed.
+
+void register_test(const char* name,
+		   void (*function)());
+
+void check_failed(const char* file,
+		  int line,
+		  const std::string& message);
+
+// A fresh, empty directory for the files written by the current test,
+// removed after the test.
+std::filesystem::path test_directory();
+
+#define TEST(name)							\
+  static void test_##name();						\
+  static const bool test_##name##_registered = (register_test(#name, test_##name), true); \
+  static void test_##name()
+
+#define CHECK(condition)						\
+  do									\
+  {									\
+    if (! (condition))							\
+      check_failed(__FILE__, __LINE__, #condition);			\
+  } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)					\
+  do									\
+  {									\
+    double check_a = (a);						\
+    double check_b = (b);						\
+    if (! (std::abs(check_a - check_b) <= (tolerance)))			\
+      check_failed(__FILE__, __LINE__, #a " = " + std::to_string(check_a) + ", " #b " = " + std::to_string(check_b)); \
+  } while (0)
+
+#define CHECK_THROWS(expression, exception)				\
+  do									\
+  {									\
+    bool check_thrown = false;						\
+    try									\
+    {									\
+      expression;							\
+    }									\
+    catch (exception&)							\
+    {									\
+      check_thrown = true;						\
+    }									\
+    if (! check_thrown)							\
+      check_failed(__FILE__, __LINE__, #expression " doesn't throw " #exception); \
+  } while (0)
+
+#endif // TEST_H
@@ -0,0 +1,126 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cmath>
+
+#include "common_line.h"
+#include "layout_diff.h"
+#include "page.h"
+#include "test.h"
+
+// Outlines of overlays stacked with no gap, as for common-line cutting.
+static DisplayList stacked_outlines(unsigned count,
+				    Dimensions size,
+				    double radius)
+{
+  DisplayList list;
+  ContentStreamString cs(true, true);
+  cs.record_to(& list);
+  for (unsigned i = 0; i < count; i++)
+  {
+    cs.begin_segment({ ElementRole::OVERLAY_OUTLINE, 0 });
+    cs.move_to({ 0.0, (i + 1) * size.height });
+    cs.rounded_rect(size, radius);
+    cs.path_close_stroke();
+    cs.end_segment();
+  }
+  return list;
+}
+
+TEST(common_line_shared_edges)
+{
+  DisplayList outlines = stacked_outlines(3, { 2.0, 1.0 }, 0.0);
+  ContentStreamString cs(true);
+  CommonLineStats stats = emit_common_line_cut(cs, outlines, 0.001);
+
+  // two shared edges, each cut once
+  CHECK_NEAR(stats.original_length_in, 18.0, 1e-9);
+  CHECK_NEAR(stats.cut_length_in, 14.0, 1e-9);
+  CHECK(stats.path_count >= 1);
+}
+
+TEST(common_line_page)
+{
+  PageLayout layout = compute_page_layout(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry,
+					  hp_geometry, true);
+  CHECK(layout.overlay_y_gap_in == 0.0);
+  CHECK(layout.slots.size() == 4);
+
+  ContentStreamString cs(true, true);
+  CommonLineStats stats = emit_common_line_slots(cs, layout.slots, hp_geometry);
+  CHECK(stats.cut_length_in < stats.original_length_in);
+  CHECK(stats.cut_length_in > 0.7 * stats.original_length_in);
+}
+
+TEST(common_line_collinear)
+{
+  // overlapping, contained and touching pieces of one line, given in
+  // both directions, and one just off it
+  DisplayList list;
+  ElementId outline = { ElementRole::OVERLAY_OUTLINE, 0 };
+  for (auto [x0, x1]: { std::pair(0.0, 2.0), std::pair(3.0, 1.0), std::pair(1.5, 1.7),
+			std::pair(5.0, 3.0), std::pair(7.0, 8.0) })
+  {
+    list.add(DisplayOpKind::MOVE_TO, outline, { x0, 1.0 });
+    list.add(DisplayOpKind::LINE_TO, outline, { x1, 1.0 });
+    list.add(DisplayOpKind::STROKE, outline);
+  }
+  list.add(DisplayOpKind::MOVE_TO, outline, { 0.0, 1.01 });
+  list.add(DisplayOpKind::LINE_TO, outline, { 1.0, 1.01 });
+  list.add(DisplayOpKind::STROKE, outline);
+
+  ContentStreamString cs(true, true);
+  CommonLineStats stats = emit_common_line_cut(cs, list, 0.001);
+  CHECK_NEAR(stats.original_length_in, 2.0 + 2.0 + 0.2 + 2.0 + 1.0 + 1.0, 1e-9);
+  CHECK_NEAR(stats.cut_length_in, 5.0 + 1.0 + 1.0, 1e-9);
+  CHECK(stats.path_count == 3);
+}
+
+// The cut of a page is one element, which layout diffs see, and its
+// paths never reverse direction, even where the rounded corners of
+// adjacent overlays meet.
+TEST(common_line_cut_paths)
+{
+  DisplayList outlines = stacked_outlines(4, { 2.0, 1.0 }, 0.1);
+  DisplayList cut;
+  ContentStreamString cs(true, true);
+  cs.record_to(& cut);
+  CommonLineStats stats = emit_common_line_cut(cs, outlines, 0.001);
+  CHECK(stats.cut_length_in < stats.original_length_in);
+
+  unsigned cusps = 0;
+  Coord current = { 0.0, 0.0 };
+  Coord direction = { 0.0, 0.0 };
+  for (std::size_t i = 0; i < cut.size(); i++)
+  {
+    const DisplayOp& op = cut[i];
+    CHECK(op.element == (ElementId { ElementRole::COMMON_CUT, 0 }));
+    Coord leaving;
+    Coord entering;
+    if (op.kind == DisplayOpKind::LINE_TO)
+    {
+      leaving = entering = { op.p[0].x - current.x, op.p[0].y - current.y };
+      current = op.p[0];
+    }
+    else if (op.kind == DisplayOpKind::CURVE_TO)
+    {
+      leaving = { op.p[0].x - current.x, op.p[0].y - current.y };
+      entering = { op.p[2].x - op.p[1].x, op.p[2].y - op.p[1].y };
+      current = op.p[2];
+    }
+    else
+    {
+      if (op.kind == DisplayOpKind::MOVE_TO)
+	current = op.p[0];
+      direction = { 0.0, 0.0 };
+      continue;
+    }
+    if (leaving.x * direction.x + leaving.y * direction.y < -1e-12)
+      cusps++;
+    direction = entering;
+  }
+  CHECK(cusps == 0);
+
+  std::vector<ElementChange> changes = diff_layouts(DisplayList(), cut, 1e-6);
+  CHECK((changes.size() == 1) && changes[0].added && (changes[0].id.role == ElementRole::COMMON_CUT));
+}
@@ -0,0 +1,155 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cmath>
+#include <filesystem>
+#include <stdexcept>
+
+#include "compact_display_list.h"
+#include "page.h"
+#include "test.h"
+#include "tiles.h"
+
+static DisplayList test_page()
+{
+  return record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry,
+		     { true, true, true, false, {}, ArtworkUse::PRINT });
+}
+
+// Points come back within half a quantum, colors and line widths as
+// floats.
+static bool same_op(const DisplayOp& a,
+		    const DisplayOp& b)
+{
+  if ((a.kind != b.kind) || (a.element != b.element))
+    return false;
+  double tolerance = COMPACT_QUANTUM_IN;
+  if ((a.kind == DisplayOpKind::SET_LINE_WIDTH) ||
+      (a.kind == DisplayOpKind::SET_FILL_COLOR) ||
+      (a.kind == DisplayOpKind::SET_STROKE_COLOR))
+    tolerance = 1e-6;
+  for (unsigned j = 0; j < 3; j++)
+    if ((std::abs(a.p[j].x - b.p[j].x) > tolerance) || (std::abs(a.p[j].y - b.p[j].y) > tolerance))
+      return false;
+  return true;
+}
+
+TEST(compact_round_trip)
+{
+  DisplayList page = test_page();
+  CompactDisplayList compact(page);
+  CHECK(compact.size() == page.size());
+  CHECK(compact.memory_bytes() < page.memory_bytes() / 2);
+
+  DisplayList expanded = compact.expand();
+  CHECK(expanded.size() == page.size());
+  std::size_t mismatches = 0;
+  for (std::size_t i = 0; (i < page.size()) && (i < expanded.size()); i++)
+  {
+    if (! same_op(page[i], expanded[i]))
+      mismatches++;
+    else if (page[i].kind == DisplayOpKind::TEXT)
+    {
+      const DisplayText& a = page.texts()[page[i].aux];
+      const DisplayText& b = expanded.texts()[expanded[i].aux];
+      if ((a.text != b.text) || (a.font_name != b.font_name) || (a.font_size != b.font_size))
+	mismatches++;
+    }
+  }
+  CHECK(mismatches == 0);
+
+  // items are the same, as decoded
+  std::vector<DisplayItem> items = display_items(page);
+  std::vector<DisplayItem> compact_items = display_items(compact);
+  CHECK(items.size() == compact_items.size());
+  for (std::size_t i = 0; (i < items.size()) && (i < compact_items.size()); i++)
+  {
+    CHECK((items[i].first_op == compact_items[i].first_op) && (items[i].op_count == compact_items[i].op_count));
+    CHECK_NEAR(items[i].min.x, compact_items[i].min.x, COMPACT_QUANTUM_IN);
+    CHECK_NEAR(items[i].max.y, compact_items[i].max.y, COMPACT_QUANTUM_IN);
+  }
+
+  // any range decodes as the same operations, whichever run it starts in
+  for (std::size_t first: { std::size_t(0), std::size_t(1), page.size() / 3, page.size() - 1 })
+  {
+    DisplayList range;
+    range.add(DisplayOpKind::CLOSE, { ElementRole::NONE, 0 });	// appended after existing operations
+    std::size_t count = std::min<std::size_t>(50, page.size() - first);
+    compact.expand(first, count, range);
+    CHECK(range.size() == count + 1);
+    for (std::size_t i = 0; (i < count) && (i + 1 < range.size()); i++)
+      CHECK(same_op(range[i + 1], expanded[first + i]));
+  }
+}
+
+TEST(compact_fill_rule)
+{
+  DisplayList list;
+  list.add(DisplayOpKind::MOVE_TO, { ElementRole::ARTWORK, 0 }, { 0.0, 0.0 });
+  list.add(DisplayOpKind::LINE_TO, { ElementRole::ARTWORK, 0 }, { 1.0, 0.0 });
+  list.add(DisplayOpKind::LINE_TO, { ElementRole::ARTWORK, 0 }, { 0.0, 1.0 });
+  list.add_fill(DisplayOpKind::FILL, { ElementRole::ARTWORK, 0 }, FillRule::EVEN_ODD);
+  list.add(DisplayOpKind::MOVE_TO, { ElementRole::ARTWORK, 0 }, { 2.0, 0.0 });
+  list.add(DisplayOpKind::LINE_TO, { ElementRole::ARTWORK, 0 }, { 3.0, 0.0 });
+  list.add_fill(DisplayOpKind::FILL_STROKE, { ElementRole::ARTWORK, 0 }, FillRule::NONZERO_WINDING);
+  CompactDisplayList compact(list);
+
+  DisplayList expanded = compact.expand();
+  CHECK(display_op_fill_rule(expanded[3]) == FillRule::EVEN_ODD);
+  CHECK(display_op_fill_rule(expanded[6]) == FillRule::NONZERO_WINDING);
+  // the values of the fills are skipped when decoding starts after them
+  DisplayList range;
+  compact.expand(5, 2, range);
+  CHECK(same_op(range[0], list[5]));
+  CHECK(display_op_fill_rule(range[1]) == FillRule::NONZERO_WINDING);
+}
+
+TEST(compact_out_of_range)
+{
+  DisplayList list;
+  list.add(DisplayOpKind::MOVE_TO, { ElementRole::NONE, 0 }, { 0.0, 0.0 });
+  list.add(DisplayOpKind::LINE_TO, { ElementRole::NONE, 0 }, { 5000.0, 0.0 });
+  CHECK_THROWS(CompactDisplayList { list }, std::invalid_argument);
+}
+
+TEST(compact_tiles)
+{
+  DisplayList page = test_page();
+  CompactDisplayList compact(page);
+  TilePyramidOptions options = { (test_directory() / "tiles").string(), "full", 20.0, 64, 1, "" };
+  TilePyramidStats full = write_tile_pyramid(page, { letter_width_in, letter_height_in }, options);
+  options.directory = (test_directory() / "compact-tiles").string();
+  options.name = "compact";
+  TilePyramidStats from_compact = write_tile_pyramid(compact, { letter_width_in, letter_height_in }, options);
+
+  CHECK(from_compact.levels == full.levels);
+  CHECK(from_compact.tiles == full.tiles);
+  CHECK(from_compact.empty == full.empty);
+  CHECK(from_compact.rendered + from_compact.reused == full.rendered + full.reused);
+  CHECK(std::filesystem::exists(test_directory() / "compact-tiles" / "compact.dzi"));
+}
+
+TEST(tiles_skip_empty)
+{
+  // one small square at the bottom left of the page
+  DisplayList list;
+  list.add(DisplayOpKind::MOVE_TO, { ElementRole::ARTWORK, 0 }, { 0.5, 0.5 });
+  list.add(DisplayOpKind::LINE_TO, { ElementRole::ARTWORK, 0 }, { 1.0, 0.5 });
+  list.add(DisplayOpKind::LINE_TO, { ElementRole::ARTWORK, 0 }, { 1.0, 1.0 });
+  list.add_fill(DisplayOpKind::FILL, { ElementRole::ARTWORK, 0 }, FillRule::NONZERO_WINDING);
+  TilePyramidOptions options = { (test_directory() / "sparse-tiles").string(), "sparse", 20.0, 64, 1, "" };
+  TilePyramidStats stats = write_tile_pyramid(list, { letter_width_in, letter_height_in }, options);
+  CHECK(stats.empty > 0);
+  CHECK(stats.rendered + stats.reused == stats.tiles - stats.empty);
+
+  // empty tiles aren't written, nor kept in the store
+  std::size_t entries = 0;
+  for (const auto& level: std::filesystem::directory_iterator(test_directory() / "sparse-tiles" / "sparse_files"))
+    for ([[maybe_unused]] const auto& entry: std::filesystem::directory_iterator(level))
+      entries++;
+  CHECK(entries == stats.tiles - stats.empty);
+  std::size_t stored = 0;
+  for ([[maybe_unused]] const auto& entry: std::filesystem::directory_iterator(test_directory() / "sparse-tiles" / "tile-store"))
+    stored++;
+  CHECK(stored == stats.rendered);
+}
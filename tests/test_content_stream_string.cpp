@@ -0,0 +1,114 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <format>
+#include <string>
+
+#include "content_stream_string.h"
+#include "overlay.h"
+#include "page.h"
+#include "test.h"
+
+TEST(formatted_length)
+{
+  for (double value: { 0.0, -0.0, 1.0, -1.5, 0.1, 0.025, 1e-5, 123456.0, 1234567.0, 2.0 / 3.0,
+		       0.999999, 0.9999995, 99999.95, 1e100, -7.25e-12 })
+    CHECK(formatted_length(value) == std::format("{0:g}", value).length());
+}
+
+TEST(count_only)
+{
+  // counting must agree with what is actually emitted
+  for (bool outlines: { false, true })
+  {
+    ContentStreamString counted(true, true);
+    emit_overlay(counted, hp_geometry, outlines, ! outlines);
+    ContentStreamString emitted = create_overlay(hp_geometry, outlines, ! outlines);
+    CHECK(counted.empty());
+    CHECK(counted.byte_count() == emitted.length());
+    CHECK(counted.operator_count() == emitted.operator_count());
+  }
+}
+
+TEST(segments)
+{
+  ContentStreamString cs(true);
+  cs.set_line_width(0.1);
+  cs.begin_segment({ ElementRole::KEY_OUTLINE, 11 });
+  cs.move_to({ 1.0, 2.0 });
+  cs.line_to({ 3.0, 4.0 });
+  cs.path_stroke();
+  cs.end_segment();
+  cs.begin_segment({ ElementRole::KEY_OUTLINE, 12 });
+  cs.move_to({ 5.0, 6.0 });
+  cs.path_stroke();
+  cs.end_segment();
+
+  const Segment* first = cs.find_segment({ ElementRole::KEY_OUTLINE, 11 });
+  const Segment* second = cs.find_segment({ ElementRole::KEY_OUTLINE, 12 });
+  CHECK(first && second);
+  CHECK(! cs.find_segment({ ElementRole::KEY_OUTLINE, 13 }));
+  CHECK(cs.substr(first->offset, first->length) == "1 2 m 3 4 l S\n");
+  CHECK(first->operator_count == 3);
+  CHECK(cs.substr(second->offset, second->length) == "5 6 m S\n");
+
+  // splicing moves the following segments, and leaves the rest alone
+  cs.splice_segment({ ElementRole::KEY_OUTLINE, 11 }, "x\n");
+  CHECK(cs.substr(first->offset, first->length) == "x\n");
+  CHECK(cs.substr(second->offset, second->length) == "5 6 m S\n");
+  CHECK(cs == "q 0.1 w x\n5 6 m S\nQ\n");
+
+  CHECK_THROWS(cs.splice_segment({ ElementRole::KEY_OUTLINE, 13 }, ""), std::invalid_argument);
+
+  // a count-only stream has segments, but nothing to splice
+  ContentStreamString counted(true, true);
+  counted.begin_segment({ ElementRole::KEY_OUTLINE, 11 });
+  counted.move_to({ 1.0, 2.0 });
+  counted.end_segment();
+  CHECK(counted.find_segment({ ElementRole::KEY_OUTLINE, 11 })->length == std::string("1 2 m\n").length());
+  CHECK_THROWS(counted.splice_segment({ ElementRole::KEY_OUTLINE, 11 }, ""), std::logic_error);
+  CHECK_THROWS(cs.end_segment(), std::logic_error);
+  cs.begin_segment({ ElementRole::REG_MARK, 0 });
+  CHECK_THROWS(cs.begin_segment({ ElementRole::REG_MARK, 1 }), std::logic_error);
+}
+
+TEST(recording)
+{
+  DisplayList list;
+  ContentStreamString cs(true, true);
+  cs.record_to(& list);
+  cs.begin_segment({ ElementRole::OVERLAY_OUTLINE, 0 });
+  cs.move_to({ 0.0, 1.0 });
+  cs.rounded_rect({ 2.0, 1.0 }, 0.25);
+  cs.path_close_stroke();
+  cs.end_segment();
+  cs.set_line_width(0.5);
+
+  CHECK(list.size() == 13);
+  CHECK(list[0].kind == DisplayOpKind::MOVE_TO);
+  CHECK(list[2].kind == DisplayOpKind::CURVE_TO);
+  CHECK(list[11].kind == DisplayOpKind::CLOSE_STROKE);
+  CHECK(list[11].element == (ElementId { ElementRole::OVERLAY_OUTLINE, 0 }));
+  CHECK(list[12].element.role == ElementRole::NONE);
+  CHECK(list[12].p[0].x == 0.5);
+}
+
+TEST(text_escaping)
+{
+  // parentheses and backslashes in a legend are escaped, so the string
+  // can't end early, and counting agrees with the escaped text
+  for (bool count_only: { false, true })
+  {
+    ContentStreamString cs(false, count_only);
+    cs.begin_text("F1", 6.0);
+    cs.show_text({ 1.0, 2.0 }, "a(b\\", "F1", 6.0);
+    cs.end_text();
+    cs.text({ 1.0, 2.0 }, HorizontalAlignment::LEFT, "x)", "F1", 6.0);
+    const std::string expected = "BT 0 Tr /F1 6 Tf\n1 0 0 1 1 2 Tm (a\\(b\\\\) Tj\nET\n"
+				 "BT 1 2 Td 0 Tr /F1 6 Tf\n(x\\)) Tj ET\n";
+    if (count_only)
+      CHECK(cs.byte_count() == expected.length());
+    else
+      CHECK(cs == expected);
+  }
+}
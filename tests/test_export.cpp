@@ -0,0 +1,202 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "document.h"
+#include "raster.h"
+#include "test.h"
+#include "vector_export.h"
+
+static std::string read_file(const std::filesystem::path& path)
+{
+  std::ifstream f(path, std::ios::binary);
+  std::ostringstream s;
+  s << f.rdbuf();
+  return s.str();
+}
+
+static DisplayList overlay_page()
+{
+  return record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry,
+		     { true, true, true, false, {}, ArtworkUse::PRINT });
+}
+
+TEST(export_svg)
+{
+  DisplayList page = overlay_page();
+  std::filesystem::path path = test_directory() / "page.svg";
+  write_svg(path.string(), page, display_items(page), { letter_width_in, letter_height_in });
+  std::string svg = read_file(path);
+  CHECK(svg.starts_with("<?xml"));
+  CHECK(svg.ends_with("</svg>\n"));
+  CHECK(svg.find("<path d=\"M") != std::string::npos);
+  CHECK(svg.find("<text ") != std::string::npos);
+}
+
+// A square with a square hole, both drawn the same way round, so that
+// only the even-odd rule leaves the hole empty.
+static DisplayList nested_squares(FillRule fill_rule)
+{
+  DisplayList list;
+  ContentStreamString cs(true, true);
+  cs.record_to(& list);
+  for (double inset: { 0.0, 0.25 })
+  {
+    cs.move_to({ inset, inset });
+    cs.line_to({ 1.0 - inset, inset });
+    cs.line_to({ 1.0 - inset, 1.0 - inset });
+    cs.line_to({ inset, 1.0 - inset });
+    cs.path_close();
+  }
+  cs.path_fill(fill_rule);
+  return list;
+}
+
+TEST(export_fill_rule)
+{
+  for (FillRule fill_rule: { FillRule::NONZERO_WINDING, FillRule::EVEN_ODD })
+  {
+    DisplayList list = nested_squares(fill_rule);
+    Raster raster(40, 40);
+    raster.draw(list, display_items(list), { 0.0, 1.0, 40.0 }, nullptr);
+    auto pixel = [&](unsigned x, unsigned y) { return raster.pixels()[(y * 40 + x) * 3]; };
+    CHECK(pixel(5, 5) == 0);
+    CHECK(pixel(20, 20) == ((fill_rule == FillRule::EVEN_ODD) ? 255 : 0));
+
+    std::filesystem::path path = test_directory() / "fill-rule.svg";
+    write_svg(path.string(), list, display_items(list), { 1.0, 1.0 });
+    CHECK((read_file(path).find("fill-rule=\"evenodd\"") != std::string::npos) == (fill_rule == FillRule::EVEN_ODD));
+
+    ContentStreamString cs(false);
+    emit_display_list(cs, list);
+    CHECK((cs.find("f*\n") != std::string::npos) == (fill_rule == FillRule::EVEN_ODD));
+  }
+}
+
+TEST(export_hpgl)
+{
+  DisplayList page = overlay_page();
+  std::filesystem::path path = test_directory() / "page.plt";
+  write_hpgl(path.string(), page, display_items(page));
+  std::string hpgl = read_file(path);
+  CHECK(hpgl.starts_with("IN;SP1;\n"));
+  CHECK(hpgl.ends_with("PU;SP0;\n"));
+
+  // Every pen down moves the pen, even for the trailing moves of the
+  // rounded rectangles: one per outline, 4 overlays of 39 keys and the
+  // overlay itself, and 3 registration marks.
+  std::istringstream lines(hpgl);
+  std::string line;
+  unsigned pen_downs = 0;
+  while (std::getline(lines, line))
+  {
+    long x0, y0;
+    int n;
+    if (std::sscanf(line.c_str(), "PU%ld,%ld;PD%n", & x0, & y0, & n) != 2)
+      continue;
+    pen_downs++;
+    bool moved = false;
+    std::istringstream points(line.substr(n));
+    long x, y;
+    char comma;
+    while (points >> x >> comma >> y)
+    {
+      moved = moved || (x != x0) || (y != y0);
+      points >> comma;
+    }
+    CHECK(moved);
+  }
+  CHECK(pen_downs == 4 * 40 + 3);
+}
+
+TEST(remove_degenerate_subpaths)
+{
+  DisplayList list;
+  ContentStreamString cs(true, true);
+  cs.record_to(& list);
+  cs.move_to({ 0.0, 1.0 });
+  cs.rounded_rect({ 2.0, 1.0 }, 0.25);	// ends with a move
+  cs.path_close_stroke();
+  cs.move_to({ 3.0, 3.0 });
+  cs.line_to({ 3.0, 3.0 });
+  cs.path_stroke();			// only one distinct point
+  cs.set_line_width(0.5);
+  cs.move_to({ 4.0, 4.0 });
+  cs.line_to({ 5.0, 4.0 });
+  cs.path_fill();
+
+  list.remove_degenerate_subpaths();
+  std::vector<DisplayOpKind> kinds;
+  for (std::size_t i = 0; i < list.size(); i++)
+    kinds.push_back(list[i].kind);
+  std::vector<DisplayOpKind> expected(12, DisplayOpKind::LINE_TO);
+  expected[0] = DisplayOpKind::MOVE_TO;
+  expected[1] = expected[3] = expected[5] = expected[7] = DisplayOpKind::CURVE_TO;
+  expected[9] = DisplayOpKind::CLOSE_STROKE;
+  expected[10] = DisplayOpKind::SET_LINE_WIDTH;
+  expected[11] = DisplayOpKind::MOVE_TO;
+  expected.push_back(DisplayOpKind::LINE_TO);
+  expected.push_back(DisplayOpKind::FILL);
+  CHECK(kinds == expected);
+}
+
+// Neither the SVG paths nor the PDF content of an export have subpaths
+// that are only a move.
+TEST(export_no_degenerate_subpaths)
+{
+  DisplayList page = overlay_page();
+  page.remove_degenerate_subpaths();
+
+  std::filesystem::path path = test_directory() / "page.svg";
+  write_svg(path.string(), page, display_items(page), { letter_width_in, letter_height_in });
+  std::string svg = read_file(path);
+  for (std::size_t pos = svg.find(" d=\"M"); pos != std::string::npos; pos = svg.find(" d=\"M", pos + 1))
+  {
+    std::string d = svg.substr(pos + 4, svg.find('"', pos + 4) - (pos + 4));
+    for (std::size_t m = 0; m != std::string::npos; m = d.find('M', m + 1))
+    {
+      std::size_t next = d.find_first_of("MLCZ", m + 1);
+      CHECK((next != std::string::npos) && ((d[next] == 'L') || (d[next] == 'C')));
+    }
+  }
+
+  ContentStreamString pdf(true);
+  emit_display_list(pdf, page);
+  for (const char* degenerate: { " m s\n", " m S\n", " m h\n", " m f\n" })
+    CHECK(pdf.find(degenerate) == std::string::npos);
+}
+
+TEST(export_page)
+{
+  DisplayList page = overlay_page();
+  std::string basename = (test_directory() / "page").string();
+  ExportTimes times = export_page(basename, { EXPORT_FORMATS.begin(), EXPORT_FORMATS.end() }, page, "", 20.0, true);
+  CHECK(times.backend_ms.size() == EXPORT_FORMATS.size());
+  for (std::string_view format: EXPORT_FORMATS)
+    CHECK(std::filesystem::file_size(basename + "." + std::string(format)) > 0);
+
+  CHECK_THROWS(export_page(basename, { "dxf" }, page, "", 20.0, false), std::logic_error);
+}
+
+TEST(plan_legend_keys)
+{
+  // a queue legend must name exactly one key of the model using its set
+  PageOptions options = { true, true, true, false, {}, ArtworkUse::PRINT };
+  std::filesystem::path path = test_directory() / "orders.txt";
+  for (int key_code: { 11, 40, 46, 50 })
+  {
+    std::ofstream(path) << std::format("legend pilot {0} \"(x\" \"\" \"\"\n"
+				       "A1 voyager pilot 1 2023-05-01\n", key_code);
+    if ((key_code == 46) || (key_code == 50))
+      CHECK_THROWS(estimate_plan(path.string(), cameo4_no_mat_reg_geometry, options), std::runtime_error);
+    else
+      CHECK(estimate_plan(path.string(), cameo4_no_mat_reg_geometry, options).pages == 1);
+  }
+}
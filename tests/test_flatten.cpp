@@ -0,0 +1,122 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "flatten.h"
+#include "test.h"
+
+TEST(flatten_segment_count)
+{
+  // a straight curve needs one segment, however long
+  CHECK(flatten_segment_count({ { 0.0, 0.0 }, { 1.0, 0.0 }, { 2.0, 0.0 }, { 3.0, 0.0 } }, 0.001) == 1);
+
+  // more segments for a tighter tolerance, about sqrt(1 / tolerance)
+  CubicBezier curve = quarter_arc({ 0.0, 1.0 }, { 1.0, 0.0 });
+  unsigned coarse = flatten_segment_count(curve, 1e-3);
+  unsigned fine = flatten_segment_count(curve, 1e-5);
+  CHECK(coarse > 1);
+  CHECK((fine >= 9 * coarse) && (fine <= 11 * coarse));
+}
+
+TEST(flatten_cubics)
+{
+  // more curves than lanes, of different segment counts
+  std::vector<CubicBezier> curves;
+  for (int i = 0; i < 7; i++)
+  {
+    double r = 0.1 * (i + 1);
+    curves.push_back(quarter_arc({ 0.0, r }, { r, 0.0 }));
+  }
+  std::vector<Coord> points { { -1.0, -1.0 } };
+  std::vector<unsigned> counts;
+  flatten_cubics(curves, 1e-4, points, & counts);
+
+  CHECK(counts.size() == curves.size());
+  CHECK(points[0].x == -1.0);	// existing points are kept
+  std::size_t offset = 1;
+  for (std::size_t i = 0; i < curves.size(); i++)
+  {
+    CHECK(counts[i] == flatten_segment_count(curves[i], 1e-4));
+    double r = 0.1 * (i + 1);
+    for (unsigned k = 0; k < counts[i]; k++)
+      CHECK_NEAR(std::hypot(points[offset + k].x, points[offset + k].y), r, 1e-4 + 2.75e-4 * r);
+    offset += counts[i];
+    // the last point is exactly the end point
+    CHECK((points[offset - 1].x == curves[i].p3.x) && (points[offset - 1].y == curves[i].p3.y));
+  }
+  CHECK(offset == points.size());
+}
+
+// The flattened rounded_rect() corners, against exact circles.  The
+// quarter arc construction itself deviates from a circle by up to 2.7e-4
+// of the radius; the flattening may add up to the tolerance, at the
+// points and at the middle of the segments.
+TEST(flatten_accuracy)
+{
+  for (double radius: { 0.025, 0.25, 1.0 })
+  {
+    for (double tolerance: { 1e-3, 1e-4, 1e-5 })
+    {
+      double w = 4.65;
+      double h = 2.10;
+      struct Corner { Coord from; Coord to; Coord center; };
+      Corner corners[] =
+      {
+	{ { 0.0,         h - radius }, { radius,     h          }, { radius,     h - radius } },
+	{ { w - radius,  h          }, { w,          h - radius }, { w - radius, h - radius } },
+	{ { w,           radius     }, { w - radius, 0.0        }, { w - radius, radius     } },
+	{ { radius,      0.0        }, { 0.0,        radius     }, { radius,     radius     } },
+      };
+      std::vector<CubicBezier> curves;
+      for (const Corner& corner: corners)
+	curves.push_back(quarter_arc(corner.from, corner.to));
+      std::vector<Coord> points;
+      std::vector<unsigned> counts;
+      flatten_cubics(curves, tolerance, points, & counts);
+
+      double max_error = 0.0;
+      std::size_t next = 0;
+      for (std::size_t c = 0; c < curves.size(); c++)
+      {
+	auto error = [&](Coord p)
+	{
+	  return std::abs(std::hypot(p.x - corners[c].center.x, p.y - corners[c].center.y) - radius);
+	};
+	Coord previous = corners[c].from;
+	for (unsigned k = 0; k < counts[c]; k++)
+	{
+	  Coord p = points[next++];
+	  max_error = std::max(max_error, error(p));
+	  max_error = std::max(max_error, error({ (previous.x + p.x) / 2, (previous.y + p.y) / 2 }));
+	  previous = p;
+	}
+      }
+      CHECK(max_error <= tolerance + 2.75e-4 * radius);
+    }
+  }
+}
+
+TEST(flatten_non_finite)
+{
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  double inf = std::numeric_limits<double>::infinity();
+  CubicBezier curve = quarter_arc({ 0.0, 1.0 }, { 1.0, 0.0 });
+  std::vector<Coord> points;
+
+  CubicBezier bad = curve;
+  bad.p1.x = nan;
+  CHECK_THROWS(flatten_segment_count(bad, 1e-3), std::invalid_argument);
+  bad = curve;
+  bad.p3.y = inf;
+  CHECK_THROWS(flatten_segment_count(bad, 1e-3), std::invalid_argument);
+  std::vector<CubicBezier> curves { curve, bad };
+  CHECK_THROWS(flatten_cubics(curves, 1e-3, points), std::invalid_argument);
+
+  CHECK_THROWS(flatten_segment_count(curve, nan), std::invalid_argument);
+  CHECK_THROWS(flatten_segment_count(curve, 0.0), std::invalid_argument);
+  CHECK_THROWS(flatten_segment_count(curve, -1e-3), std::invalid_argument);
+}
@@ -0,0 +1,106 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <sstream>
+
+#include "layout_diff.h"
+#include "page.h"
+#include "test.h"
+
+static DisplayList overlay_ops(bool show_outlines,
+			       bool show_legends)
+{
+  DisplayList list;
+  ContentStreamString cs(true, true);
+  cs.record_to(& list);
+  emit_overlay(cs, hp_geometry, show_outlines, show_legends);
+  return list;
+}
+
+TEST(diff_identical)
+{
+  DisplayList page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry,
+				 { true, true, true, false, {}, ArtworkUse::PRINT });
+  CHECK(diff_layouts(page, page, 1e-6).empty());
+
+  // a recording read back is the same layout
+  std::stringstream s;
+  write_display_list(s, page);
+  CHECK(diff_layouts(page, read_display_list(s), 1e-6).empty());
+}
+
+TEST(diff_changes)
+{
+  DisplayList old_list = overlay_ops(true, true);
+
+  // everything moved, by more than the tolerance
+  DisplayList moved;
+  moved.append(old_list, { 0.01, 0.0 });
+  std::vector<ElementChange> changes = diff_layouts(old_list, moved, 1e-6);
+  CHECK(! changes.empty());
+  for (const ElementChange& change: changes)
+    CHECK(change.moved && ! (change.added || change.removed || change.resized || change.reshaped));
+
+  // but not by less
+  DisplayList nudged;
+  nudged.append(old_list, { 1e-8, 0.0 });
+  CHECK(diff_layouts(old_list, nudged, 1e-6).empty());
+
+  // without legends, only legends are removed
+  changes = diff_layouts(old_list, overlay_ops(true, false), 1e-6);
+  CHECK(! changes.empty());
+  for (const ElementChange& change: changes)
+  {
+    CHECK(change.removed);
+    CHECK((change.id.role == ElementRole::F_LEGEND) ||
+	  (change.id.role == ElementRole::PRIMARY_LEGEND) ||
+	  (change.id.role == ElementRole::G_LEGEND));
+  }
+}
+
+TEST(read_display_list_malformed)
+{
+  std::istringstream bad("not a recording\n");
+  CHECK_THROWS(read_display_list(bad), std::runtime_error);
+}
+
+TEST(display_list_fill_rule)
+{
+  DisplayList list;
+  ContentStreamString cs(true, true);
+  cs.record_to(& list);
+  for (FillRule fill_rule: { FillRule::NONZERO_WINDING, FillRule::EVEN_ODD })
+  {
+    cs.move_to({ 0.0, 0.0 });
+    cs.line_to({ 1.0, 0.0 });
+    cs.line_to({ 0.0, 1.0 });
+    cs.path_fill(fill_rule);
+  }
+  CHECK(display_op_fill_rule(list[3]) == FillRule::NONZERO_WINDING);
+  CHECK(display_op_fill_rule(list[7]) == FillRule::EVEN_ODD);
+
+  std::stringstream s;
+  write_display_list(s, list);
+  CHECK(s.str().find("\nf* NONE") != std::string::npos);
+  DisplayList read = read_display_list(s);
+  CHECK(read.size() == list.size());
+  CHECK(display_op_fill_rule(read[3]) == FillRule::NONZERO_WINDING);
+  CHECK(display_op_fill_rule(read[7]) == FillRule::EVEN_ODD);
+
+  // a changed fill rule is a change of style
+  std::istringstream nonzero("voyager-overlay display list 2\n"
+			     "m ARTWORK 0 0 0\nl ARTWORK 0 1 0\nl ARTWORK 0 0 1\nf ARTWORK 0\n");
+  std::istringstream even_odd("voyager-overlay display list 2\n"
+			      "m ARTWORK 0 0 0\nl ARTWORK 0 1 0\nl ARTWORK 0 0 1\nf* ARTWORK 0\n");
+  std::vector<ElementChange> changes = diff_layouts(read_display_list(nonzero), read_display_list(even_odd), 1e-6);
+  CHECK((changes.size() == 1) && changes[0].restyled && ! changes[0].reshaped);
+
+  // recordings from before the fill rule was kept are still read
+  std::istringstream v1("voyager-overlay display list 1\nm NONE 0 0 0\nl NONE 0 1 0\nf NONE 0\n");
+  DisplayList old = read_display_list(v1);
+  CHECK((old.size() == 3) && (display_op_fill_rule(old[2]) == FillRule::NONZERO_WINDING));
+
+  // only fills have a fill rule
+  std::istringstream bad("voyager-overlay display list 2\nS* NONE 0\n");
+  CHECK_THROWS(read_display_list(bad), std::runtime_error);
+}
@@ -0,0 +1,88 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "test.h"
+
+struct Test
+{
+  const char* name;
+  void (*function)();
+};
+
+// Tests are registered during static initialization, in no particular
+// order across files, so the registry must be constructed on first use.
+static std::vector<Test>& registry()
+{
+  static std::vector<Test> tests;
+  return tests;
+}
+
+void register_test(const char* name,
+		   void (*function)())
+{
+  registry().push_back({ name, function });
+}
+
+static const char* current_test;
+static unsigned failures;
+static std::filesystem::path current_directory;
+
+void check_failed(const char* file,
+		  int line,
+		  const std::string& message)
+{
+  std::cout << std::format("{0}:{1}: {2}: check failed: {3}\n", file, line, current_test, message);
+  failures++;
+}
+
+std::filesystem::path test_directory()
+{
+  if (current_directory.empty())
+  {
+    current_directory = (std::filesystem::temp_directory_path()
+			 / std::format("voyager-overlay-test-{0}-{1}", getpid(), current_test));
+    std::filesystem::remove_all(current_directory);
+    std::filesystem::create_directories(current_directory);
+  }
+  return current_directory;
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned run = 0;
+  for (const Test& test: registry())
+  {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; i++)
+      selected = selected || (argv[i] == std::string(test.name));
+    if (! selected)
+      continue;
+
+    current_test = test.name;
+    try
+    {
+      test.function();
+    }
+    catch (std::exception& e)
+    {
+      check_failed(__FILE__, __LINE__, std::string("exception: ") + e.what());
+    }
+    if (! current_directory.empty())
+    {
+      std::filesystem::remove_all(current_directory);
+      current_directory.clear();
+    }
+    run++;
+  }
+
+  std::cout << std::format("{0} tests, {1} failed checks\n", run, failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include "page.h"
+#include "test.h"
+
+// Operations of the printed (index 0) and cut (index 1) artwork of a
+// recorded page.
+static std::size_t artwork_ops(const DisplayList& page,
+			       unsigned index)
+{
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < page.size(); i++)
+    if ((page[i].element.role == ElementRole::ARTWORK) && (page[i].element.index == static_cast<int>(index)))
+      count++;
+  return count;
+}
+
+TEST(page_artwork_use)
+{
+  PageOptions options = { true, false, true, false, {}, ArtworkUse::PRINT };
+  options.artwork = parse_svg_path_data("M 1 0.5 h 0.5 v 0.5 h -0.5 z");
+
+  // printed only, unless a cut is asked for
+  DisplayList page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry, options);
+  CHECK(artwork_ops(page, 0) > 0);
+  CHECK(artwork_ops(page, 1) == 0);
+
+  options.artwork_use = ArtworkUse::CUT;
+  page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry, options);
+  CHECK(artwork_ops(page, 0) == 0);
+  CHECK(artwork_ops(page, 1) > 0);
+
+  options.artwork_use = ArtworkUse::BOTH;
+  page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry, options);
+  CHECK(artwork_ops(page, 0) > 0);
+  CHECK(artwork_ops(page, 1) > 0);
+
+  // nothing is cut if the outlines aren't
+  options.show_outlines = false;
+  page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, hp_geometry, options);
+  CHECK(artwork_ops(page, 0) > 0);
+  CHECK(artwork_ops(page, 1) == 0);
+}
+
+// The estimate adds up the content of the pages exactly, whatever is
+// drawn and however many slots are filled.
+TEST(page_estimate)
+{
+  PageOptions options = { true, true, true, false, {}, ArtworkUse::BOTH };
+  options.artwork = parse_svg_path_data("M 1 0.5 h 0.5 v 0.5 h -0.5 z");
+
+  for (bool common_line: { false, true })
+  {
+    options.common_line = common_line;
+    std::vector<PageSlots> pages = { { & hp_geometry, ALL_SLOTS, {} }, { & sm_geometry, 3, {} }, { & hp_geometry, 1, {} } };
+    std::size_t bytes = 0;
+    for (const PageSlots& p: pages)
+      bytes += create_page_contents(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, *p.geom,
+				    options, p.slot_count, p.legends, nullptr, 1).length();
+
+    Estimate e = estimate_pages(cameo4_no_mat_reg_geometry, options, pages);
+    CHECK(e.pages == 3);
+    CHECK(e.streams == 3);
+    CHECK(e.uncompressed_bytes == bytes);
+    CHECK(e.generation_s > 0.0);
+
+    // a second estimate only reads the tables
+    CHECK(estimate_pages(cameo4_no_mat_reg_geometry, options, pages).uncompressed_bytes == bytes);
+  }
+
+  options = { false, false, true, false, {}, ArtworkUse::PRINT };
+  Estimate e = estimate_pdf(cameo4_no_mat_reg_geometry, hp_geometry, options);
+  CHECK(e.pages == 1);
+  CHECK(e.uncompressed_bytes == create_page_contents(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry,
+						     hp_geometry, options, ALL_SLOTS, {}, nullptr, 1).length());
+}
+
+// Legend placement is computed once per geometry, and every overlay
+// shares it.
+TEST(legend_anchors_shared)
+{
+  const std::vector<LegendAnchors>& hp = legend_anchors(hp_geometry);
+  CHECK(& legend_anchors(hp_geometry) == & hp);
+  CHECK(& legend_anchors(sm_geometry) != & hp);
+  CHECK(hp.size() == key_placements(hp_geometry).size());
+
+  OverlayGeometry wider = hp_geometry;
+  wider.width_in += 1.0;
+  CHECK(legend_anchors(wider)[0].slot[0].x == hp[0].slot[0].x + 0.5);
+}
+
+// Each slot shows the legends of its own set, and the estimate follows.
+TEST(page_slot_legends)
+{
+  static constexpr Legend pilot[] = { { 11, { "PILOT", "", "" } } };
+  PageOptions options = { true, true, true, false, {}, ArtworkUse::PRINT };
+  SlotLegends legends = { legend_table(), pilot, legend_table() };
+
+  std::string builtin = create_page_contents(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry,
+					     hp_geometry, options, 3, {}, nullptr, 1);
+  std::string mixed = create_page_contents(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry,
+					   hp_geometry, options, 3, legends, nullptr, 2);
+  CHECK(builtin.find("(PILOT)") == std::string::npos);
+  CHECK(mixed.find("(PILOT)") != std::string::npos);
+  CHECK(mixed.find("(ln)") != mixed.rfind("(ln)"));	// in the other two slots
+
+  Estimate e = estimate_pages(cameo4_no_mat_reg_geometry, options, { { & hp_geometry, 3, legends } });
+  CHECK(e.uncompressed_bytes == mixed.length());
+}
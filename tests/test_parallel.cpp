@@ -0,0 +1,53 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "parallel.h"
+#include "test.h"
+
+// Every index is visited exactly once, for any number of threads, and
+// call after call on the same workers.
+TEST(parallel_for_indices)
+{
+  for (int call = 0; call < 50; call++)
+  {
+    for (unsigned threads: { 0u, 1u, 2u, 4u, 8u })
+    {
+      std::vector<std::atomic<int>> visits(37);
+      parallel_for(visits.size(), threads, [&](std::size_t i) { visits[i]++; });
+      bool once = true;
+      for (const std::atomic<int>& v: visits)
+	once = once && (v == 1);
+      CHECK(once);
+    }
+  }
+}
+
+TEST(parallel_for_exception)
+{
+  CHECK_THROWS(parallel_for(100, 4, [](std::size_t i)
+  {
+    if (i == 42)
+      throw std::runtime_error("42");
+  }), std::runtime_error);
+
+  // the workers are still usable
+  std::atomic<std::size_t> sum = 0;
+  parallel_for(100, 4, [&](std::size_t i) { sum += i; });
+  CHECK(sum == 4950);
+}
+
+// A call from within a call runs on its own thread rather than waiting for
+// the busy workers.
+TEST(parallel_for_nested)
+{
+  std::atomic<std::size_t> sum = 0;
+  parallel_for(8, 4, [&](std::size_t i)
+  {
+    parallel_for(10, 4, [&](std::size_t j) { sum += i * 10 + j; });
+  });
+  CHECK(sum == 3160);
+}
@@ -0,0 +1,100 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
+
+#include "sheet_plan.h"
+#include "test.h"
+
+TEST(read_order_queue)
+{
+  std::istringstream s("# id model legends quantity due\n"
+		       "\n"
+		       "A1 voyager 16c 3 2023-11-02\n"
+		       "A2 dm1xl   15c 1 2023-11-01\n");
+  std::vector<Order> orders = read_order_queue(s).orders;
+  CHECK(orders.size() == 2);
+  CHECK((orders[0].id == "A1") && (orders[0].model == "voyager") && (orders[0].legend_set == "16c"));
+  CHECK((orders[0].quantity == 3) && (orders[0].due_date == 20231102));
+  CHECK((orders[1].model == "dm1xl") && (orders[1].due_date == 20231101));
+
+  for (const char* bad: { "A1 voyager 16c 0 2023-11-02\n",
+			  "A1 voyager 16c 1\n",
+			  "A1 voyager 16c 1 2023-13-02\n",
+			  "A1 voyager 16c 1 2023-11-02 extra\n" })
+  {
+    std::istringstream b(bad);
+    CHECK_THROWS(read_order_queue(b), std::runtime_error);
+  }
+}
+
+TEST(read_legend_sets)
+{
+  std::istringstream s("legend pilot 11 \"sin -1\" A \"\"\n"
+		       "A1 voyager pilot 1 2023-11-02\n"
+		       "legend pilot 12 \"\" B e^x\n"
+		       "legend other 49 x \"\" \"\"\n");
+  OrderQueue queue = read_order_queue(s);
+  CHECK(queue.orders.size() == 1);
+  CHECK(queue.legend_sets.size() == 2);
+  const std::vector<LegendDefinition>& pilot = queue.legend_sets["pilot"];
+  CHECK(pilot.size() == 2);
+  CHECK((pilot[0].key_code == 11) && (pilot[0].text[0] == "sin -1") && (pilot[0].text[1] == "A") && pilot[0].text[2].empty());
+  CHECK((pilot[1].key_code == 12) && pilot[1].text[0].empty() && (pilot[1].text[2] == "e^x"));
+
+  for (const char* bad: { "legend pilot 11 a b\n",
+			  "legend pilot 11 a b c d\n",
+			  "legend pilot x a b c\n",
+			  "legend pilot 11 a b c\nlegend pilot 11 d e f\n" })
+  {
+    std::istringstream b(bad);
+    CHECK_THROWS(read_order_queue(b), std::runtime_error);
+  }
+}
+
+TEST(plan_sheets)
+{
+  std::vector<Order> orders =
+  {
+    { "late",   "voyager", "16c", 5, 20231110 },
+    { "early",  "voyager", "15c", 2, 20231101 },
+    { "other",  "dm1xl",   "16c", 3, 20231105 },
+    { "early2", "voyager", "16c", 1, 20231101 },
+  };
+  std::map<std::string, std::size_t> slot_counts = { { "voyager", 4 }, { "dm1xl", 4 } };
+  std::vector<Sheet> sheets = plan_sheets(orders, slot_counts);
+
+  // 8 voyager overlays on 2 sheets, 3 dm1xl on 1
+  CHECK(sheets.size() == 3);
+  std::set<std::pair<std::size_t, unsigned>> planned;
+  int last_due = 0;
+  for (const Sheet& sheet: sheets)
+  {
+    CHECK(sheet.slots.size() <= slot_counts[sheet.model]);
+    CHECK(sheet.due_date >= last_due);
+    last_due = sheet.due_date;
+    for (const SheetSlot& slot: sheet.slots)
+    {
+      CHECK(orders[slot.order].model == sheet.model);
+      CHECK(planned.insert({ slot.order, slot.copy }).second);
+    }
+  }
+  CHECK(planned.size() == 11);
+
+  // the first sheet holds the orders due first, grouped by legend set
+  CHECK(sheets[0].model == "voyager");
+  CHECK(sheets[0].slots.size() == 4);
+  CHECK(orders[sheets[0].slots[0].order].id == "early");
+  CHECK(orders[sheets[0].slots[2].order].id == "early2");
+
+  std::ostringstream map;
+  write_sheet_plan(map, orders, sheets);
+  CHECK(map.str().starts_with("sheet,slot,order,copy,model,legend_set,due_date\n"
+			      "1,1,early,1,voyager,15c,2023-11-01\n"));
+
+  orders.push_back({ "unknown", "hp41", "16c", 1, 20231101 });
+  CHECK_THROWS(plan_sheets(orders, slot_counts), std::invalid_argument);
+}
@@ -0,0 +1,165 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <sys/stat.h>
+
+#include "shm_cache.h"
+#include "test.h"
+
+TEST(shm_cache_insert_lookup)
+{
+  ShmCache cache((test_directory() / "cache").string());
+  CHECK(cache.is_open());
+
+  CHECK(! cache.lookup("42", 1));
+  CHECK(cache.insert("42", 1, "forty-two"));
+  auto value = cache.lookup("42", 1);
+  CHECK(value && (*value == "forty-two"));
+
+  // entries of another version are distinct
+  CHECK(! cache.lookup("42", 2));
+  CHECK(cache.insert("42", 2, "version two"));
+  CHECK(cache.lookup("42", 1) == "forty-two");
+  CHECK(cache.lookup("42", 2) == "version two");
+}
+
+TEST(shm_cache_keys)
+{
+  ShmCache cache((test_directory() / "cache").string());
+  CHECK(cache.is_open());
+
+  // keys are compared as bytes, including embedded and trailing NULs
+  using namespace std::string_view_literals;
+  CHECK(cache.insert("ab"sv, 1, "1"));
+  CHECK(cache.insert("ab\0"sv, 1, "2"));
+  CHECK(cache.insert("a\0b"sv, 1, "3"));
+  CHECK(cache.insert(""sv, 1, "4"));
+  CHECK(cache.lookup("ab"sv, 1) == "1");
+  CHECK(cache.lookup("ab\0"sv, 1) == "2");
+  CHECK(cache.lookup("a\0b"sv, 1) == "3");
+  CHECK(cache.lookup(""sv, 1) == "4");
+  CHECK(! cache.lookup("a"sv, 1));
+
+  // enough keys to share buckets of their probe sequences
+  for (int i = 0; i < 1000; i++)
+    CHECK(cache.insert(std::to_string(i), 1, std::to_string(i * i)));
+  for (int i = 0; i < 1000; i++)
+    CHECK(cache.lookup(std::to_string(i), 1) == std::to_string(i * i));
+}
+
+TEST(shm_cache_shared)
+{
+  std::string path = (test_directory() / "cache").string();
+  ShmCache writer(path);
+  ShmCache reader(path);
+  CHECK(writer.is_open() && reader.is_open());
+
+  CHECK(writer.insert("7", 1, "shared"));
+  CHECK(reader.lookup("7", 1) == "shared");
+
+  // adding an entry that is already present is not an error, and doesn't
+  // replace it
+  CHECK(reader.insert("7", 1, "other"));
+  CHECK(writer.lookup("7", 1) == "shared");
+}
+
+TEST(shm_cache_private)
+{
+  std::string path = (test_directory() / "cache").string();
+  {
+    ShmCache cache(path);
+    CHECK(cache.is_open());
+  }
+  struct stat st;
+  CHECK(stat(path.c_str(), & st) == 0);
+  CHECK((st.st_mode & 07777) == 0600);
+
+  // a file others may write to isn't trusted
+  CHECK(chmod(path.c_str(), 0644) == 0);
+  {
+    ShmCache cache(path);
+    CHECK(! cache.is_open());
+    CHECK(! cache.insert("1", 1, "one"));
+    CHECK(! cache.lookup("1", 1));
+  }
+
+  // nor is a link to a cache file, even one that is otherwise valid
+  CHECK(chmod(path.c_str(), 0600) == 0);
+  std::string link_path = (test_directory() / "link").string();
+  std::filesystem::create_symlink(path, link_path);
+  ShmCache cache(link_path);
+  CHECK(! cache.is_open());
+}
+
+TEST(shm_cache_full)
+{
+  std::string path = (test_directory() / "full-cache").string();
+  ShmCache full(path);
+  CHECK(full.is_open());
+
+  // a value too big for any cache doesn't replace the file
+  CHECK(! full.insert("huge", 1, std::string(40 << 20, 'x')));
+  CHECK(ShmCache(path).lookup("0", 1) == std::nullopt);
+  CHECK(full.insert("0", 1, "zero"));
+  CHECK(ShmCache(path).lookup("0", 1) == "zero");
+
+  // once the data area is full the file is replaced, but the process
+  // that filled it still finds its entries
+  std::string value(1 << 20, 'v');
+  int count = 1;
+  while (full.insert(std::to_string(count), 1, value))
+    count++;
+  CHECK(count > 30);
+  CHECK(full.lookup("0", 1) == "zero");
+  CHECK(! full.insert("more", 1, "more"));
+
+  ShmCache fresh(path);
+  CHECK(fresh.is_open());
+  CHECK(! fresh.lookup("0", 1));
+  CHECK(fresh.insert("1", 1, value));
+  CHECK(fresh.lookup("1", 1) == value);
+}
+
+TEST(shm_cache_incompatible)
+{
+  std::string path = (test_directory() / "old-cache").string();
+  std::string other_path = (test_directory() / "not-a-cache").string();
+  for (const std::string& p: { path, other_path })
+  {
+    std::ofstream f(p);
+    if (p == path)
+      f << "VoyCache";		// the magic number, little-endian
+    f << "from an older build";
+  }
+  CHECK(chmod(path.c_str(), 0600) == 0);
+  CHECK(chmod(other_path.c_str(), 0600) == 0);
+
+  // a cache file of another format is replaced
+  ShmCache cache(path);
+  CHECK(cache.is_open());
+  CHECK(cache.insert("1", 1, "one"));
+
+  // another file is left alone
+  CHECK(! ShmCache(other_path).is_open());
+  CHECK(std::filesystem::file_size(other_path) == 19);
+}
+
+TEST(shm_cache_default_path)
+{
+  std::string path = ShmCache::default_path();
+  CHECK(path.starts_with("/"));
+  CHECK(path.find("voyager-overlay-cache") != std::string::npos);
+}
+
+TEST(shm_cache_hash)
+{
+  // FNV-1a test vectors
+  CHECK(ShmCache::hash("", 0) == 0xcbf29ce484222325);
+  CHECK(ShmCache::hash("a", 1) == 0xaf63dc4c8601ec8c);
+  CHECK(ShmCache::hash("foobar", 6) == 0x85944171f73967e8);
+}
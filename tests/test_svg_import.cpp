@@ -0,0 +1,316 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cmath>
+#include <format>
+#include <numbers>
+#include <string>
+#include <vector>
+
+#include "svg_import.h"
+#include "test.h"
+
+TEST(svg_path_data)
+{
+  std::vector<SvgSubpath> paths = parse_svg_path_data("M 1 2 L 3 4 H 5 V 6 Z");
+  CHECK(paths.size() == 1);
+  CHECK((paths[0].start.x == 1.0) && (paths[0].start.y == 2.0));
+  CHECK(paths[0].closed);
+  CHECK(paths[0].segments.size() == 3);
+  CHECK((paths[0].segments[1].end.x == 5.0) && (paths[0].segments[1].end.y == 4.0));
+  CHECK((paths[0].segments[2].end.x == 5.0) && (paths[0].segments[2].end.y == 6.0));
+
+  CHECK_THROWS(parse_svg_path_data("L 1 2"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 X 3 4"), std::runtime_error);
+}
+
+static Coord cubic_point(Coord p0,
+			 const SvgSegment& segment,
+			 double t)
+{
+  double u = 1.0 - t;
+  double a = u * u * u;
+  double b = 3.0 * u * u * t;
+  double c = 3.0 * u * t * t;
+  double d = t * t * t;
+  return { a * p0.x + b * segment.control_1.x + c * segment.control_2.x + d * segment.end.x,
+	   a * p0.y + b * segment.control_1.y + c * segment.control_2.y + d * segment.end.y };
+}
+
+static bool near(Coord a,
+		 Coord b)
+{
+  return std::hypot(a.x - b.x, a.y - b.y) < 1e-9;
+}
+
+TEST(svg_path_data_relative)
+{
+  // implicit lines after a move, and relative commands from the current
+  // point, which after a close is the start of the subpath
+  std::vector<SvgSubpath> paths = parse_svg_path_data("m 1 1 2 0 v 1 h -1 z m 1 1 l 1 1 c 0 1 1 1 1 0 s 1 -1 1 0 q 1 1 2 0 t 2 0");
+  CHECK(paths.size() == 2);
+  CHECK(near(paths[0].start, { 1.0, 1.0 }));
+  CHECK(paths[0].segments.size() == 3);
+  CHECK(near(paths[0].segments[0].end, { 3.0, 1.0 }));
+  CHECK(near(paths[0].segments[1].end, { 3.0, 2.0 }));
+  CHECK(near(paths[0].segments[2].end, { 2.0, 2.0 }));
+  CHECK(paths[0].closed);
+
+  CHECK(near(paths[1].start, { 2.0, 2.0 }));
+  CHECK(! paths[1].closed);
+  const std::vector<SvgSegment>& segments = paths[1].segments;
+  CHECK(segments.size() == 5);
+  if (segments.size() == 5)
+  {
+    CHECK(near(segments[0].end, { 3.0, 3.0 }));
+    CHECK(segments[1].curve);
+    CHECK(near(segments[1].control_1, { 3.0, 4.0 }));
+    CHECK(near(segments[1].control_2, { 4.0, 4.0 }));
+    CHECK(near(segments[1].end, { 4.0, 3.0 }));
+    // the first control point of s reflects the last one of c
+    CHECK(near(segments[2].control_1, { 4.0, 2.0 }));
+    CHECK(near(segments[2].control_2, { 5.0, 2.0 }));
+    CHECK(near(segments[2].end, { 5.0, 3.0 }));
+    // quadratic curves are elevated to cubics: control (6, 4)
+    CHECK(near(segments[3].control_1, { 5.0 + 2.0 / 3.0, 3.0 + 2.0 / 3.0 }));
+    CHECK(near(segments[3].control_2, { 7.0 - 2.0 / 3.0, 3.0 + 2.0 / 3.0 }));
+    CHECK(near(segments[3].end, { 7.0, 3.0 }));
+    // and t reflects the quadratic control point, to (8, 2)
+    CHECK(near(segments[4].control_1, { 7.0 + 2.0 / 3.0, 3.0 - 2.0 / 3.0 }));
+    CHECK(near(segments[4].end, { 9.0, 3.0 }));
+  }
+
+  // numbers need no separators where the syntax allows it
+  paths = parse_svg_path_data("M.5.5L1-1e0");
+  CHECK((paths.size() == 1) && (paths[0].segments.size() == 1));
+  CHECK(near(paths[0].start, { 0.5, 0.5 }));
+  CHECK(near(paths[0].segments[0].end, { 1.0, -1.0 }));
+}
+
+TEST(svg_path_data_arcs)
+{
+  // quarter circle about (0, 1), one cubic
+  std::vector<SvgSubpath> paths = parse_svg_path_data("M 0 0 A 1 1 0 0 1 1 1");
+  CHECK((paths.size() == 1) && (paths[0].segments.size() == 1));
+  const SvgSegment& quarter = paths[0].segments[0];
+  CHECK(quarter.curve);
+  CHECK(near(quarter.end, { 1.0, 1.0 }));
+  Coord middle = cubic_point(paths[0].start, quarter, 0.5);
+  CHECK_NEAR(std::hypot(middle.x, middle.y - 1.0), 1.0, 1e-3);
+
+  // the large arc the other way round is three quarters, in three cubics
+  paths = parse_svg_path_data("M 0 0 a 1 1 0 1 0 1 1");
+  CHECK((paths.size() == 1) && (paths[0].segments.size() == 3));
+  CHECK(near(paths[0].segments.back().end, { 1.0, 1.0 }));
+
+  // radii too small for the end point are scaled up, to a half circle
+  paths = parse_svg_path_data("M 0 0 A 0.1 0.1 0 0 1 2 0");
+  CHECK((paths.size() == 1) && (paths[0].segments.size() == 2));
+  CHECK(near(paths[0].segments[0].end, { 1.0, -1.0 }) || near(paths[0].segments[0].end, { 1.0, 1.0 }));
+  CHECK(near(paths[0].segments[1].end, { 2.0, 0.0 }));
+
+  // a zero radius makes a line, and flags need no separators
+  paths = parse_svg_path_data("M 0 0 A 0 1 0 0 1 1 1 a1 1 0 01-1 1");
+  CHECK((paths.size() == 1) && (paths[0].segments.size() == 2));
+  CHECK(! paths[0].segments[0].curve);
+  CHECK(paths[0].segments[1].curve);
+  CHECK(near(paths[0].segments[1].end, { 0.0, 2.0 }));
+}
+
+TEST(svg_path_data_malformed)
+{
+  CHECK_THROWS(parse_svg_path_data("1 2"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 L 3"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 Z 3 4"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 C 1 2 3 4"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 A 1 1 0 2 1 3 3"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 L . 3"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 L 3 4 -"), std::runtime_error);
+  CHECK_THROWS(parse_svg_path_data("M 1 2 L 1e999 3"), std::runtime_error);	// out of range
+
+  CHECK_THROWS(import_svg("<svg><path d=\"M 0 0 L 1 1\""), std::runtime_error);
+  CHECK_THROWS(import_svg("<svg><path d=M/></svg>"), std::runtime_error);
+  CHECK_THROWS(import_svg("<svg><path d=\"M 0 0/></svg>"), std::runtime_error);
+  CHECK_THROWS(import_svg("<svg><!-- unterminated </svg>"), std::runtime_error);
+}
+
+TEST(svg_fill_rule)
+{
+  std::vector<SvgSubpath> paths = import_svg("<svg xmlns=\"http://www.w3.org/2000/svg\">"
+					     "<path d=\"M 0 0 H 4 V 4 H 0 Z M 1 1 H 3 V 3 H 1 Z\" fill-rule=\"evenodd\"/>"
+					     "<g style=\"fill: black; fill-rule : evenodd\">"
+					     "<rect x=\"5\" y=\"0\" width=\"1\" height=\"1\"/>"
+					     "<rect x=\"7\" y=\"0\" width=\"1\" height=\"1\" fill-rule=\"nonzero\"/>"
+					     "</g>"
+					     "<circle cx=\"10\" cy=\"0\" r=\"1\"/>"
+					     "</svg>");
+  CHECK(paths.size() == 5);
+  if (paths.size() == 5)
+  {
+    CHECK(paths[0].fill_rule == FillRule::EVEN_ODD);
+    CHECK(paths[1].fill_rule == FillRule::EVEN_ODD);
+    CHECK(paths[2].fill_rule == FillRule::EVEN_ODD);
+    CHECK(paths[3].fill_rule == FillRule::NONZERO_WINDING);
+    CHECK(paths[4].fill_rule == FillRule::NONZERO_WINDING);
+  }
+
+  // filled as one path per run of the same rule; stroked as one path
+  ContentStreamString fill(false);
+  emit_svg_paths(fill, paths, true);
+  std::string s = fill;
+  CHECK(s.ends_with("f\n"));
+  std::size_t even_odd = s.find("f*\n");
+  CHECK(even_odd != std::string::npos);
+  CHECK(s.find("f*\n", even_odd + 1) == std::string::npos);
+  CHECK(s.find("f\n") > even_odd);
+
+  ContentStreamString stroke(false);
+  emit_svg_paths(stroke, paths, false);
+  std::string t = stroke;
+  CHECK(t.find("S\n") == t.length() - 2);
+  CHECK(t.find("f") == std::string::npos);
+
+  CHECK_THROWS(import_svg("<svg><path d=\"M 0 0 L 1 1\" fill-rule=\"odd\"/></svg>"), std::runtime_error);
+}
+
+TEST(svg_import_shapes)
+{
+  std::vector<SvgSubpath> paths = import_svg("<svg xmlns=\"http://www.w3.org/2000/svg\">"
+					     "<g transform=\"translate(10 20)\"><rect x=\"1\" y=\"2\" width=\"3\" height=\"4\"/></g>"
+					     "<circle cx=\"0\" cy=\"0\" r=\"1\"/>"
+					     "<text>ignored</text>"
+					     "</svg>");
+  CHECK(paths.size() == 2);
+  CHECK((paths[0].start.x == 11.0) && (paths[0].start.y == 22.0));
+  CHECK(paths[0].closed);
+
+  fit_svg_paths(paths, { 1.0, 1.0 }, { 2.0, 2.0 });
+  for (const SvgSubpath& path: paths)
+    for (const SvgSegment& segment: path.segments)
+      CHECK((segment.end.x >= 1.0 - 1e-9) && (segment.end.x <= 3.0 + 1e-9) &&
+	    (segment.end.y >= 1.0 - 1e-9) && (segment.end.y <= 3.0 + 1e-9));
+
+  CHECK_THROWS(import_svg("<svg><path d=\"M 0 0 L\"/></svg>"), std::runtime_error);
+}
+
+
+// Points along a subpath, with each segment divided into n steps.
+static std::vector<Coord> sample_subpath(const SvgSubpath& path,
+					 unsigned n)
+{
+  std::vector<Coord> points { path.start };
+  Coord from = path.start;
+  for (const SvgSegment& segment: path.segments)
+  {
+    for (unsigned i = 1; i <= n; i++)
+    {
+      double t = double(i) / n;
+      if (segment.curve)
+	points.push_back(cubic_point(from, segment, t));
+      else
+	points.push_back({ from.x + t * (segment.end.x - from.x), from.y + t * (segment.end.y - from.y) });
+    }
+    from = segment.end;
+  }
+  if (path.closed)
+    points.push_back(path.start);
+  return points;
+}
+
+static double distance_to_polyline(Coord p,
+				   const std::vector<Coord>& polyline)
+{
+  double distance = std::hypot(p.x - polyline[0].x, p.y - polyline[0].y);
+  for (std::size_t i = 1; i < polyline.size(); i++)
+  {
+    Coord a = polyline[i - 1];
+    Coord b = polyline[i];
+    double dx = b.x - a.x;
+    double dy = b.y - a.y;
+    double length2 = dx * dx + dy * dy;
+    double t = (length2 > 0.0) ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length2 : 0.0;
+    t = std::clamp(t, 0.0, 1.0);
+    distance = std::min(distance, std::hypot(p.x - a.x - t * dx, p.y - a.y - t * dy));
+  }
+  return distance;
+}
+
+// Every point of the original curves, sampled, must lie within the
+// tolerance of the simplified path.
+TEST(svg_simplify_tolerance)
+{
+  // a disc with a hole traced to pixels, as a bitmap tracer without curve
+  // fitting produces it, and curves both large and small enough to
+  // become lines
+  constexpr int radius_px = 200;
+  std::string d;
+  for (int r: { radius_px, radius_px / 2 })
+  {
+    int n = 16 * r;
+    int px = r;
+    int py = 0;
+    d += std::format("M{0} {1}", px, py);
+    for (int i = 1; i <= n; i++)
+    {
+      double angle = 2.0 * std::numbers::pi * i / n;
+      int x = std::lround(r * std::cos(angle));
+      int y = std::lround(r * std::sin(angle));
+      if ((x == px) && (y == py))
+	continue;
+      if ((x != px) && (y != py))
+	d += std::format("L{0} {1}", x, py);
+      d += std::format("L{0} {1}", x, y);
+      px = x;
+      py = y;
+    }
+    d += "Z";
+  }
+  d += "M0 0C50 0 50 50 0 50Z";
+  for (int i = 0; i < 20; i++)
+    d += std::format("M{0} 150c0.03 0.01 0.06 -0.01 0.1 0s0.05 0.02 0.1 0", -100 + 10 * i);
+
+  std::vector<SvgSubpath> paths = parse_svg_path_data(d);
+  // pixels of half the tolerance
+  fit_svg_paths(paths, { 0.0, 0.0 }, { 0.2, 0.2 });
+
+  // Short curves along an arc, bulging outwards nearly as far as allowed
+  // for replacing them by chords, where the errors of the steps add up.
+  constexpr double tolerance = 0.001;
+  for (double bulge: { 0.32 * tolerance, 0.45 * tolerance })
+  {
+    constexpr double radius = 0.0236;
+    constexpr int count = 11;
+    SvgSubpath arc = { { radius, 1.0 }, {}, false, FillRule::NONZERO_WINDING };
+    for (int i = 1; i <= count; i++)
+    {
+      Coord from = arc.segments.empty() ? arc.start : arc.segments.back().end;
+      double angle = 0.5 * i / count;
+      Coord to = { radius * std::cos(angle), 1.0 + radius * std::sin(angle) };
+      double middle = 0.5 * (i - 0.5) / count;
+      Coord out = { bulge * std::cos(middle), bulge * std::sin(middle) };
+      arc.segments.push_back({ true,
+			       { from.x + (to.x - from.x) / 3.0 + out.x, from.y + (to.y - from.y) / 3.0 + out.y },
+			       { from.x + 2.0 * (to.x - from.x) / 3.0 + out.x, from.y + 2.0 * (to.y - from.y) / 3.0 + out.y },
+			       to });
+    }
+    paths.push_back(arc);
+  }
+  std::vector<SvgSubpath> original = paths;
+
+  simplify_svg_paths(paths, tolerance);
+  CHECK(paths.size() == original.size());
+  CHECK(svg_node_count(paths) < svg_node_count(original) / 2);
+
+  double worst = 0.0;
+  for (std::size_t i = 0; (i < paths.size()) && (i < original.size()); i++)
+  {
+    // kept curves are the original ones, so sampling them at a multiple
+    // of the rate of the original samples hits those exactly
+    std::vector<Coord> simplified = sample_subpath(paths[i], 64);
+    for (Coord p: sample_subpath(original[i], 16))
+      worst = std::max(worst, distance_to_polyline(p, simplified));
+  }
+  CHECK(worst <= tolerance * (1.0 + 1e-9));
+  CHECK(worst > tolerance / 10.0);	// not trivially met
+}
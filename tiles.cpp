@@ -0,0 +1,254 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "compact_display_list.h"
+#include "parallel.h"
+#include "raster.h"
+#include "shm_cache.h"
+#include "tiles.h"
+
+namespace fs = std::filesystem;
+
+// Must be incremented whenever the rasterizer draws the same display list
+// differently, so that stale tiles in a store aren't used.
+static constexpr uint32_t TILE_FORMAT_VERSION = 3;
+
+struct Tile
+{
+  unsigned level;
+  unsigned column;
+  unsigned row;
+  unsigned width;		// edge tiles may be smaller
+  unsigned height;
+  RasterView view;
+};
+
+// Items that can affect any pixel of the tile.  Strokes are at least one
+// pixel wide, and antialiasing spreads them by another pixel.
+static std::vector<DisplayItem> tile_items(const std::vector<DisplayItem>& items,
+					   const Tile& tile)
+{
+  double ppi = tile.view.pixels_per_in;
+  double left = tile.view.left_in;
+  double right = left + tile.width / ppi;
+  double top = tile.view.top_in;
+  double bottom = top - tile.height / ppi;
+
+  std::vector<DisplayItem> result;
+  for (const DisplayItem& item: items)
+  {
+    double margin = std::max(item.line_width / 2.0, 0.5 / ppi) + 1.0 / ppi;
+    if ((item.max.x + margin < left) || (item.min.x - margin > right) ||
+	(item.max.y + margin < bottom) || (item.min.y - margin > top))
+      continue;
+    result.push_back(item);
+  }
+  return result;
+}
+
+// Hash of everything that determines the pixels of the tile.  The
+// coordinates are hashed as transformed to tile pixels, so identical
+// geometry at the same place in the pyramid hashes the same regardless of
+// what else is on the page.
+static uint64_t tile_hash(const DisplayList& list,
+			  const std::vector<DisplayItem>& items,
+			  const Tile& tile,
+			  const std::string& font_file)
+{
+  uint64_t h = ShmCache::hash(& TILE_FORMAT_VERSION, sizeof(TILE_FORMAT_VERSION));
+  unsigned size[2] = { tile.width, tile.height };
+  h = ShmCache::hash(size, sizeof(size), h);
+  h = ShmCache::hash(& tile.view.pixels_per_in, sizeof(tile.view.pixels_per_in), h);
+  h = ShmCache::hash(font_file.c_str(), font_file.length() + 1, h);
+  for (const DisplayItem& item: items)
+  {
+    double state[7] = { item.line_width,
+			item.fill_color.r, item.fill_color.g, item.fill_color.b,
+			item.stroke_color.r, item.stroke_color.g, item.stroke_color.b };
+    h = ShmCache::hash(state, sizeof(state), h);
+    for (std::size_t i = item.first_op; i < item.first_op + item.op_count; i++)
+    {
+      const DisplayOp& op = list[i];
+      h = ShmCache::hash(& op.kind, sizeof(op.kind), h);
+      for (unsigned j = 0; j < display_op_point_count(op.kind); j++)
+      {
+	Coord p = tile.view.to_pixels(op.p[j]);
+	h = ShmCache::hash(& p, sizeof(p), h);
+      }
+      if (op.kind == DisplayOpKind::TEXT)
+      {
+	const DisplayText& text = list.texts()[op.aux];
+	h = ShmCache::hash(text.text.c_str(), text.text.length() + 1, h);
+	h = ShmCache::hash(& text.font_size, sizeof(text.font_size), h);
+      }
+      else if (display_op_is_fill(op.kind))
+	h = ShmCache::hash(& op.aux, sizeof(op.aux), h);	// fill rule
+    }
+  }
+  return h;
+}
+
+static void write_dzi(const std::string& filename,
+		      unsigned width,
+		      unsigned height,
+		      unsigned tile_size)
+{
+  std::ofstream f(filename);
+  f << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    << std::format("<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\" TileSize=\"{0}\" Overlap=\"0\" Format=\"png\">\n", tile_size)
+    << std::format("  <Size Width=\"{0}\" Height=\"{1}\"/>\n", width, height)
+    << "</Image>\n";
+  if (! f)
+    throw std::runtime_error("can't write `" + filename + "'");
+}
+
+// Hard links the pyramid entry to the stored tile, falling back to a copy
+// if the file system doesn't support links.
+static void link_tile(const fs::path& stored,
+		      const fs::path& entry)
+{
+  std::error_code ec;
+  fs::remove(entry, ec);
+  fs::create_hard_link(stored, entry, ec);
+  if (ec)
+    fs::copy_file(stored, entry, fs::copy_options::overwrite_existing);
+}
+
+
+// Gives the display list to draw a tile from, and the visible items as
+// indices into it.  The list may be a full page, or only the operations
+// of the visible items, decoded into storage for the tile.
+typedef std::function<const DisplayList& (std::vector<DisplayItem>& visible,
+					  DisplayList& storage)> TileListFn;
+
+static TilePyramidStats write_tile_pyramid(const std::vector<DisplayItem>& items,
+					   const TileListFn& tile_list,
+					   Dimensions page_size_in,
+					   const TilePyramidOptions& options)
+{
+  TilePyramidStats stats = { 0, 0, 0, 0, 0 };
+
+  unsigned width = std::ceil(page_size_in.width * options.pixels_per_in);
+  unsigned height = std::ceil(page_size_in.height * options.pixels_per_in);
+  unsigned max_level = std::ceil(std::log2(std::max(width, height)));
+  stats.levels = max_level + 1;
+
+  fs::path dir(options.directory);
+  fs::path store = dir / "tile-store";
+  fs::path files = dir / (options.name + "_files");
+  fs::create_directories(store);
+
+  std::vector<Tile> tiles;
+  for (unsigned level = 0; level <= max_level; level++)
+  {
+    double scale = std::ldexp(1.0, int(level) - int(max_level));
+    unsigned level_width = std::ceil(width * scale);
+    unsigned level_height = std::ceil(height * scale);
+    double ppi = options.pixels_per_in * scale;
+    fs::create_directories(files / std::to_string(level));
+    for (unsigned row = 0; row * options.tile_size < level_height; row++)
+      for (unsigned col = 0; col * options.tile_size < level_width; col++)
+	tiles.push_back({ level, col, row,
+			  std::min(options.tile_size, level_width - col * options.tile_size),
+			  std::min(options.tile_size, level_height - row * options.tile_size),
+			  { col * options.tile_size / ppi,
+			    page_size_in.height - row * options.tile_size / ppi,
+			    ppi } });
+  }
+  stats.tiles = tiles.size();
+
+  std::unique_ptr<GlyphCache> glyphs;
+  if (! options.font_file.empty())
+    glyphs = std::make_unique<GlyphCache>(options.font_file);
+
+  std::atomic<std::size_t> empty = 0;
+  std::atomic<std::size_t> rendered = 0;
+  std::atomic<std::size_t> reused = 0;
+
+  parallel_for(tiles.size(), options.threads, [&](std::size_t i)
+  {
+    const Tile& tile = tiles[i];
+    fs::path entry = files / std::to_string(tile.level) / std::format("{0}_{1}.png", tile.column, tile.row);
+    std::vector<DisplayItem> visible = tile_items(items, tile);
+    if (visible.empty())
+    {
+      // only an entry left by an earlier pyramid is removed
+      std::error_code ec;
+      fs::remove(entry, ec);
+      empty++;
+      return;
+    }
+
+    DisplayList storage;
+    const DisplayList& list = tile_list(visible, storage);
+    uint64_t hash = tile_hash(list, visible, tile, options.font_file);
+    fs::path stored_tile = store / std::format("{0:016x}.png", hash);
+
+    // Two threads may render the same new tile at once; that only costs
+    // time, as the rename is atomic.
+    if (fs::exists(stored_tile))
+      reused++;
+    else
+    {
+      Raster raster(tile.width, tile.height);
+      raster.draw(list, visible, tile.view, glyphs.get());
+      // written under a temporary name so that the store never contains
+      // a partial tile
+      fs::path temp = store / std::format("{0:016x}.{1}.tmp", hash, i);
+      raster.write_png(temp.string());
+      fs::rename(temp, stored_tile);
+      rendered++;
+    }
+    link_tile(stored_tile, entry);
+  });
+
+  stats.empty = empty;
+  stats.rendered = rendered;
+  stats.reused = reused;
+
+  write_dzi((dir / (options.name + ".dzi")).string(), width, height, options.tile_size);
+  return stats;
+}
+
+TilePyramidStats write_tile_pyramid(const DisplayList& list,
+				    Dimensions page_size_in,
+				    const TilePyramidOptions& options)
+{
+  return write_tile_pyramid(display_items(list),
+			    [&](std::vector<DisplayItem>&, DisplayList&) -> const DisplayList&
+			    {
+			      return list;
+			    },
+			    page_size_in,
+			    options);
+}
+
+TilePyramidStats write_tile_pyramid(const CompactDisplayList& list,
+				    Dimensions page_size_in,
+				    const TilePyramidOptions& options)
+{
+  return write_tile_pyramid(display_items(list),
+			    [&](std::vector<DisplayItem>& visible, DisplayList& storage) -> const DisplayList&
+			    {
+			      for (DisplayItem& item: visible)
+			      {
+				std::size_t first_op = storage.size();
+				list.expand(item.first_op, item.op_count, storage);
+				item.first_op = first_op;
+			      }
+			      return storage;
+			    },
+			    page_size_in,
+			    options);
+}
@@ -0,0 +1,56 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef TILES_H
+#define TILES_H
+
+#include <cstddef>
+#include <string>
+
+#include "display_list.h"
+
+class CompactDisplayList;
+
+// Deep-zoom (DZI) preview of a page: a pyramid of levels, each half the
+// resolution of the next, cut into square tiles, for viewers such as
+// OpenSeadragon that only load the tiles in view.
+
+static constexpr unsigned DEFAULT_TILE_SIZE = 256;
+
+struct TilePyramidOptions
+{
+  std::string directory;
+  std::string name;		// writes name.dzi and name_files/
+  double pixels_per_in;		// resolution of the highest level
+  unsigned tile_size;
+  unsigned threads;		// 0 = one per CPU
+  std::string font_file;	// if empty, text isn't drawn
+};
+
+struct TilePyramidStats
+{
+  unsigned levels;
+  std::size_t tiles;
+  std::size_t empty;		// no geometry, culled by bounding box, not written
+  std::size_t rendered;
+  std::size_t reused;		// identical tile already in the store
+};
+
+// Tiles are rendered in parallel.  Each tile is identified by a hash of
+// the part of the display list it shows, and is kept in a store in the
+// tile-store subdirectory of the output directory, with the pyramid
+// entries hard linked to it.  A tile whose hash is already in the store,
+// e.g. from a pyramid of another legend set sharing the directory, is not
+// rendered again.  Tiles with nothing on them aren't written at all; the
+// viewer shows its background, which should be white, in their place.
+TilePyramidStats write_tile_pyramid(const DisplayList& list,
+				    Dimensions page_size_in,
+				    const TilePyramidOptions& options);
+
+// The same, from compact storage, for large jobs.  Each tile decodes only
+// the operations of the items it shows.
+TilePyramidStats write_tile_pyramid(const CompactDisplayList& list,
+				    Dimensions page_size_in,
+				    const TilePyramidOptions& options);
+
+#endif // TILES_H
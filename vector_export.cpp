@@ -0,0 +1,241 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "flatten.h"
+#include "vector_export.h"
+
+static constexpr double HPGL_UNITS_PER_IN = 1016.0;	// 0.025 mm
+static constexpr double HPGL_TOLERANCE_IN = 0.001;
+
+static std::string svg_color(Color color)
+{
+  return std::format("#{0:02x}{1:02x}{2:02x}",
+		     int(std::lround(color.r * 255.0)),
+		     int(std::lround(color.g * 255.0)),
+		     int(std::lround(color.b * 255.0)));
+}
+
+static std::string xml_escape(const std::string& text)
+{
+  std::string result;
+  for (char c: text)
+  {
+    switch (c)
+    {
+    case '<':  result += "&lt;";   break;
+    case '>':  result += "&gt;";   break;
+    case '&':  result += "&amp;";  break;
+    case '"':  result += "&quot;"; break;
+    default:   result += c;
+    }
+  }
+  return result;
+}
+
+static bool paint_closes(DisplayOpKind kind)
+{
+  return ((kind == DisplayOpKind::CLOSE_STROKE) ||
+	  (kind == DisplayOpKind::CLOSE_FILL_STROKE));
+}
+
+static bool paint_strokes(DisplayOpKind kind)
+{
+  return ((kind == DisplayOpKind::STROKE) ||
+	  (kind == DisplayOpKind::CLOSE_STROKE) ||
+	  (kind == DisplayOpKind::FILL_STROKE) ||
+	  (kind == DisplayOpKind::CLOSE_FILL_STROKE));
+}
+
+
+// SVG has y down, so y is flipped about the page height.
+void write_svg(const std::string& filename,
+	       const DisplayList& list,
+	       std::span<const DisplayItem> items,
+	       Dimensions page_size_in)
+{
+  double h = page_size_in.height;
+  std::string svg = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+  svg += std::format("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"{0:g}in\" height=\"{1:g}in\" viewBox=\"0 0 {0:g} {1:g}\">\n",
+		     page_size_in.width, page_size_in.height);
+
+  for (const DisplayItem& item: items)
+  {
+    const DisplayOp& paint = list[item.first_op + item.op_count - 1];
+    if (paint.kind == DisplayOpKind::TEXT)
+    {
+      const DisplayText& text = list.texts()[paint.aux];
+      static constexpr const char* anchors[] = { "start", "middle", "end" };
+      svg += std::format("<text x=\"{0:.6g}\" y=\"{1:.6g}\" font-family=\"Helvetica\" font-size=\"{2:.6g}\" fill=\"{3}\" text-anchor=\"{4}\">{5}</text>\n",
+			 paint.p[0].x, h - paint.p[0].y, text.font_size, svg_color(item.fill_color),
+			 anchors[static_cast<int>(text.horizontal_alignment)], xml_escape(text.text));
+      continue;
+    }
+
+    std::string d;
+    for (std::size_t i = item.first_op; i < item.first_op + item.op_count - 1; i++)
+    {
+      const DisplayOp& op = list[i];
+      switch (op.kind)
+      {
+      case DisplayOpKind::MOVE_TO:
+	d += std::format("M{0:.6g} {1:.6g}", op.p[0].x, h - op.p[0].y);
+	break;
+      case DisplayOpKind::LINE_TO:
+	d += std::format("L{0:.6g} {1:.6g}", op.p[0].x, h - op.p[0].y);
+	break;
+      case DisplayOpKind::CURVE_TO:
+	d += std::format("C{0:.6g} {1:.6g} {2:.6g} {3:.6g} {4:.6g} {5:.6g}",
+			 op.p[0].x, h - op.p[0].y, op.p[1].x, h - op.p[1].y, op.p[2].x, h - op.p[2].y);
+	break;
+      case DisplayOpKind::CLOSE:
+	d += "Z";
+	break;
+      default:
+	break;
+      }
+    }
+    if (paint_closes(paint.kind))
+      d += "Z";
+
+    svg += std::format("<path d=\"{0}\" fill=\"{1}\"", d,
+		       display_op_is_fill(paint.kind) ? svg_color(item.fill_color) : "none");
+    if (display_op_is_fill(paint.kind) && (display_op_fill_rule(paint) == FillRule::EVEN_ODD))
+      svg += " fill-rule=\"evenodd\"";
+    if (paint_strokes(paint.kind))
+      svg += std::format(" stroke=\"{0}\" stroke-width=\"{1:.6g}\"", svg_color(item.stroke_color), item.line_width);
+    svg += "/>\n";
+  }
+  svg += "</svg>\n";
+
+  std::ofstream f(filename, std::ios::binary);
+  f << svg;
+  if (! f)
+    throw std::runtime_error("can't write `" + filename + "'");
+}
+
+
+// Pen up to the start of each subpath, pen down along it.  Points that
+// round to the same plotter unit as the previous one are left out, and
+// subpaths with fewer than two distinct points, such as a move followed
+// by a close, aren't drawn at all.
+static void hpgl_subpath(std::string& hpgl,
+			 const std::vector<Coord>& points)
+{
+  auto units = [](double v) { return long(std::lround(v * HPGL_UNITS_PER_IN)); };
+  std::vector<std::pair<long, long>> path;
+  for (Coord p: points)
+  {
+    std::pair<long, long> u = { units(p.x), units(p.y) };
+    if (path.empty() || (u != path.back()))
+      path.push_back(u);
+  }
+  if (path.size() < 2)
+    return;
+  hpgl += std::format("PU{0},{1};PD", path[0].first, path[0].second);
+  for (std::size_t i = 1; i < path.size(); i++)
+    hpgl += std::format("{0}{1},{2}", (i > 1) ? "," : "", path[i].first, path[i].second);
+  hpgl += ";\n";
+}
+
+void write_hpgl(const std::string& filename,
+		const DisplayList& list,
+		std::span<const DisplayItem> items)
+{
+  std::string hpgl = "IN;SP1;\n";
+  std::vector<Coord> points;
+  std::vector<CubicBezier> curves;
+  std::vector<Coord> curve_points;
+  std::vector<unsigned> curve_counts;
+  for (const DisplayItem& item: items)
+  {
+    const DisplayOp& paint = list[item.first_op + item.op_count - 1];
+    if (! paint_strokes(paint.kind))
+      continue;
+
+    // Flatten all curves of the item at once, rather than one at a time,
+    // so that they fill the lanes of flatten_cubics().  Each starts where
+    // the path is when it is reached below.
+    curves.clear();
+    bool drawing = false;
+    Coord current = { 0.0, 0.0 };
+    Coord start = current;
+    for (std::size_t i = item.first_op; i < item.first_op + item.op_count - 1; i++)
+    {
+      const DisplayOp& op = list[i];
+      if (op.kind == DisplayOpKind::MOVE_TO)
+      {
+	drawing = true;
+	current = start = op.p[0];
+      }
+      else if (! drawing)
+	continue;
+      else if (op.kind == DisplayOpKind::LINE_TO)
+	current = op.p[0];
+      else if (op.kind == DisplayOpKind::CURVE_TO)
+      {
+	curves.push_back({ current, op.p[0], op.p[1], op.p[2] });
+	current = op.p[2];
+      }
+      else if (op.kind == DisplayOpKind::CLOSE)
+	current = start;
+    }
+    curve_points.clear();
+    curve_counts.clear();
+    flatten_cubics(curves, HPGL_TOLERANCE_IN, curve_points, & curve_counts);
+    std::size_t next_curve = 0;
+    std::size_t next_point = 0;
+
+    points.clear();
+    for (std::size_t i = item.first_op; i < item.first_op + item.op_count - 1; i++)
+    {
+      const DisplayOp& op = list[i];
+      switch (op.kind)
+      {
+      case DisplayOpKind::MOVE_TO:
+	hpgl_subpath(hpgl, points);
+	points.assign(1, op.p[0]);
+	break;
+      case DisplayOpKind::LINE_TO:
+	if (! points.empty())
+	  points.push_back(op.p[0]);
+	break;
+      case DisplayOpKind::CURVE_TO:
+	if (! points.empty())
+	{
+	  unsigned count = curve_counts[next_curve++];
+	  points.insert(points.end(), curve_points.begin() + next_point, curve_points.begin() + next_point + count);
+	  next_point += count;
+	}
+	break;
+      case DisplayOpKind::CLOSE:
+	// drawing continues from the start of the closed subpath
+	if (! points.empty())
+	{
+	  Coord start = points.front();
+	  points.push_back(start);
+	  hpgl_subpath(hpgl, points);
+	  points.assign(1, start);
+	}
+	break;
+      default:
+	break;
+      }
+    }
+    if (paint_closes(paint.kind) && (points.size() > 1))
+      points.push_back(points.front());
+    hpgl_subpath(hpgl, points);
+  }
+  hpgl += "PU;SP0;\n";
+
+  std::ofstream f(filename, std::ios::binary);
+  f << hpgl;
+  if (! f)
+    throw std::runtime_error("can't write `" + filename + "'");
+}
@@ -0,0 +1,29 @@
+// Copyright 2023 Eric Smith
+// SPDX-License-Identifier: GPL-3.0-only
+
+#ifndef VECTOR_EXPORT_H
+#define VECTOR_EXPORT_H
+
+#include <span>
+#include <string>
+
+#include "display_list.h"
+
+// Vector output of display lists, other than PDF.  The items are those of
+// display_items(list), so that they can be computed once for several
+// backends.  Both throw std::runtime_error if the file can't be written.
+
+// SVG, with the page size in inches.  Text is left to the viewer's
+// Helvetica.
+void write_svg(const std::string& filename,
+	       const DisplayList& list,
+	       std::span<const DisplayItem> items,
+	       Dimensions page_size_in);
+
+// HP-GL for plotters and cutters: only stroked paths, with curves
+// flattened.  Fills and text aren't drawn.
+void write_hpgl(const std::string& filename,
+		const DisplayList& list,
+		std::span<const DisplayItem> items);
+
+#endif // VECTOR_EXPORT_H
@@ -2,384 +2,22 @@
 // Copyright 2023 Eric Smith
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <chrono>
+#include <cstdio>
 #include <format>
 #include <iostream>
-#include <map>
+#include <memory>
 #include <stdexcept>
 #include <vector>
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
-#include <qpdf/QPDF.hh>
-#include <qpdf/QPDFObjectHandle.hh>
-#include <qpdf/QPDFPageDocumentHelper.hh>
-#include <qpdf/QPDFPageObjectHelper.hh>
-#include <qpdf/QPDFWriter.hh>
-#include <qpdf/QUtil.hh>
-
-#include "content_stream_string.h"
-
-
-static constexpr double MM_PER_IN = 25.4;
-static constexpr double PT_PER_IN = 72.0;
-
-
-static constexpr double PAGE_INSET_LEFT_IN     = 0.625;
-static constexpr double PAGE_INSET_RIGHT_IN    = 0.625;
-static constexpr double PAGE_INSET_TOP_IN      = 0.625;
-static constexpr double PAGE_INSET_BOTTOM_IN   = 1.024;
-
-static constexpr double REG_MARK_SIZE_IN       = 0.250;
-static constexpr double REG_MARK_LINE_WIDTH_MM = 0.5;
-
-
-struct RegistrationGeometry
-{
-  double inset_left_in;
-  double inset_right_in;
-  double inset_top_in;
-  double inset_bottom_in;
-
-  double square_size_in;
-  double line_length_in;
-  double line_width_in;
-};
-
-
-struct OverlayGeometry
-{
-  double width_in;
-  double height_in;
-  double corner_radius_in;
-
-  double key_col_pitch_in;
-  double key_row_pitch_in;
-  double key_row_1_offset_in;
-
-  double key_width_in;
-  double key_height_in;
-  double key_corner_radius_in;
-};
-
-
-static std::string create_registration(double page_width_in,
-				       double page_height_in,
-				       const RegistrationGeometry& geom)
-{
-  ContentStreamString s(true);
-
-  s.set_line_width(geom.line_width_in);
-  s.set_color_space("DeviceRGB", true, true);
-  s.set_color(BLACK, true, true);
-
-  // square at top left of cut area
-  s.move_to({ geom.inset_left_in,                                        page_height_in - geom.inset_top_in});	// top left
-  s.rect({ geom.square_size_in, geom.square_size_in });
-  s.path_close_fill_stroke();
-  
-  // right angle at bottom left of cut area
-  s.move_to({ geom.inset_left_in,                                        geom.inset_bottom_in + geom.line_length_in });
-  s.line_to({ geom.inset_left_in,                                        geom.inset_bottom_in });
-  s.line_to({ geom.inset_left_in + geom.line_length_in,                  geom.inset_bottom_in });
-  s.path_stroke();
-
-  // right angle at top left of cut area
-  s.move_to({ page_width_in - geom.inset_right_in - geom.line_length_in, page_height_in - geom.inset_top_in });
-  s.line_to({ page_width_in - geom.inset_right_in,                       page_height_in - geom.inset_top_in });
-  s.line_to({ page_width_in - geom.inset_right_in,                       page_height_in - geom.inset_top_in - geom.line_length_in});
-  s.path_stroke();
-
-  return s;
-}
-
-
-static std::map<int, std::string> legend_map =
-{
-#if 1
-  { 11, "ln e^x"   },
-  { 12, "log 10^x" },
-  { 13, "? fact"   },
-  { 14, "sin -1"   },
-  { 15, "cos -1"   },
-  { 16, "tan -1"   },
-#else
-  { 11, "SL"       },
-  { 12, "SR"       },
-  { 13, "RL"       },
-  { 14, "RR"       },
-  { 15, "RLn"      },
-  { 16, "RRn"      },
-#endif
-  { 17, "MASKL"    },
-  { 18, "MASKR"    },
-  { 19, "RMD"      },
-  { 10, "XOR"      },
-
-  { 21, "x<>(i)"   },
-  { 22, "x<>I"     },
-  { 23, "SH HEX"   },
-  { 24, "SH DEC"   },
-  { 25, "SH OCT"   },
-  { 26, "SH BIN"   },
-  { 27, "SB"       },
-  { 28, "CB"       },
-  { 29, "B?"       },
-  { 30, "AND"      },
-
-  { 31, "(i)"      },
-  { 32, "I"        },
-  { 33, "CL PRGM"  },
-  { 34, "CL REG"   },
-  { 35, "CL PRFX"  },
-  { 36, "WINDOW"   },
-  { 37, "1s COMP"  },
-  { 38, "2s COMP"  },
-  { 39, "UNSIGNED" },
-  { 40, "NOT"      },
-
-  { 41, ""         },
-  { 42, ""         },
-  { 43, ""         },
-  { 44, "WSIZE"    },
-  { 45, "FLOAT"    },
-
-  { 47, "MEM"      },
-  { 48, "STATUS"   },
-  { 49, "EEX"      },
-  { 40, "OR"       },
-};
-
-
-static std::string create_overlay(const OverlayGeometry& geom,
-				  bool show_outlines,
-				  bool show_legends)
-{
-  std::string s;
-  double line_width_mm = 0.1;
-  double line_width_in = line_width_mm / MM_PER_IN;
-
-  ContentStreamString cs(true);
-  cs.set_line_width(line_width_mm / MM_PER_IN);
-  cs.set_color(BLACK, false, true);	// set stroke color
-
-  if (show_outlines)
-  {
-    cs.move_to({ 0.0, geom.height_in });
-    cs.rounded_rect({ geom.width_in, geom.height_in}, geom.corner_radius_in);
-    cs.path_close_stroke();
-  }
-
-  for (int row = 0; row < 4; row++)
-  {
-    double y = geom.height_in - (row * geom.key_row_pitch_in + geom.key_row_1_offset_in);
-    for (int col = 0; col < 10; col++)
-    {
-      if ((row == 3) && (col == 5))
-	continue;  // ignore bottom half of enter key
-      double key_height = geom.key_height_in;
-      if ((row == 2) && (col == 5))
-	key_height += geom.key_row_pitch_in;	// if top half of enter key, it's a tall key
-      int user_kc = (row + 1) * 10 + (col + 1) % 10;
-
-      double x = geom.width_in / 2.0 - (5 * geom.key_col_pitch_in) + (geom.key_col_pitch_in - geom.key_width_in) / 2.0 + col * geom.key_col_pitch_in;
-
-      if (show_outlines)
-      {
-	cs.move_to({ x, y });
-	cs.rounded_rect({ geom.key_width_in, key_height }, geom.key_corner_radius_in);
-	cs.path_close_stroke();
-      }
-
-      if (show_legends)
-      {
-	cs.text({ x + geom.key_width_in / 2.0 - 0.125, y + 0.03 },
-		HorizontalAlignment::CENTER,
-		legend_map[user_kc],
-		"F1",
-		6.0 / PT_PER_IN);
-      }
-    }
-  }
-
-  return cs;
-}
-
-
-constexpr RegistrationGeometry cameo4_no_mat_reg_geometry =
-{
-  .inset_left_in   = PAGE_INSET_LEFT_IN,
-  .inset_right_in  = PAGE_INSET_RIGHT_IN,
-  .inset_top_in    = PAGE_INSET_TOP_IN,
-  .inset_bottom_in = PAGE_INSET_BOTTOM_IN,
-
-  .square_size_in  = REG_MARK_SIZE_IN,
-  .line_length_in  = REG_MARK_SIZE_IN,
-  .line_width_in   = REG_MARK_LINE_WIDTH_MM / MM_PER_IN,
-};
-
-
-static constexpr float OVERLAY_MINIMUM_Y_GAP_IN = 0.1;
-
-static constexpr float ADDITIONAL_INSET_IN = 0.1;
-
-static QPDFObjectHandle createPageContents(QPDF& pdf,
-					   double page_width_in,
-					   double page_height_in,
-					   const RegistrationGeometry& reg_geom,
-					   const OverlayGeometry& geom,
-					   bool show_outlines,
-					   bool show_reg_marks,
-					   bool show_legends)
-{
-  // Create a stream that displays our image and the given text in
-  // our font.
-  std::string contents;
-
-  static double top_in = reg_geom.inset_top_in + ADDITIONAL_INSET_IN;
-  std::cout << "top_in " << top_in << "\n";
-  static double bottom_in = page_height_in - (reg_geom.inset_bottom_in + ADDITIONAL_INSET_IN);
-  std::cout << "bottom_in " << bottom_in << "\n";
-  static double available_height_in = bottom_in - top_in;
-  std::cout << "available_height_in_in " << available_height_in << "\n";
-  static int y_count = available_height_in / geom.height_in;
-  if ((available_height_in - ((y_count * geom.height_in) / (y_count - 1))) < OVERLAY_MINIMUM_Y_GAP_IN)
-    y_count--;
-  static double overlay_y_gap_in = (available_height_in - (y_count * geom.height_in)) / (y_count - 1);
-  std::cout << "overlay_y_gap_in " << overlay_y_gap_in << "\n";
-
-  // transform to inch coordinate system, origin at left
-  contents = ("q "                                // push graphics stack
-	      + std::format("{0:g} 0 0 {0:g} 0 0 cm ", PT_PER_IN)
-	      );
-
-  if (show_reg_marks)
-  {
-    contents += "q\n";
-    contents += create_registration(page_width_in, page_height_in, cameo4_no_mat_reg_geometry);
-    contents += "Q\n";
-  }
-
-  for (int y = 0; y < y_count; y++)
-  {
-    std::cout << "overlay " << y << "\n";
-    double left = (page_width_in - geom.width_in) / 2.0;
-    std::cout << "left " << left << "\n";
-    double top = top_in + (y * (geom.height_in + overlay_y_gap_in));
-    std::cout << "top " << top << "\n";
-    double bottom = top + geom.height_in;
-    std::cout << "bottom " << bottom << "\n";
-
-    // transform to inch coordinate system, origin at bottom left
-    // XXX why the heck do I need to subtract 1.75 from bottom for HP Voyager,
-    // ? for SwissMicros???
-    contents += ("q "
- 		 + std::format("1 0 0 1 {0:g} {1:g} cm\n", left, bottom - 1.55));
-
-    contents += create_overlay(geom, show_outlines, show_legends);
-
-    contents += "Q\n";
-  }
-
-  contents += "Q\n";
-
-  return pdf.newStream(contents);
-  //return QPDFObjectHandle::newStream(&pdf, contents);
-}
-
-
-constexpr double letter_width_in = 8.5;
-constexpr double letter_height_in = 11.0;
-
-constexpr double letter_width_pt = letter_width_in * PT_PER_IN;
-constexpr double letter_height_pt = letter_height_in * PT_PER_IN;
-
-
-static void create_page(QPDFPageDocumentHelper &dh,
-			std::string font_name,
-			QPDFObjectHandle font_obj,
-			RegistrationGeometry reg_geom,
-			const OverlayGeometry& geom,
-			bool do_outlines,
-			bool do_reg_marks,
-			bool do_legends)
-{
-  QPDF& pdf(dh.getQPDF());
-  
-  // Create direct objects as needed by the page dictionary.
-  QPDFObjectHandle procset = "[/PDF /Text]"_qpdf;
-
-  QPDFObjectHandle rfont = QPDFObjectHandle::newDictionary();
-  rfont.replaceKey("/" + font_name, font_obj);
-
-  QPDFObjectHandle resources = QPDFObjectHandle::newDictionary();
-  resources.replaceKey("/ProcSet", procset);
-  resources.replaceKey("/Font", rfont);
-
-  // Create the page content stream
-  QPDFObjectHandle contents =
-    createPageContents(pdf,
-		       letter_width_in,
-		       letter_height_in,
-		       reg_geom,
-		       geom,
-		       do_outlines,  // show_outlines
-		       do_reg_marks, // show_reg_marks
-		       do_legends);  // show legends
-
-  // Create the page dictionary
-  std::string page_dict_stream_str = ("<<"
-				      " /Type /Page"
-				      " /MediaBox [0 0 "
-				      + std::format("{0:g} {1:g}", letter_width_pt, letter_height_pt) +
-				      "]"
-				      ">>");
-
-  QPDFObjectHandle page = pdf.makeIndirectObject(QPDFObjectHandle::parse(page_dict_stream_str));
-
-  page.replaceKey("/Contents", contents);
-  page.replaceKey("/Resources", resources);
-
-  // Add the page to the PDF file
-  dh.addPage(page, false);
-}
-
-
-static void create_pdf(const std::string filename,
-		       const RegistrationGeometry& reg_geom,
-		       const OverlayGeometry& geom,
-		       bool do_outlines,
-		       bool do_reg_marks,
-		       bool do_legends)
-{
-  QPDF pdf;
-
-  pdf.emptyPDF();
-
-  QPDFObjectHandle font_obj = pdf.makeIndirectObject(
-        // line-break
-        "<<"
-        " /Type /Font"
-        " /Subtype /Type1"
-        " /Name /F1"
-        " /BaseFont /Helvetica"
-        " /Encoding /WinAnsiEncoding"
-        ">>"_qpdf);
-
-  QPDFPageDocumentHelper dh(pdf);
-
-  create_page(dh,
-	      "F1",        // font_name
-	      font_obj,    // font_obj
-	      reg_geom,
-	      geom,
-	      do_outlines,
-	      do_reg_marks,
-	      do_legends);
-
-  QPDFWriter w(pdf, filename.c_str());
-  w.write();
-}
+#include "compact_display_list.h"
+#include "document.h"
+#include "shm_cache.h"
+#include "svg_import.h"
+#include "tiles.h"
 
 
 void conflicting_options(const po::variables_map& vm,
@@ -412,57 +50,54 @@ void conflicting_options(const po::variables_map& vm,
 }
 
 
-constexpr OverlayGeometry hp_geometry =
-{
-  .width_in             = 4.65,
-  .height_in            = 2.10,
-  .corner_radius_in     = 0.025,
-
-  .key_col_pitch_in     = 0.45,
-  .key_row_pitch_in     = 0.50,
-  .key_row_1_offset_in  = 0.133,
-
-  .key_width_in         = 0.34,
-  .key_height_in        = 0.32,
-  .key_corner_radius_in = 0.025
-};
-
-constexpr OverlayGeometry sm_geometry =
-{
-  .width_in             = 4.75,
-  .height_in            = 1.95,
-  .corner_radius_in     = 0.025,
-
-  .key_col_pitch_in     = 0.475,
-  .key_row_pitch_in     = 0.475,
-  .key_row_1_offset_in  = 0.175,
-
-  .key_width_in         = 0.33,
-  .key_height_in        = 0.30,
-  .key_corner_radius_in = 0.025
-};
-
-
 int main(int argc, char* argv[])
 {
   std::string type;
   std::string model;
-  bool do_reg_marks = false;
-  bool do_outlines = false; 
-  bool do_legends = false;
+  PageOptions options = { false, false, false, false, {}, ArtworkUse::PRINT };
   const OverlayGeometry* geom = nullptr;
+  std::unique_ptr<ShmCache> cache;
+  unsigned threads = 1;
+  bool estimate = false;
+  bool verbose = false;
+  bool compact = false;
+  TilePyramidOptions tile_options = { "", "", 600.0, DEFAULT_TILE_SIZE, 1, "" };
+  std::string record_filename;
+  std::string plan_filename;
+  std::vector<std::string> export_formats;
+  double export_pixels_per_in = 150.0;
 
   try
   {
     po::options_description desc("Options");
     desc.add_options()
       ("help,h",   "output help message")
+      ("verbose,v", "report the page layout, and the common-line cut")
       ("cut,c",    "cut marks")
       ("print,p",  "print (registration and legends)")
       ("all,a",    "all (registration, legends, and cut marks)")
       ("hp",       "HP calculator")
       ("sm",       "Swiss Micros calculator")
       ("output,o", po::value<std::string>(), "output PDF file")
+      ("cache",    "share generated data with other processes of the user via a cache in $XDG_RUNTIME_DIR or /dev/shm")
+      ("cache-file", po::value<std::string>(), "cache file (implies --cache)")
+      ("estimate", "only estimate the pages, operators, uncompressed content bytes and generation time of the output")
+      ("common-line", "place overlays with no gap, and cut shared edges once")
+      ("threads,j", po::value<unsigned>(), "worker threads for generating overlays (0 = one per CPU)")
+      ("logo",     po::value<std::string>(), "SVG artwork for each overlay")
+      ("logo-use", po::value<std::string>()->default_value("print"), "use of the artwork: print, cut, or both")
+      ("logo-box", po::value<std::string>(), "box for the artwork, in overlay inches: left,bottom,width,height")
+      ("tiles",    po::value<std::string>(), "write a deep-zoom tiled preview to the directory, instead of a PDF file")
+      ("tile-dpi", po::value<double>()->default_value(600.0), "resolution of the highest preview level")
+      ("compact",  "with --tiles, keep the recorded page in compact form while rendering, for large jobs")
+      ("font-file", po::value<std::string>(), "font for legends in previews")
+      ("record",   po::value<std::string>(), "also write the drawing operations of the page to a file, for --diff")
+      ("diff",     po::value<std::vector<std::string>>()->multitoken(),
+       "compare two recordings, or two directories of them: --diff OLD NEW")
+      ("highlight", po::value<std::string>(), "with --diff, write the new layout with the changes outlined to a PDF file (or directory)")
+      ("plan",     po::value<std::string>(), "consolidate a queue of orders onto sheets, instead of one model per file")
+      ("export",   po::value<std::string>(), "write the page in several formats at once, e.g. pdf,svg,plt,png")
+      ("export-dpi", po::value<double>()->default_value(150.0), "resolution of exported png files")
       ;
 
     po::variables_map vm;
@@ -476,26 +111,98 @@ int main(int argc, char* argv[])
       return 0;
     }
 
+    options.common_line = vm.count("common-line");
+    estimate = vm.count("estimate");
+    verbose = vm.count("verbose");
+
+    if (vm.count("threads"))
+      threads = vm["threads"].as<unsigned>();
+
+    if (vm.count("logo"))
+    {
+      if (! vm.count("logo-box"))
+	throw std::logic_error("--logo requires --logo-box");
+      Coord origin;
+      Dimensions box;
+      std::string spec = vm["logo-box"].as<std::string>();
+      if (std::sscanf(spec.c_str(), "%lf,%lf,%lf,%lf", & origin.x, & origin.y, & box.width, & box.height) != 4)
+	throw std::logic_error("bad --logo-box `" + spec + "'");
+      std::string use = vm["logo-use"].as<std::string>();
+      if (use == "print")
+	options.artwork_use = ArtworkUse::PRINT;
+      else if (use == "cut")
+	options.artwork_use = ArtworkUse::CUT;
+      else if (use == "both")
+	options.artwork_use = ArtworkUse::BOTH;
+      else
+	throw std::logic_error("bad --logo-use `" + use + "'");
+      options.artwork = import_svg_file(vm["logo"].as<std::string>());
+      fit_svg_paths(options.artwork, origin, box);
+      std::size_t nodes = svg_node_count(options.artwork);
+      simplify_svg_paths(options.artwork, ARTWORK_TOLERANCE_IN);
+      std::cout << std::format("logo: {0} nodes, simplified to {1}\n", nodes, svg_node_count(options.artwork));
+    }
+
+    if (vm.count("tiles"))
+      tile_options.directory = vm["tiles"].as<std::string>();
+    compact = vm.count("compact");
+    if (compact && ! vm.count("tiles"))
+      throw std::logic_error("--compact requires --tiles");
+    tile_options.pixels_per_in = vm["tile-dpi"].as<double>();
+    if (vm.count("font-file"))
+      tile_options.font_file = vm["font-file"].as<std::string>();
+
+    if (vm.count("diff"))
+    {
+      std::vector<std::string> paths = vm["diff"].as<std::vector<std::string>>();
+      if (paths.size() != 2)
+	throw std::logic_error("--diff requires two recordings");
+      std::string highlight;
+      if (vm.count("highlight"))
+	highlight = vm["highlight"].as<std::string>();
+      auto start = std::chrono::steady_clock::now();
+      std::size_t changes = diff_recordings(paths[0], paths[1], highlight);
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << std::format("{0} changed elements, {1:.1f} ms\n", changes, elapsed.count());
+      return 0;
+    }
+
+    if (vm.count("record"))
+      record_filename = vm["record"].as<std::string>();
+    if (vm.count("plan"))
+      plan_filename = vm["plan"].as<std::string>();
+    if (vm.count("export"))
+    {
+      std::string list = vm["export"].as<std::string>();
+      for (std::size_t start = 0; start <= list.length(); )
+      {
+	std::size_t end = std::min(list.find(',', start), list.length());
+	export_formats.push_back(list.substr(start, end - start));
+	start = end + 1;
+      }
+    }
+    export_pixels_per_in = vm["export-dpi"].as<double>();
+
     conflicting_options(vm, {"cut", "print", "all"}, true);
     conflicting_options(vm, {"hp", "sm"});
 
     if (vm.count("cut"))
     {
       type = "cut";
-      do_outlines  = true;
+      options.show_outlines = true;
     }
     if (vm.count("print"))
     {
       type = "print";
-      do_reg_marks = true;
-      do_legends = true;
+      options.show_reg_marks = true;
+      options.show_legends = true;
     }
     if (vm.count("all"))
     {
       type = "all";
-      do_reg_marks = true;
-      do_legends = true;
-      do_outlines  = true;
+      options.show_reg_marks = true;
+      options.show_legends = true;
+      options.show_outlines = true;
     }
 
     if (vm.count("sm"))
@@ -508,6 +215,13 @@ int main(int argc, char* argv[])
       model = "voyager";
       geom = & hp_geometry;
     }
+
+    if (vm.count("cache-file"))
+      cache = std::make_unique<ShmCache>(vm["cache-file"].as<std::string>());
+    else if (vm.count("cache"))
+      cache = std::make_unique<ShmCache>();
+    if (cache && ! cache->is_open())
+      cache.reset();	// the cache is only an optimization
   }
   catch (std::exception& e)
   {
@@ -515,13 +229,141 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if (estimate)
+  {
+    try
+    {
+      auto start = std::chrono::steady_clock::now();
+      Estimate e = (plan_filename.empty()
+		    ? estimate_pdf(cameo4_no_mat_reg_geometry, *geom, options)
+		    : estimate_plan(plan_filename, cameo4_no_mat_reg_geometry, options));
+      std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << std::format("pages {0}\nstreams {1}\noperators {2}\nuncompressed_bytes {3}\ngeneration_ms {4:.3f}\n",
+			       e.pages, e.streams, e.operators, e.uncompressed_bytes, e.generation_s * 1000.0);
+      std::cout << std::format("estimate_us {0:.1f}\n", elapsed.count());
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "error: " << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (! plan_filename.empty())
+  {
+    try
+    {
+      create_plan(plan_filename,
+		  "plan-overlay-" + type + ".pdf",
+		  "plan-overlay-" + type + ".csv",
+		  cameo4_no_mat_reg_geometry,
+		  options,
+		  cache.get(),
+		  threads);
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "error: " << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (! export_formats.empty())
+  {
+    try
+    {
+      DisplayList page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, *geom, options);
+      ExportTimes times = export_page(model + "-overlay-" + type, export_formats, page,
+				      tile_options.font_file, export_pixels_per_in, true);
+      double sequential_ms = 0.0;
+      for (std::size_t i = 0; i < export_formats.size(); i++)
+      {
+	std::cout << std::format("{0}: {1:.1f} ms\n", export_formats[i], times.backend_ms[i]);
+	sequential_ms += times.backend_ms[i];
+      }
+      std::cout << std::format("wall {0:.1f} ms, backends {1:.1f} ms in total\n", times.wall_ms, sequential_ms);
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "error: " << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (! record_filename.empty())
+  {
+    try
+    {
+      write_recording(record_filename,
+		      record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, *geom, options));
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "error: " << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  if (! tile_options.directory.empty())
+  {
+    tile_options.name = model + "-overlay-" + type;
+    tile_options.threads = threads;
+    try
+    {
+      DisplayList page = record_page(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry, *geom, options);
+      auto start = std::chrono::steady_clock::now();
+      TilePyramidStats stats;
+      if (compact)
+      {
+	CompactDisplayList compact_page(page);
+	page = DisplayList();	// only the compact form is kept
+	stats = write_tile_pyramid(compact_page, { letter_width_in, letter_height_in }, tile_options);
+      }
+      else
+	stats = write_tile_pyramid(page, { letter_width_in, letter_height_in }, tile_options);
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << std::format("{0} levels, {1} tiles: {2} empty, {3} rendered, {4} reused, {5:.1f} ms\n",
+			       stats.levels, stats.tiles, stats.empty, stats.rendered, stats.reused,
+			       elapsed.count());
+    }
+    catch (std::exception& e)
+    {
+      std::cerr << "error: " << e.what() << "\n";
+      return 1;
+    }
+    return 0;
+  }
+
+  if (verbose)
+  {
+    PageLayout layout = compute_page_layout(letter_width_in, letter_height_in, cameo4_no_mat_reg_geometry,
+					    *geom, options.common_line);
+    std::cout << "top_in " << layout.top_in << "\n";
+    std::cout << "bottom_in " << layout.bottom_in << "\n";
+    std::cout << "available_height_in_in " << layout.available_height_in << "\n";
+    std::cout << "overlay_y_gap_in " << layout.overlay_y_gap_in << "\n";
+    for (std::size_t y = 0; y < layout.slots.size(); y++)
+    {
+      std::cout << "overlay " << y << "\n";
+      std::cout << "left " << layout.slots[y].left_in << "\n";
+      std::cout << "top " << layout.slots[y].bottom_in - geom->height_in << "\n";
+      std::cout << "bottom " << layout.slots[y].bottom_in << "\n";
+    }
+  }
+
   std::string filename = model + "-overlay-" + type + ".pdf";
-  create_pdf(filename,
-	     cameo4_no_mat_reg_geometry,
-	     *geom,
-	     do_outlines,
-	     do_reg_marks,
-	     do_legends);
+  CommonLineStats stats = create_pdf(filename,
+				     cameo4_no_mat_reg_geometry,
+				     *geom,
+				     options,
+				     cache.get(),
+				     threads);
+  if (verbose && options.show_outlines && options.common_line)
+    std::cout << std::format("common line: {0} paths, cut length {1:.2f} in of {2:.2f} in, travel {3:.2f} in\n",
+			     stats.path_count, stats.cut_length_in, stats.original_length_in, stats.travel_in);
 
   return 0;
 }